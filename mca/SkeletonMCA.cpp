@@ -0,0 +1,521 @@
+// skeleton-mca: lowers the hottest basic blocks of LLVM IR modules to machine
+// code for a chosen CPU, runs them through the llvm-mca simulator, and reports
+// throughput, resource pressure and the bottleneck of every loop they are in.
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInstrAnalysis.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCObjectFileInfo.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCTargetOptions.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/MCA/Context.h"
+#include "llvm/MCA/CustomBehaviour.h"
+#include "llvm/MCA/HWEventListener.h"
+#include "llvm/MCA/InstrBuilder.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/TargetParser/Host.h"
+
+#include "../skeleton/Profile.h"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+
+using namespace llvm;
+using namespace skeleton;
+
+static cl::list<std::string> InputFiles(cl::Positional, cl::OneOrMore,
+                                        cl::desc("<IR or bitcode files>"));
+
+static cl::opt<std::string> TripleName(
+    "mtriple", cl::desc("Target triple for modules that have none (default: host)"));
+
+static cl::opt<std::string> MCPU(
+    "mcpu", cl::desc("CPU to simulate, or 'native' (default: each function's target-cpu)"));
+
+static cl::opt<std::string> MAttr(
+    "mattr", cl::desc("Target features, overriding each function's target-features"));
+
+static cl::opt<unsigned> TopBlocks("n", cl::desc("Number of hottest blocks to simulate"),
+                                   cl::init(10));
+
+static cl::opt<unsigned> Iterations("iterations",
+                                    cl::desc("Iterations of each block to simulate"),
+                                    cl::init(100));
+
+namespace {
+
+// Marks the start of a block in the generated assembly.
+constexpr StringLiteral Marker = "skeleton-mca ";
+
+struct HotBlock {
+    unsigned Module;
+    BasicBlock *BB;
+    std::string Name;     // block name, or its 1-based index
+    std::string LoopName; // function:header of its innermost loop, or function
+    unsigned LoopDepth;
+    double Executions;
+    bool PerCall;
+};
+
+struct Simulation {
+    std::string Error; // why the block could not be simulated
+    std::string CPU;
+    unsigned Instructions = 0;
+    double Cycles = 0; // per iteration: the block's reciprocal throughput
+    double UOps = 0;   // per iteration
+    unsigned DispatchWidth = 0;
+    std::vector<std::pair<std::string, double>> Pressure; // per unit and iteration
+    std::string Bottleneck;
+};
+
+std::string loopName(const Function &F, const Loop *L) {
+    if (!L)
+        return F.getName().str();
+    const BasicBlock *Header = L->getHeader();
+    return F.getName().str() + ":" + (Header->hasName() ? Header->getName().str() : "loop");
+}
+
+// Collects the instructions the assembly parser produces.
+class InstCollector : public MCStreamer {
+public:
+    explicit InstCollector(MCContext &Ctx) : MCStreamer(Ctx) {}
+
+    std::vector<MCInst> Insts;
+
+    void emitInstruction(const MCInst &Inst, const MCSubtargetInfo &) override {
+        Insts.push_back(Inst);
+    }
+    bool emitSymbolAttribute(MCSymbol *, MCSymbolAttr) override { return true; }
+    void emitCommonSymbol(MCSymbol *, uint64_t, Align) override {}
+    void emitZerofill(MCSection *, MCSymbol *, uint64_t, Align, SMLoc) override {}
+};
+
+// Sums the resource cycles of issued instructions and the dispatched micro-ops.
+// Issue events name each resource by its index in the scheduling model.
+class PressureListener : public mca::HWEventListener {
+public:
+    explicit PressureListener(const MCSchedModel &SM) : Cycles(SM.getNumProcResourceKinds()) {}
+
+    std::vector<double> Cycles; // by processor resource index
+    uint64_t UOps = 0;
+
+    void onEvent(const mca::HWInstructionEvent &Event) override {
+        if (Event.Type == mca::HWInstructionEvent::Issued) {
+            const auto &Issued = static_cast<const mca::HWInstructionIssuedEvent &>(Event);
+            for (const auto &Use : Issued.UsedResources)
+                Cycles[Use.first.first] +=
+                    double(Use.second.getNumerator()) / Use.second.getDenominator();
+        } else if (Event.Type == mca::HWInstructionEvent::Dispatched) {
+            UOps += static_cast<const mca::HWInstructionDispatchedEvent &>(Event).MicroOpcodes;
+        }
+    }
+};
+
+// Picks the TopBlocks blocks with the most profile counts over all modules.
+// Without a profile, estimates are per call of each function and cannot rank
+// blocks of different functions, so it picks the TopBlocks blocks of each
+// function instead. Blocks holding nothing but a terminator are not worth
+// simulating.
+std::vector<HotBlock> selectHotBlocks(ArrayRef<std::unique_ptr<Module>> Modules) {
+    std::vector<HotBlock> Blocks;
+    for (unsigned MI = 0; MI < Modules.size(); ++MI) {
+        Module &M = *Modules[MI];
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+        PassBuilder PB;
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+        ProfileSummaryInfo &PSI = MAM.getResult<ProfileSummaryAnalysis>(M);
+
+        for (Function &F : M) {
+            if (F.isDeclaration())
+                continue;
+            FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+            LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+            unsigned Index = 0;
+            for (BasicBlock &BB : F) {
+                ++Index;
+                if (BB.sizeWithoutDebug() - std::distance(BB.phis().begin(), BB.phis().end()) < 2)
+                    continue;
+                const Loop *L = LI.getLoopFor(&BB);
+                Blocks.push_back({MI, &BB,
+                                  BB.hasName() ? BB.getName().str() : "#" + std::to_string(Index),
+                                  loopName(F, L), L ? L->getLoopDepth() : 0, Prof.blockCount(BB),
+                                  !Prof.hasProfile()});
+            }
+        }
+    }
+    auto ByExecutions = [](const HotBlock &A, const HotBlock &B) {
+        return A.Executions > B.Executions;
+    };
+    if (llvm::none_of(Blocks, [](const HotBlock &HB) { return HB.PerCall; })) {
+        llvm::stable_sort(Blocks, ByExecutions);
+        if (Blocks.size() > TopBlocks)
+            Blocks.resize(TopBlocks);
+        return Blocks;
+    }
+
+    // Blocks are still in function order here.
+    std::vector<HotBlock> Kept;
+    for (auto Begin = Blocks.begin(); Begin != Blocks.end();) {
+        const Function *F = Begin->BB->getParent();
+        auto End = std::find_if(Begin, Blocks.end(), [&](const HotBlock &HB) {
+            return HB.BB->getParent() != F;
+        });
+        std::stable_sort(Begin, End, ByExecutions);
+        Kept.insert(Kept.end(), Begin, Begin + std::min<size_t>(TopBlocks, End - Begin));
+        Begin = End;
+    }
+    return Kept;
+}
+
+// Simulates the instructions of one block, given as assembly text.
+Simulation simulate(const Target &T, const Triple &TT, StringRef CPU, StringRef Features,
+                    StringRef Asm) {
+    Simulation Sim;
+    Sim.CPU = CPU.str();
+    std::unique_ptr<MCRegisterInfo> MRI(T.createMCRegInfo(TT.str()));
+    MCTargetOptions MCOptions;
+    std::unique_ptr<MCAsmInfo> MAI(T.createMCAsmInfo(*MRI, TT.str(), MCOptions));
+    std::unique_ptr<MCSubtargetInfo> STI(T.createMCSubtargetInfo(TT.str(), CPU, Features));
+    std::unique_ptr<MCInstrInfo> MCII(T.createMCInstrInfo());
+    std::unique_ptr<MCInstrAnalysis> MCIA(T.createMCInstrAnalysis(MCII.get()));
+    const MCSchedModel &SM = STI->getSchedModel();
+    if (!SM.hasInstrSchedModel()) {
+        Sim.Error = "no scheduling model for CPU '" + CPU.str() + "'";
+        return Sim;
+    }
+
+    SourceMgr SrcMgr;
+    SrcMgr.AddNewSourceBuffer(MemoryBuffer::getMemBuffer(Asm, "block"), SMLoc());
+    MCContext Ctx(TT, MAI.get(), MRI.get(), STI.get(), &SrcMgr);
+    std::unique_ptr<MCObjectFileInfo> MOFI(T.createMCObjectFileInfo(Ctx, /*PIC=*/false));
+    Ctx.setObjectFileInfo(MOFI.get());
+    InstCollector Collector(Ctx);
+    std::unique_ptr<MCAsmParser> Parser(createMCAsmParser(SrcMgr, Ctx, Collector, *MAI));
+    std::unique_ptr<MCTargetAsmParser> TAP(
+        T.createMCAsmParser(*STI, *Parser, *MCII, MCOptions));
+    if (!TAP) {
+        Sim.Error = "no assembly parser for " + TT.str();
+        return Sim;
+    }
+    Parser->setTargetParser(*TAP);
+    if (Parser->Run(/*NoInitialTextSection=*/false, /*NoFinalize=*/true)) {
+        Sim.Error = "could not parse the generated assembly";
+        return Sim;
+    }
+    Sim.Instructions = Collector.Insts.size();
+    if (Collector.Insts.empty()) {
+        Sim.Error = "no machine instructions";
+        return Sim;
+    }
+
+    mca::InstrumentManager IM(*STI, *MCII);
+    mca::InstrBuilder IB(*STI, *MCII, *MRI, MCIA.get(), IM);
+    SmallVector<std::unique_ptr<mca::Instruction>, 16> Lowered;
+    for (const MCInst &Inst : Collector.Insts) {
+        Expected<std::unique_ptr<mca::Instruction>> I = IB.createInstruction(Inst, {});
+        if (!I) {
+            Sim.Error = toString(I.takeError());
+            return Sim;
+        }
+        Lowered.push_back(std::move(*I));
+    }
+
+    mca::Context MCA(*MRI, *STI);
+    mca::CircularSourceMgr Source(Lowered, Iterations);
+    mca::CustomBehaviour CB(*STI, Source, *MCII);
+    mca::PipelineOptions Options(/*UOPQSize=*/0, /*DecThr=*/0, /*DW=*/0, /*RFS=*/0,
+                                 /*LQS=*/0, /*SQS=*/0, /*NoAlias=*/true);
+    std::unique_ptr<mca::Pipeline> Pipeline = MCA.createDefaultPipeline(Options, Source, CB);
+    PressureListener Listener(SM);
+    Pipeline->addEventListener(&Listener);
+    Expected<unsigned> Cycles = Pipeline->run();
+    if (!Cycles) {
+        Sim.Error = toString(Cycles.takeError());
+        return Sim;
+    }
+
+    Sim.Cycles = double(*Cycles) / Iterations;
+    Sim.UOps = double(Listener.UOps) / Iterations;
+    Sim.DispatchWidth = SM.IssueWidth;
+    for (unsigned I = 1, E = SM.getNumProcResourceKinds(); I < E; ++I) {
+        const MCProcResourceDesc &Desc = *SM.getProcResource(I);
+        if (Listener.Cycles[I] > 0)
+            Sim.Pressure.emplace_back(Desc.Name,
+                                      Listener.Cycles[I] / Desc.NumUnits / Iterations);
+    }
+    llvm::stable_sort(Sim.Pressure, [](const auto &A, const auto &B) {
+        return A.second > B.second;
+    });
+
+    // A block runs as fast as its busiest port, the dispatch width and its
+    // dependency chains allow: name whichever comes within 15% of the result.
+    if (!Sim.Pressure.empty() && Sim.Pressure.front().second >= 0.85 * Sim.Cycles)
+        Sim.Bottleneck = Sim.Pressure.front().first;
+    else if (Sim.DispatchWidth && Sim.UOps / Sim.DispatchWidth >= 0.85 * Sim.Cycles)
+        Sim.Bottleneck = "dispatch width";
+    else
+        Sim.Bottleneck = "dependency chains";
+    return Sim;
+}
+
+// Places a marker comment at the start of every block of the functions that
+// hold hot blocks, and returns the module's assembly. The marker numbers are
+// indices into Blocks, or Blocks.size() for blocks that are not simulated.
+Expected<std::string> emitMarkedAssembly(Module &M, TargetMachine &TM,
+                                         ArrayRef<HotBlock> Blocks, unsigned ModuleIndex) {
+    DenseMap<const BasicBlock *, unsigned> Ids;
+    SmallPtrSet<Function *, 8> Functions;
+    for (unsigned I = 0; I < Blocks.size(); ++I)
+        if (Blocks[I].Module == ModuleIndex) {
+            Ids[Blocks[I].BB] = I;
+            Functions.insert(Blocks[I].BB->getParent());
+        }
+
+    std::string Comment = TM.getMCAsmInfo()->getCommentString().str() + " " + Marker.str();
+    FunctionType *FTy = FunctionType::get(Type::getVoidTy(M.getContext()), false);
+    for (Function *F : Functions)
+        for (BasicBlock &BB : *F) {
+            auto It = Ids.find(&BB);
+            unsigned Id = It == Ids.end() ? Blocks.size() : It->second;
+            IRBuilder<> B(&BB, BB.getFirstInsertionPt());
+            B.CreateCall(FTy, InlineAsm::get(FTy, Comment + std::to_string(Id), "",
+                                             /*hasSideEffects=*/true));
+        }
+
+    SmallString<0> Asm;
+    raw_svector_ostream OS(Asm);
+    legacy::PassManager PM;
+    if (TM.addPassesToEmitFile(PM, OS, nullptr, CodeGenFileType::AssemblyFile))
+        return createStringError(inconvertibleErrorCode(),
+                                 "target cannot emit assembly: " + TM.getTargetTriple().str());
+    PM.run(M);
+    return std::string(Asm);
+}
+
+// Splits the assembly at the markers into the instruction lines of each hot
+// block. Labels, directives and comments are dropped. A block that codegen
+// duplicated keeps its first copy.
+std::map<unsigned, std::string> splitBlocks(StringRef Asm, StringRef CommentString) {
+    std::map<unsigned, std::string> Regions;
+    std::optional<unsigned> Current;
+    SmallVector<StringRef, 0> Lines;
+    Asm.split(Lines, '\n');
+    for (StringRef Line : Lines) {
+        size_t Pos = Line.find(Marker);
+        if (Pos != StringRef::npos) {
+            unsigned Id;
+            Current.reset();
+            if (!Line.substr(Pos + Marker.size()).trim().getAsInteger(10, Id) &&
+                !Regions.count(Id)) {
+                Current = Id;
+                Regions[Id];
+            }
+            continue;
+        }
+        StringRef Text = Line.split(CommentString).first.trim();
+        if (Text.starts_with(".cfi_endproc") || Text.starts_with(".Lfunc_end")) {
+            Current.reset();
+            continue;
+        }
+        if (!Current || Text.empty() || Text.starts_with(".") || Text.ends_with(":"))
+            continue;
+        Regions[*Current] += Text.str() + "\n";
+    }
+    return Regions;
+}
+
+void printReport(ArrayRef<HotBlock> Blocks, ArrayRef<Simulation> Sims,
+                 ArrayRef<std::unique_ptr<Module>> Modules) {
+    // Group the blocks by loop, costliest loop first.
+    struct LoopGroup {
+        std::vector<unsigned> Blocks;
+        double Cycles = 0;
+    };
+    std::map<std::pair<unsigned, std::string>, LoopGroup> Groups;
+    for (unsigned I = 0; I < Blocks.size(); ++I) {
+        LoopGroup &G = Groups[{Blocks[I].Module, Blocks[I].LoopName}];
+        G.Blocks.push_back(I);
+        G.Cycles += Sims[I].Cycles * Blocks[I].Executions;
+    }
+    // Per-call cycles of different functions do not compare, so without a
+    // profile functions keep their order and only their loops are ranked.
+    bool PerFunction = llvm::any_of(Blocks, [](const HotBlock &HB) { return HB.PerCall; });
+    DenseMap<const Function *, unsigned> FunctionRank;
+    for (const HotBlock &HB : Blocks)
+        FunctionRank.try_emplace(HB.BB->getParent(), PerFunction ? FunctionRank.size() : 0);
+    std::vector<std::pair<const std::pair<unsigned, std::string> *, LoopGroup *>> Order;
+    for (auto &G : Groups)
+        Order.emplace_back(&G.first, &G.second);
+    auto Rank = [&](const LoopGroup *G) {
+        return FunctionRank.lookup(Blocks[G->Blocks.front()].BB->getParent());
+    };
+    llvm::stable_sort(Order, [&](const auto &A, const auto &B) {
+        if (Rank(A.second) != Rank(B.second))
+            return Rank(A.second) < Rank(B.second);
+        return A.second->Cycles > B.second->Cycles;
+    });
+
+    if (PerFunction)
+        outs() << "No profile: the " << TopBlocks
+               << " hottest blocks of each function by per-call estimates, which do not "
+                  "compare across functions\n\n";
+
+    for (const auto &[Key, G] : Order) {
+        const HotBlock &First = Blocks[G->Blocks.front()];
+        outs() << (First.LoopDepth ? "Loop " : "Function ") << Key->second;
+        if (First.LoopDepth)
+            outs() << " (depth " << First.LoopDepth << ")";
+        outs() << "  [" << Modules[Key->first]->getSourceFileName() << "]\n";
+
+        const Simulation *Costliest = nullptr;
+        double CostliestCycles = -1;
+        for (unsigned I : G->Blocks) {
+            const HotBlock &HB = Blocks[I];
+            const Simulation &Sim = Sims[I];
+            outs() << "   • " << HB.Name << "  " << format("%.1f", HB.Executions)
+                   << (HB.PerCall ? " executions per call" : " executions");
+            if (!Sim.Error.empty()) {
+                outs() << "  (not simulated: " << Sim.Error << ")\n";
+                continue;
+            }
+            outs() << ", " << Sim.CPU << ": " << Sim.Instructions << " instructions, "
+                   << format("%.2f", Sim.Cycles) << " cycles/iteration, IPC "
+                   << format("%.2f", Sim.Instructions / Sim.Cycles) << ", "
+                   << format("%.1f", Sim.UOps) << " uops (dispatch width "
+                   << Sim.DispatchWidth << ")  → bound by " << Sim.Bottleneck << "\n";
+            outs() << "       pressure/iteration:";
+            for (size_t P = 0; P < std::min<size_t>(6, Sim.Pressure.size()); ++P)
+                outs() << "  " << Sim.Pressure[P].first << " "
+                       << format("%.2f", Sim.Pressure[P].second);
+            outs() << "\n";
+            if (Sim.Cycles * HB.Executions > CostliestCycles) {
+                CostliestCycles = Sim.Cycles * HB.Executions;
+                Costliest = &Sim;
+            }
+        }
+        if (Costliest)
+            outs() << "   Σ " << format("%.1f", G->Cycles) << " cycles"
+                   << (First.PerCall ? " per call" : "") << ", bottleneck: "
+                   << Costliest->Bottleneck << "\n";
+        outs() << "\n";
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    InitLLVM X(argc, argv);
+    InitializeAllTargetInfos();
+    InitializeAllTargets();
+    InitializeAllTargetMCs();
+    InitializeAllAsmParsers();
+    InitializeAllAsmPrinters();
+    cl::ParseCommandLineOptions(argc, argv, "skeleton hot block simulator\n");
+    if (Iterations == 0) {
+        WithColor::error() << "-iterations must be at least 1\n";
+        return 1;
+    }
+
+    LLVMContext Context;
+    std::vector<std::unique_ptr<Module>> Modules;
+    for (const std::string &File : InputFiles) {
+        SMDiagnostic Err;
+        std::unique_ptr<Module> M = parseIRFile(File, Err, Context);
+        if (!M) {
+            Err.print(argv[0], WithColor::error());
+            return 1;
+        }
+        if (M->getTargetTriple().empty())
+            M->setTargetTriple(TripleName.empty() ? sys::getDefaultTargetTriple()
+                                                  : Triple::normalize(TripleName));
+        Modules.push_back(std::move(M));
+    }
+
+    std::vector<HotBlock> Blocks = selectHotBlocks(Modules);
+    std::vector<Simulation> Sims(Blocks.size());
+    std::string CPUOverride = MCPU == "native" ? sys::getHostCPUName().str() : MCPU.getValue();
+
+    for (unsigned MI = 0; MI < Modules.size(); ++MI) {
+        if (llvm::none_of(Blocks, [&](const HotBlock &HB) { return HB.Module == MI; }))
+            continue;
+        Module &M = *Modules[MI];
+        Triple TT(M.getTargetTriple());
+        std::string Error;
+        const Target *T = TargetRegistry::lookupTarget(TT.str(), Error);
+        if (!T) {
+            WithColor::error() << M.getSourceFileName() << ": " << Error << "\n";
+            return 1;
+        }
+
+        // Like llc, -mcpu and -mattr replace the functions' own attributes.
+        for (Function &F : M) {
+            if (!CPUOverride.empty())
+                F.addFnAttr("target-cpu", CPUOverride);
+            if (!MAttr.empty())
+                F.addFnAttr("target-features", MAttr);
+        }
+        std::unique_ptr<TargetMachine> TM(T->createTargetMachine(
+            TT.str(), CPUOverride.empty() ? "generic" : CPUOverride, MAttr, TargetOptions(),
+            std::nullopt));
+        M.setDataLayout(TM->createDataLayout());
+
+        Expected<std::string> Asm = emitMarkedAssembly(M, *TM, Blocks, MI);
+        if (!Asm) {
+            WithColor::error() << M.getSourceFileName() << ": " << toString(Asm.takeError())
+                               << "\n";
+            return 1;
+        }
+        std::map<unsigned, std::string> Regions =
+            splitBlocks(*Asm, TM->getMCAsmInfo()->getCommentString());
+        for (unsigned I = 0; I < Blocks.size(); ++I) {
+            if (Blocks[I].Module != MI)
+                continue;
+            auto It = Regions.find(I);
+            if (It == Regions.end()) {
+                Sims[I].Error = "not found in the generated code";
+                continue;
+            }
+            const Function &F = *Blocks[I].BB->getParent();
+            StringRef CPU = F.getFnAttribute("target-cpu").getValueAsString();
+            StringRef Features = F.getFnAttribute("target-features").getValueAsString();
+            Sims[I] = simulate(*T, TT, CPU.empty() ? "generic" : CPU, Features, It->second);
+        }
+    }
+
+    printReport(Blocks, Sims, Modules);
+    return 0;
+}
@@ -0,0 +1,143 @@
+// skeleton-query: answers whole-program questions from the report database
+// written by the skeleton pass with -skeleton-db=<dir>.
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "../skeleton/ReportDB.h"
+
+using namespace llvm;
+using namespace skeleton;
+
+static cl::SubCommand TopCmd("top", "List the top functions by a per-function counter");
+static cl::SubCommand IndirectCmd("indirect-calls", "List every indirect call site");
+static cl::SubCommand CallersCmd("callers", "List every call site of a function");
+static cl::SubCommand ModulesCmd("modules", "List the modules in the database");
+static cl::SubCommand CompactCmd("compact",
+                                 "Merge the latest shard of every module into one shard "
+                                 "and delete the shards it supersedes");
+
+static cl::opt<std::string> DBDir(cl::Positional, cl::Required, cl::desc("<db-dir>"),
+                                  cl::sub(TopCmd), cl::sub(IndirectCmd),
+                                  cl::sub(CallersCmd), cl::sub(ModulesCmd),
+                                  cl::sub(CompactCmd));
+
+enum class Counter {
+    Loads, Stores, Calls, IndirectCalls, Instructions, Blocks,
+    DynLoads, DynStores, DynCalls, DynInstructions
+};
+
+static cl::opt<Counter> TopBy(
+    "by", cl::desc("Counter to rank functions by"), cl::init(Counter::Loads),
+    cl::values(clEnumValN(Counter::Loads, "loads", "Load instructions"),
+               clEnumValN(Counter::Stores, "stores", "Store instructions"),
+               clEnumValN(Counter::Calls, "calls", "Direct call sites"),
+               clEnumValN(Counter::IndirectCalls, "indirect-calls", "Indirect call sites"),
+               clEnumValN(Counter::Instructions, "instructions", "Instructions"),
+               clEnumValN(Counter::Blocks, "blocks", "Basic blocks"),
+               clEnumValN(Counter::DynLoads, "dyn-loads", "Estimated executed loads"),
+               clEnumValN(Counter::DynStores, "dyn-stores", "Estimated executed stores"),
+               clEnumValN(Counter::DynCalls, "dyn-calls", "Estimated executed calls"),
+               clEnumValN(Counter::DynInstructions, "dyn-instructions",
+                          "Estimated executed instructions")),
+    cl::sub(TopCmd));
+
+static cl::opt<unsigned> TopN("n", cl::desc("Number of functions to list"), cl::init(20),
+                              cl::sub(TopCmd));
+
+static cl::opt<std::string> CalleeName(cl::Positional, cl::Required, cl::desc("<callee>"),
+                                       cl::sub(CallersCmd));
+
+static double getCounter(const FunctionRecord &FR, Counter C) {
+    switch (C) {
+    case Counter::Loads: return FR.Loads;
+    case Counter::Stores: return FR.Stores;
+    case Counter::Calls: return FR.Calls;
+    case Counter::IndirectCalls: return FR.IndirectCalls;
+    case Counter::Instructions: return FR.Instructions;
+    case Counter::Blocks: return FR.Blocks;
+    case Counter::DynLoads: return FR.DynLoads;
+    case Counter::DynStores: return FR.DynStores;
+    case Counter::DynCalls: return FR.DynCalls;
+    case Counter::DynInstructions: return FR.DynInstructions;
+    }
+    llvm_unreachable("unknown counter");
+}
+
+static void printTop(const std::vector<ModuleRecord> &Modules) {
+    std::vector<std::pair<const FunctionRecord *, const ModuleRecord *>> All;
+    for (const ModuleRecord &MR : Modules)
+        for (const FunctionRecord &FR : MR.Functions)
+            All.emplace_back(&FR, &MR);
+
+    size_t N = std::min<size_t>(TopN, All.size());
+    std::partial_sort(All.begin(), All.begin() + N, All.end(), [](auto &A, auto &B) {
+        return getCounter(*A.first, TopBy) > getCounter(*B.first, TopBy);
+    });
+
+    for (size_t i = 0; i < N; ++i)
+        outs() << format("%4zu. %14.1f  ", i + 1, getCounter(*All[i].first, TopBy))
+               << All[i].first->Name << "  [" << All[i].first->Hotness << "]  ("
+               << All[i].second->SourceFile << ")\n";
+}
+
+static void printCallSite(const ModuleRecord &MR, const CallSiteRecord &CS) {
+    outs() << MR.SourceFile << ": " << CS.Caller << " / "
+           << (CS.Block.empty() ? "unnamed" : CS.Block) << " [" << CS.Index << "]  "
+           << (CS.Callee.empty() ? "<indirect>" : CS.Callee) << " : " << CS.CalleeType << "\n";
+}
+
+int main(int argc, char **argv) {
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv, "skeleton report database query tool\n");
+
+    auto Warn = [](Error E) {
+        WithColor::warning() << toString(std::move(E)) << "; skipped\n";
+    };
+
+    if (CompactCmd) {
+        Expected<CompactStats> Stats = compactDatabase(DBDir, Warn);
+        if (!Stats) {
+            WithColor::error() << toString(Stats.takeError()) << "\n";
+            return 1;
+        }
+        outs() << "compacted " << Stats->Modules << " modules into one shard, removed "
+               << Stats->RemovedShards << " shards\n";
+        return 0;
+    }
+
+    Expected<std::vector<ModuleRecord>> Modules = loadModuleRecords(DBDir, Warn);
+    if (!Modules) {
+        WithColor::error() << toString(Modules.takeError()) << "\n";
+        return 1;
+    }
+
+    if (TopCmd) {
+        printTop(*Modules);
+    } else if (IndirectCmd) {
+        for (const ModuleRecord &MR : *Modules)
+            for (const CallSiteRecord &CS : MR.CallSites)
+                if (CS.Callee.empty())
+                    printCallSite(MR, CS);
+    } else if (CallersCmd) {
+        for (const ModuleRecord &MR : *Modules)
+            for (const CallSiteRecord &CS : MR.CallSites)
+                if (CS.Callee == CalleeName)
+                    printCallSite(MR, CS);
+    } else if (ModulesCmd) {
+        for (const ModuleRecord &MR : *Modules)
+            outs() << MR.SourceFile
+                   << (MR.OutputFile.empty() ? "" : " -> " + MR.OutputFile)
+                   << "  functions=" << MR.Functions.size()
+                   << "  callsites=" << MR.CallSites.size() << "\n";
+    } else {
+        cl::PrintHelpMessage();
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,164 @@
+// Collects the counter tables of instrumented modules and appends them to the
+// profile when the program exits.
+
+#include "SkeletonRuntime.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// A thread's private copy of one table's counters.
+struct ThreadCounters {
+    const __skeleton_site_table *Table;
+    uint64_t *Counters;
+};
+
+struct ThreadBuffers;
+
+// Never destroyed, so that it outlives the exit handlers and the thread-local
+// destructors that use it.
+struct State {
+    std::mutex Lock;
+    std::vector<const __skeleton_site_table *> Tables;
+    std::vector<ThreadBuffers *> LiveThreads;
+};
+
+State &state() {
+    static State *S = new State;
+    return *S;
+}
+
+bool isMaxCounter(const char *Name) { return std::strncmp(Name, "max_", 4) == 0; }
+
+// Folds a thread's counters into the table's shared ones.
+void merge(const ThreadCounters &TC) {
+    const __skeleton_site_table *T = TC.Table;
+    for (uint32_t S = 0; S < T->num_sites; ++S) {
+        for (uint32_t C = 0; C < T->num_counters; ++C) {
+            uint64_t V = TC.Counters[S * T->num_counters + C];
+            uint64_t *Shared = &T->counters[S * T->num_counters + C];
+            if (!isMaxCounter(T->counter_names[C])) {
+                __atomic_fetch_add(Shared, V, __ATOMIC_RELAXED);
+                continue;
+            }
+            uint64_t Old = __atomic_load_n(Shared, __ATOMIC_RELAXED);
+            while (V > Old &&
+                   !__atomic_compare_exchange_n(Shared, &Old, V, true, __ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED)) {
+            }
+        }
+    }
+}
+
+struct ThreadBuffers {
+    std::vector<ThreadCounters> Buffers;
+    bool Merged = false;
+
+    ThreadBuffers() {
+        std::lock_guard<std::mutex> Guard(state().Lock);
+        state().LiveThreads.push_back(this);
+    }
+    ~ThreadBuffers() {
+        std::lock_guard<std::mutex> Guard(state().Lock);
+        auto &Live = state().LiveThreads;
+        Live.erase(std::find(Live.begin(), Live.end(), this));
+        for (ThreadCounters &TC : Buffers) {
+            if (!Merged)
+                merge(TC);
+            std::free(TC.Counters);
+        }
+    }
+};
+
+void writeString(FILE *F, const char *S) {
+    std::fputc('"', F);
+    for (; *S; ++S) {
+        unsigned char C = *S;
+        if (C == '"' || C == '\\')
+            std::fprintf(F, "\\%c", C);
+        else if (C < 0x20)
+            std::fprintf(F, "\\u%04x", C);
+        else
+            std::fputc(C, F);
+    }
+    std::fputc('"', F);
+}
+
+void dump() {
+    const char *Path = std::getenv("SKELETON_PROFILE");
+    FILE *F = std::fopen(Path && *Path ? Path : "skeleton-profile.ndjson", "a");
+    if (!F) {
+        std::perror("skeleton: cannot write profile");
+        return;
+    }
+    std::lock_guard<std::mutex> Guard(state().Lock);
+    // Threads still running at exit contribute what they have counted so far.
+    for (ThreadBuffers *TB : state().LiveThreads) {
+        if (TB->Merged)
+            continue;
+        for (const ThreadCounters &TC : TB->Buffers)
+            merge(TC);
+        TB->Merged = true;
+    }
+    for (const __skeleton_site_table *T : state().Tables) {
+        for (uint32_t S = 0; S < T->num_sites; ++S) {
+            std::fputs("{\"kind\":", F);
+            writeString(F, T->kind);
+            std::fputs(",\"module\":", F);
+            writeString(F, T->module);
+            std::fputs(",\"site\":", F);
+            writeString(F, T->sites[S]);
+            std::fputs(",\"counters\":{", F);
+            for (uint32_t C = 0; C < T->num_counters; ++C) {
+                uint64_t V = __atomic_load_n(&T->counters[S * T->num_counters + C], __ATOMIC_RELAXED);
+                if (C)
+                    std::fputc(',', F);
+                writeString(F, T->counter_names[C]);
+                std::fprintf(F, ":%llu", static_cast<unsigned long long>(V));
+            }
+            std::fputs("}}\n", F);
+        }
+    }
+    std::fclose(F);
+}
+
+} // namespace
+
+extern "C" void __skeleton_register(const __skeleton_site_table *Table) {
+    if (!Table || Table->version != SKELETON_RT_VERSION) {
+        std::fprintf(stderr, "skeleton: ignoring counters of an incompatible module\n");
+        return;
+    }
+    std::lock_guard<std::mutex> Guard(state().Lock);
+    if (state().Tables.empty())
+        std::atexit(dump);
+    state().Tables.push_back(Table);
+}
+
+extern "C" uint64_t *__skeleton_thread_counters(const __skeleton_site_table *Table) {
+    thread_local ThreadBuffers Buffers;
+    for (const ThreadCounters &TC : Buffers.Buffers)
+        if (TC.Table == Table)
+            return TC.Counters;
+    auto *Counters = static_cast<uint64_t *>(
+        std::calloc(std::size_t(Table->num_sites) * Table->num_counters, sizeof(uint64_t)));
+    if (!Counters) {
+        std::fprintf(stderr, "skeleton: out of memory for thread counters\n");
+        std::abort();
+    }
+    std::lock_guard<std::mutex> Guard(state().Lock);
+    Buffers.Buffers.push_back({Table, Counters});
+    return Counters;
+}
+
+extern "C" uint64_t __skeleton_now(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
@@ -0,0 +1,55 @@
+#ifndef SKELETON_RUNTIME_H
+#define SKELETON_RUNTIME_H
+
+/* Runtime support for the skeleton pass's instrumentation modes. Link
+ * programs built with -skeleton-instrument-* against libskeleton_rt.a.
+ *
+ * Every instrumented module registers one table per kind of site from a
+ * constructor. At exit, each site is appended to the profile as one NDJSON
+ * line:
+ *
+ *   {"kind":"atomic","module":"a.c","site":"push:retry:3 cmpxchg seq_cst",
+ *    "counters":{"executions":120,"failures":7}}
+ *
+ * The profile path is $SKELETON_PROFILE, or skeleton-profile.ndjson in the
+ * working directory. Several processes may append to the same file.
+ *
+ * Tables with per-thread counters get a private copy for each thread from
+ * __skeleton_thread_counters(), which is added into the table's counters when
+ * the thread exits (or at program exit for threads still running). Counters
+ * whose name starts with "max_" are combined by maximum instead of sum. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SKELETON_RT_VERSION 1
+
+/* Layout shared with SiteCounters::finish() in skeleton/Instrumentation.cpp. */
+struct __skeleton_site_table {
+    uint32_t version;
+    uint32_t num_sites;
+    uint32_t num_counters;
+    const char *kind;
+    const char *module;
+    const char *const *counter_names; /* num_counters entries */
+    const char *const *sites;         /* num_sites entries */
+    uint64_t *counters;               /* num_sites * num_counters, by site */
+};
+
+void __skeleton_register(const struct __skeleton_site_table *table);
+
+/* The calling thread's zero-initialized copy of a registered table's
+ * counters. */
+uint64_t *__skeleton_thread_counters(const struct __skeleton_site_table *table);
+
+/* A monotonic timestamp in nanoseconds, for timing instrumented calls. */
+uint64_t __skeleton_now(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SKELETON_RUNTIME_H */
@@ -0,0 +1,124 @@
+#ifndef SKELETON_ANALYSES_H
+#define SKELETON_ANALYSES_H
+
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+struct InlineParams;
+class Module;
+class ProfileSummaryInfo;
+} // namespace llvm
+
+namespace skeleton {
+
+class Report;
+
+// Module-level report sections printed after the per-function walk. Each one
+// walks the module itself and checks Report::withinBudget() before every
+// entry it writes.
+
+// Size, padding holes and cache-line straddling fields of every struct type
+// reached by allocas, GEPs, loads and stores.
+void reportStructLayouts(llvm::Module &M, Report &R, unsigned CacheLine);
+
+// Per-field load/store counts of every accessed struct type, static and
+// weighted by block frequency, as a heat map for hot/cold field splitting.
+void reportFieldHeatMap(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                        llvm::ProfileSummaryInfo &PSI, Report &R);
+
+// Fields of each struct accessed together within a loop or function, and a
+// field order that packs co-accessed hot fields into the same cache lines,
+// with the lines touched per access pattern before and after.
+void reportFieldCoAccess(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                         llvm::ProfileSummaryInfo &PSI, Report &R, unsigned CacheLine);
+
+// Loops whose loads and stores stride (per SCEV) over an array of structs but
+// only touch some of the fields, ranked by the bytes fetched and not used: the
+// candidates for a struct-of-arrays layout.
+void reportSoACandidates(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                         llvm::ProfileSummaryInfo &PSI, Report &R, unsigned CacheLine);
+
+// Every atomic instruction (atomicrmw, cmpxchg, fence and atomic loads and
+// stores) with its ordering, scope and loop depth, flagging seq_cst inside
+// loops.
+void reportAtomics(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                   llvm::ProfileSummaryInfo &PSI, Report &R);
+
+// Direct calls to lock primitives (see Locks.h) with their kind, loop depth
+// and estimated executions, flagging acquisitions inside loops.
+void reportLockSites(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                     llvm::ProfileSummaryInfo &PSI, Report &R);
+
+// Every switch with its case count, value range and density, and how the
+// target's TTI expects to lower it: a jump table, a binary search over case
+// clusters, or compares.
+void reportSwitches(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                    llvm::ProfileSummaryInfo &PSI, Report &R);
+
+// Floating-point operations per function and loop with their fast-math flag
+// coverage, expensive operations (division, roots, transcendental calls), and
+// the loops where local fast-math would pay off: reductions kept in order for
+// lack of reassoc, divisions by a loop-invariant value without arcp, and math
+// calls that may set errno.
+void reportFloatingPoint(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                         llvm::ProfileSummaryInfo &PSI, Report &R);
+
+// Vector usage per function: the share of vector instructions, their lane
+// types and widths against the target's vector registers, shuffles and
+// lane-by-lane extract/insert chains, flagging shuffle-dominated, narrow and
+// scalarized code. Stage is "pipeline_start" or "optimizer_last".
+void reportSimdUtilization(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                           llvm::ProfileSummaryInfo &PSI, Report &R, llvm::StringRef Stage);
+
+// Throughput and latency cost of every function and loop under the target's
+// cost model, summed over their blocks and weighted by estimated executions:
+// the Top costliest functions (all when Top is 0) with their loops.
+void reportStaticCost(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                      llvm::ProfileSummaryInfo &PSI, Report &R, unsigned Top);
+
+// Throughput cost of every function on each of CPUs (the first is the
+// baseline), with innermost loops costed as vectorized where the CPU's vector
+// width allows. Functions at least MinGain cheaper on some CPU are the ones
+// worth multiversioning.
+void reportTargetComparison(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                            llvm::ProfileSummaryInfo &PSI, Report &R,
+                            llvm::ArrayRef<std::string> CPUs, double MinGain);
+
+// Inline cost against Params' threshold of every direct call to a function
+// defined in the module: the Top hottest sites the inliner would leave alone,
+// with why, and always_inline/noinline suggestions for hot sites just over
+// the threshold and cold sites under it.
+void reportInlining(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                    llvm::ProfileSummaryInfo &PSI, Report &R, const llvm::InlineParams &Params,
+                    unsigned Top);
+
+// Loads of a location an earlier, dominating load already read (must-alias per
+// AA), found through MemorySSA: those with no write in between, and those kept
+// only by writes that may alias, with why and which arguments would need
+// noalias. Stage ("pipeline_start" or "optimizer_last") tags the records; the
+// text lists the Top most executed loads (all when Top is 0).
+void reportRedundantLoads(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                          llvm::ProfileSummaryInfo &PSI, Report &R, llvm::StringRef Stage,
+                          unsigned Top);
+
+// Functions with loops that only possible aliasing between pointer arguments
+// keeps from LICM or vectorization: the loops, the arguments whose noalias
+// would separate every may-alias pair, and whether noalias is provably safe
+// for each argument given every call site in the module.
+void reportNoAliasCandidates(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                             llvm::ProfileSummaryInfo &PSI, Report &R);
+
+// Every global variable with its size, linkage, constness and section, and
+// the loads and stores of it per function, flagging hot mutable globals and
+// globals that could be const (or .rodata tables) or internal.
+void reportGlobals(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                   llvm::ProfileSummaryInfo &PSI, Report &R);
+
+// Cache lines shared by distinct writable globals, in the module's own global
+// layout, where at least one is written atomically or the globals are used
+// from different functions: the likely false-sharing pairs.
+void reportFalseSharing(llvm::Module &M, Report &R, unsigned CacheLine);
+
+} // namespace skeleton
+
+#endif // SKELETON_ANALYSES_H
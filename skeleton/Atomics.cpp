@@ -0,0 +1,196 @@
+#include "Analyses.h"
+#include "Instrumentation.h"
+#include "Profile.h"
+#include "Report.h"
+#include "Transforms.h"
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/AtomicOrdering.h"
+#include "llvm/Support/Format.h"
+
+#include <optional>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// The memory-ordering properties of an atomic instruction.
+struct AtomicInfo {
+    const char *Kind = nullptr; // "atomicrmw", "cmpxchg", "fence", "load" or "store"
+    std::string Operation;      // the atomicrmw operation, e.g. "add"
+    AtomicOrdering Ordering = AtomicOrdering::NotAtomic;
+    AtomicOrdering Failure = AtomicOrdering::NotAtomic; // cmpxchg only
+    SyncScope::ID Scope = SyncScope::System;
+    bool Weak = false;
+    bool Volatile = false;
+
+    bool isSeqCst() const {
+        return Ordering == AtomicOrdering::SequentiallyConsistent ||
+               Failure == AtomicOrdering::SequentiallyConsistent;
+    }
+
+    std::string orderings() const {
+        std::string S = toIRString(Ordering);
+        if (Failure != AtomicOrdering::NotAtomic)
+            S += std::string("/") + toIRString(Failure);
+        return S;
+    }
+};
+
+bool getAtomicInfo(Instruction &I, AtomicInfo &A) {
+    if (auto *RMW = dyn_cast<AtomicRMWInst>(&I)) {
+        A.Kind = "atomicrmw";
+        A.Operation = AtomicRMWInst::getOperationName(RMW->getOperation()).str();
+        A.Ordering = RMW->getOrdering();
+        A.Scope = RMW->getSyncScopeID();
+        A.Volatile = RMW->isVolatile();
+    } else if (auto *CX = dyn_cast<AtomicCmpXchgInst>(&I)) {
+        A.Kind = "cmpxchg";
+        A.Ordering = CX->getSuccessOrdering();
+        A.Failure = CX->getFailureOrdering();
+        A.Scope = CX->getSyncScopeID();
+        A.Weak = CX->isWeak();
+        A.Volatile = CX->isVolatile();
+    } else if (auto *Fence = dyn_cast<FenceInst>(&I)) {
+        A.Kind = "fence";
+        A.Ordering = Fence->getOrdering();
+        A.Scope = Fence->getSyncScopeID();
+    } else if (auto *LI = dyn_cast<LoadInst>(&I); LI && LI->isAtomic()) {
+        A.Kind = "load";
+        A.Ordering = LI->getOrdering();
+        A.Scope = LI->getSyncScopeID();
+        A.Volatile = LI->isVolatile();
+    } else if (auto *SI = dyn_cast<StoreInst>(&I); SI && SI->isAtomic()) {
+        A.Kind = "store";
+        A.Ordering = SI->getOrdering();
+        A.Scope = SI->getSyncScopeID();
+        A.Volatile = SI->isVolatile();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void reportAtomics(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI, Report &R) {
+    struct Site {
+        Instruction *I;
+        AtomicInfo A;
+        unsigned LoopDepth;
+        double Executions;
+    };
+    std::vector<Site> Sites;
+    unsigned SeqCstInLoops = 0;
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        LoopInfo *LI = nullptr;
+        std::optional<FunctionProfile> Prof;
+        for (Instruction &I : instructions(F)) {
+            AtomicInfo A;
+            if (!getAtomicInfo(I, A))
+                continue;
+            if (!LI) {
+                LI = &FAM.getResult<LoopAnalysis>(F);
+                Prof.emplace(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+            }
+            unsigned Depth = LI->getLoopDepth(I.getParent());
+            SeqCstInLoops += Depth && A.isSeqCst();
+            Sites.push_back({&I, A, Depth, Prof->blockCount(*I.getParent())});
+        }
+    }
+    if (Sites.empty())
+        return;
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "⚛️  Atomics (" << Sites.size() << " sites, " << SeqCstInLoops
+                   << " seq_cst in loops; ordering, scope, estimated executions"
+                   << (PerCall ? " per call" : "") << ")\n";
+
+    for (const Site &S : Sites) {
+        if (!R.withinBudget())
+            return;
+        const AtomicInfo &A = S.A;
+        std::string Scope = syncScopeName(M.getContext(), A.Scope);
+        bool Flag = S.LoopDepth && A.isSeqCst();
+        if (!R.isText()) {
+            R.record("atomic", [&](json::OStream &J) {
+                J.attribute("site", siteName(*S.I));
+                J.attribute("kind", A.Kind);
+                if (!A.Operation.empty())
+                    J.attribute("operation", A.Operation);
+                J.attribute("ordering", toIRString(A.Ordering));
+                if (A.Failure != AtomicOrdering::NotAtomic)
+                    J.attribute("failure_ordering", toIRString(A.Failure));
+                J.attribute("scope", Scope);
+                J.attribute("weak", A.Weak);
+                J.attribute("volatile", A.Volatile);
+                J.attribute("loop_depth", S.LoopDepth);
+                J.attribute("executions", S.Executions);
+                J.attribute("seq_cst_in_loop", Flag);
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   • " << siteName(*S.I) << "  " << A.Kind;
+        if (!A.Operation.empty())
+            OS << " " << A.Operation;
+        OS << " " << A.orderings() << " " << Scope;
+        if (A.Weak)
+            OS << " weak";
+        if (A.Volatile)
+            OS << " volatile";
+        OS << "  [loop depth " << S.LoopDepth << ", " << format("%.1f", S.Executions)
+           << " executions]";
+        if (Flag)
+            OS << "  ⚠️  seq_cst in loop";
+        OS << "\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+bool instrumentAtomics(Module &M, Report &R) {
+    // Site names are taken before any counter update shifts the positions.
+    enum { Executions, Failures };
+    // Per-thread counters: a shared atomic add next to every contended atomic
+    // would add its own cache-line traffic to what is being measured.
+    SiteCounters Counters(M, "atomic", {"executions", "failures"}, /*PerThread=*/true);
+    std::vector<Instruction *> Sites;
+    for (Function &F : M)
+        for (Instruction &I : instructions(F)) {
+            AtomicInfo A;
+            if (!getAtomicInfo(I, A))
+                continue;
+            std::string Desc = siteName(I) + " " + A.Kind;
+            if (!A.Operation.empty())
+                Desc += " " + A.Operation;
+            Counters.addSite(Desc + " " + A.orderings());
+            Sites.push_back(&I);
+        }
+
+    for (unsigned Site = 0; Site != Sites.size(); ++Site) {
+        Instruction *I = Sites[Site];
+        IRBuilder<> B(I->getNextNode());
+        Value *Base = Counters.threadCounters(B);
+        Counters.add(B, Base, Site, Executions, B.getInt64(1));
+        if (auto *CX = dyn_cast<AtomicCmpXchgInst>(I)) {
+            Value *Failed = B.CreateNot(B.CreateExtractValue(CX, 1));
+            Counters.add(B, Base, Site, Failures, B.CreateZExt(Failed, B.getInt64Ty()));
+        }
+    }
+    Counters.finish();
+    reportInstrumentation(R, "atomic", Sites.size());
+    return !Sites.empty();
+}
+
+} // namespace skeleton
@@ -0,0 +1,142 @@
+#include "Cost.h"
+#include "Analyses.h"
+#include "Profile.h"
+#include "Report.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+void accumulate(InstructionCost C, double &Sum, unsigned &Unknown) {
+    if (C.isValid())
+        Sum += *C.getValue();
+    else
+        ++Unknown;
+}
+
+struct LoopCost {
+    Loop *L;
+    std::string Name; // function:header
+    double Iterations;
+    BlockCost Weighted; // blocks of the loop and its subloops
+};
+
+struct FunctionCost {
+    Function *F;
+    BlockCost Weighted;
+    std::vector<LoopCost> Loops;
+};
+
+double share(double Part, double Whole) { return Whole > 0 ? Part / Whole : 0; }
+
+} // namespace
+
+BlockCost blockCost(const BasicBlock &BB, const TargetTransformInfo &TTI) {
+    BlockCost C;
+    unsigned LatencyUnknown = 0; // the same instructions as C.Unknown
+    for (const Instruction &I : BB) {
+        accumulate(TTI.getInstructionCost(&I, TargetTransformInfo::TCK_RecipThroughput),
+                   C.Throughput, C.Unknown);
+        accumulate(TTI.getInstructionCost(&I, TargetTransformInfo::TCK_Latency), C.Latency,
+                   LatencyUnknown);
+    }
+    return C;
+}
+
+void reportStaticCost(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                      Report &R, unsigned Top) {
+    std::vector<FunctionCost> Functions;
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        const TargetTransformInfo &TTI = FAM.getResult<TargetIRAnalysis>(F);
+        FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+        LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+        FunctionCost FC{&F};
+        DenseMap<const BasicBlock *, BlockCost> Blocks;
+        for (BasicBlock &BB : F) {
+            BlockCost C = blockCost(BB, TTI).scaled(Prof.blockCount(BB));
+            Blocks[&BB] = C;
+            FC.Weighted += C;
+        }
+        for (Loop *L : LI.getLoopsInPreorder()) {
+            BasicBlock *Header = L->getHeader();
+            LoopCost LC{L,
+                        F.getName().str() + ":" +
+                            (Header->hasName() ? Header->getName().str() : std::string("loop")),
+                        Prof.blockCount(*Header)};
+            for (BasicBlock *BB : L->blocks())
+                LC.Weighted += Blocks.lookup(BB);
+            FC.Loops.push_back(std::move(LC));
+        }
+        llvm::stable_sort(FC.Loops, [](const LoopCost &A, const LoopCost &B) {
+            return A.Weighted.Throughput > B.Weighted.Throughput;
+        });
+        Functions.push_back(std::move(FC));
+    }
+    if (Functions.empty())
+        return;
+    llvm::stable_sort(Functions, [](const FunctionCost &A, const FunctionCost &B) {
+        return A.Weighted.Throughput > B.Weighted.Throughput;
+    });
+    if (Top && Functions.size() > Top)
+        Functions.resize(Top);
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "⏱️  Static Cost (target cost model, weighted by estimated executions"
+                   << (PerCall ? " per call" : "") << "; top " << Functions.size()
+                   << " functions by throughput cost)\n";
+
+    for (const FunctionCost &FC : Functions) {
+        if (!R.withinBudget())
+            return;
+        if (!R.isText()) {
+            R.record("function_cost", [&](json::OStream &J) {
+                J.attribute("function", FC.F->getName());
+                J.attribute("per_call", PerCall);
+                J.attribute("throughput", FC.Weighted.Throughput);
+                J.attribute("latency", FC.Weighted.Latency);
+                J.attribute("unknown", FC.Weighted.Unknown);
+            });
+            for (const LoopCost &LC : FC.Loops)
+                R.record("loop_cost", [&](json::OStream &J) {
+                    J.attribute("loop", LC.Name);
+                    J.attribute("depth", LC.L->getLoopDepth());
+                    J.attribute("iterations", LC.Iterations);
+                    J.attribute("throughput", LC.Weighted.Throughput);
+                    J.attribute("latency", LC.Weighted.Latency);
+                    J.attribute("share", share(LC.Weighted.Throughput, FC.Weighted.Throughput));
+                });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   • " << FC.F->getName() << "  " << format("%.1f", FC.Weighted.Throughput)
+           << " throughput, " << format("%.1f", FC.Weighted.Latency) << " latency";
+        if (FC.Weighted.Unknown)
+            OS << "  (" << FC.Weighted.Unknown << " instructions without a cost)";
+        OS << "\n";
+        for (const LoopCost &LC : FC.Loops)
+            OS << "       ↻ " << LC.Name << " (depth " << LC.L->getLoopDepth() << "): "
+               << format("%.1f", LC.Weighted.Throughput) << " throughput ("
+               << format("%.0f", 100 * share(LC.Weighted.Throughput, FC.Weighted.Throughput))
+               << "%), " << format("%.1f", LC.Weighted.Latency) << " latency  ["
+               << format("%.1f", LC.Iterations) << " iterations]\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
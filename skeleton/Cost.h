@@ -0,0 +1,33 @@
+#ifndef SKELETON_COST_H
+#define SKELETON_COST_H
+
+namespace llvm {
+class BasicBlock;
+class TargetTransformInfo;
+} // namespace llvm
+
+namespace skeleton {
+
+// Static cost of one execution of a block under the target's cost model, in
+// its abstract units, which are close to cycles on most targets.
+struct BlockCost {
+    double Throughput = 0; // sum of reciprocal throughputs: the issue-bound time
+    double Latency = 0;    // sum of latencies: the time if nothing overlapped
+    unsigned Unknown = 0;  // instructions the model has no cost for
+
+    BlockCost &operator+=(const BlockCost &Other) {
+        Throughput += Other.Throughput;
+        Latency += Other.Latency;
+        Unknown += Other.Unknown;
+        return *this;
+    }
+    BlockCost scaled(double Executions) const {
+        return {Throughput * Executions, Latency * Executions, Unknown};
+    }
+};
+
+BlockCost blockCost(const llvm::BasicBlock &BB, const llvm::TargetTransformInfo &TTI);
+
+} // namespace skeleton
+
+#endif // SKELETON_COST_H
@@ -0,0 +1,199 @@
+#include "Analyses.h"
+#include "GlobalInfo.h"
+#include "Report.h"
+#include "Transforms.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <string>
+#include <utility>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+struct LineMember {
+    GlobalPlacement Place;
+    const GlobalAccessStats *Stats;
+};
+
+// A cache line that holds parts of two or more distinct writable globals, at
+// least one of which is written.
+struct SharedLine {
+    StringRef Section;
+    uint64_t Line;
+    std::vector<LineMember> Members;
+    const char *Risk = nullptr;   // "high" or "medium"
+    const char *Reason = nullptr;
+};
+
+// Cache lines of the module's writable globals that risk false sharing. A
+// line is high risk when any of its globals is written atomically, which
+// says several threads write it; medium risk when its globals are written
+// and accessed from more than one function. Lines whose globals are all used
+// by a single function are left out.
+std::vector<SharedLine> findSharedLines(Module &M, const GlobalAccessMap &Accesses,
+                                        unsigned CacheLine) {
+    MapVector<std::pair<StringRef, uint64_t>, std::vector<LineMember>> Lines;
+    for (const GlobalPlacement &P : layoutGlobals(M, M.getDataLayout())) {
+        if (P.GV->isConstant() || P.GV->isThreadLocal() || !P.Size)
+            continue;
+        auto It = Accesses.find(P.GV);
+        if (It == Accesses.end())
+            continue;
+        for (uint64_t L = P.Offset / CacheLine; L <= (P.Offset + P.Size - 1) / CacheLine; ++L)
+            Lines[{P.Section, L}].push_back({P, &It->second});
+    }
+
+    std::vector<SharedLine> Shared;
+    for (auto &[Key, Members] : Lines) {
+        if (Members.size() < 2)
+            continue;
+        bool Written = false, Atomic = false;
+        SmallPtrSet<const Function *, 8> Functions;
+        for (const LineMember &LM : Members) {
+            Written |= LM.Stats->stores() != 0;
+            Atomic |= LM.Stats->atomicWrites() != 0;
+            for (const auto &[F, A] : LM.Stats->Functions)
+                Functions.insert(F);
+        }
+        if (!Written || (!Atomic && Functions.size() < 2))
+            continue;
+        SharedLine SL{Key.first, Key.second, std::move(Members)};
+        SL.Risk = Atomic ? "high" : "medium";
+        SL.Reason = Atomic ? "atomic writes" : "written from several functions";
+        Shared.push_back(std::move(SL));
+    }
+    return Shared;
+}
+
+std::vector<std::string> functionNames(const GlobalAccessStats &S, bool Writers) {
+    std::vector<std::string> Names;
+    for (const auto &[F, A] : S.Functions)
+        if (Writers ? A.Stores != 0 : A.Stores == 0 && A.Loads != 0)
+            Names.push_back(F->getName().str());
+    return Names;
+}
+
+void printNames(raw_ostream &OS, const std::vector<std::string> &Names) {
+    for (size_t i = 0; i < Names.size(); ++i)
+        OS << (i ? ", " : "") << Names[i];
+}
+
+} // namespace
+
+void reportFalseSharing(Module &M, Report &R, unsigned CacheLine) {
+    GlobalAccessMap Accesses = collectGlobalAccesses(M);
+    std::vector<SharedLine> Lines = findSharedLines(M, Accesses, CacheLine);
+    if (Lines.empty())
+        return;
+
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🧵 False Sharing Risks (" << Lines.size()
+                   << " shared cache lines; layout assumes each section starts on a " << CacheLine
+                   << "-byte line)\n";
+
+    for (const SharedLine &SL : Lines) {
+        if (!R.withinBudget())
+            return;
+        if (!R.isText()) {
+            R.record("false_sharing", [&](json::OStream &J) {
+                J.attribute("section", SL.Section);
+                J.attribute("line", static_cast<int64_t>(SL.Line));
+                J.attribute("risk", SL.Risk);
+                J.attribute("reason", SL.Reason);
+                J.attributeArray("globals", [&] {
+                    for (const LineMember &LM : SL.Members)
+                        J.object([&] {
+                            J.attribute("name", LM.Place.GV->getName());
+                            J.attribute("offset", static_cast<int64_t>(LM.Place.Offset));
+                            J.attribute("size", static_cast<int64_t>(LM.Place.Size));
+                            J.attribute("atomic", LM.Stats->atomicWrites() != 0);
+                            J.attributeArray("writers", [&] {
+                                for (const std::string &N : functionNames(*LM.Stats, true))
+                                    J.value(N);
+                            });
+                            J.attributeArray("readers", [&] {
+                                for (const std::string &N : functionNames(*LM.Stats, false))
+                                    J.value(N);
+                            });
+                        });
+                });
+                J.attribute("suggested_align", CacheLine);
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   ┌─ " << SL.Section << " line " << SL.Line << " (bytes "
+           << SL.Line * CacheLine << "-" << (SL.Line + 1) * CacheLine - 1 << "): " << SL.Risk
+           << " risk, " << SL.Reason << "\n";
+        for (const LineMember &LM : SL.Members) {
+            OS << "   │  " << LM.Place.GV->getName() << ": " << LM.Place.Size << " bytes @ "
+               << LM.Place.Offset;
+            std::vector<std::string> Writers = functionNames(*LM.Stats, true);
+            std::vector<std::string> Readers = functionNames(*LM.Stats, false);
+            if (!Writers.empty()) {
+                OS << (LM.Stats->atomicWrites() ? ", written atomically by " : ", written by ");
+                printNames(OS, Writers);
+            }
+            if (!Readers.empty()) {
+                OS << ", read by ";
+                printNames(OS, Readers);
+            }
+            OS << "\n";
+        }
+        OS << "   │  Suggest: alignas(" << CacheLine << ") on ";
+        for (size_t i = 0; i < SL.Members.size(); ++i)
+            OS << (i ? ", " : "") << SL.Members[i].Place.GV->getName();
+        OS << ", or padding each to a full line\n";
+        OS << "   └─────────────────────────────────────────────────────\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+bool alignFalseSharingGlobals(Module &M, Report &R, unsigned CacheLine) {
+    // Alignments are powers of two.
+    uint64_t Target = PowerOf2Ceil(CacheLine);
+    std::vector<std::pair<GlobalVariable *, uint64_t>> Aligned;
+    GlobalAccessMap Accesses = collectGlobalAccesses(M);
+    for (const SharedLine &SL : findSharedLines(M, Accesses, CacheLine)) {
+        for (const LineMember &LM : SL.Members) {
+            GlobalVariable *GV = LM.Place.GV;
+            // Entries of a named section are often walked as an array between
+            // __start_<sec> and __stop_<sec>; padding one breaks the walk.
+            if (LM.Place.Align >= Target || GV->hasSection())
+                continue;
+            // A global spanning two shared lines is listed in both.
+            if (GV->getAlign() && GV->getAlign()->value() >= Target)
+                continue;
+            Aligned.emplace_back(GV, LM.Place.Align);
+            GV->setAlignment(Align(Target));
+        }
+    }
+    if (Aligned.empty())
+        return false;
+
+    if (!R.isText()) {
+        for (auto &[GV, OldAlign] : Aligned)
+            R.record("global_aligned", [&](json::OStream &J) {
+                J.attribute("global", GV->getName());
+                J.attribute("old_align", static_cast<int64_t>(OldAlign));
+                J.attribute("new_align", static_cast<int64_t>(Target));
+            });
+        return true;
+    }
+    raw_ostream &OS = R.stream();
+    OS << "📐 Aligned " << Aligned.size() << " globals to " << Target << "-byte cache lines: ";
+    for (size_t i = 0; i < Aligned.size(); ++i)
+        OS << (i ? ", " : "") << Aligned[i].first->getName();
+    OS << "\n\n";
+    return true;
+}
+
+} // namespace skeleton
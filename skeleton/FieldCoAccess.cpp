@@ -0,0 +1,265 @@
+#include "Analyses.h"
+#include "Profile.h"
+#include "Report.h"
+#include "StructInfo.h"
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/Format.h"
+
+#include <numeric>
+#include <set>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// The set of fields of one struct touched within one scope (the innermost
+// loop around the accesses, or the function body outside loops), weighted by
+// how often the scope is entered: the loop header count or the entry count.
+struct AccessPattern {
+    BitVector Fields;
+    double Weight = 0;
+    std::string Where;
+    unsigned Scopes = 1;
+};
+
+// Groups the accesses of every struct type into patterns.
+MapVector<StructType *, std::vector<AccessPattern>>
+collectPatterns(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI) {
+    MapVector<StructType *, std::vector<AccessPattern>> Patterns;
+    SmallVector<FieldRef, 4> Fields;
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+        FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+
+        MapVector<std::pair<Loop *, StructType *>, BitVector> Scopes;
+        for (BasicBlock &BB : F) {
+            Loop *L = LI.getLoopFor(&BB);
+            for (Instruction &I : BB) {
+                Value *Ptr = getLoadStorePointerOperand(&I);
+                const GEPOperator *GEP = Ptr ? getAddressGEP(Ptr) : nullptr;
+                if (!GEP)
+                    continue;
+                Fields.clear();
+                decodeStructFields(*GEP, Fields);
+                for (const FieldRef &FR : Fields) {
+                    BitVector &BV = Scopes[{L, FR.Struct}];
+                    if (BV.empty())
+                        BV.resize(FR.Struct->getNumElements());
+                    BV.set(FR.Field);
+                }
+            }
+        }
+
+        for (auto &[Key, BV] : Scopes) {
+            auto [L, ST] = Key;
+            AccessPattern P;
+            P.Fields = BV;
+            P.Weight = Prof.blockCount(L ? *L->getHeader() : F.getEntryBlock());
+            P.Where = F.getName().str();
+            if (L)
+                P.Where += ":" + (L->getHeader()->hasName() ? L->getHeader()->getName().str()
+                                                           : std::string("loop"));
+            Patterns[ST].push_back(std::move(P));
+        }
+    }
+    return Patterns;
+}
+
+unsigned linesTouched(StructType *ST, const BitVector &Fields, ArrayRef<uint64_t> Offsets,
+                      const DataLayout &DL, unsigned CacheLine) {
+    std::set<uint64_t> Lines;
+    for (unsigned f : Fields.set_bits()) {
+        uint64_t Size = DL.getTypeAllocSize(ST->getElementType(f)).getFixedValue();
+        if (!Size)
+            continue;
+        for (uint64_t L = Offsets[f] / CacheLine, E = (Offsets[f] + Size - 1) / CacheLine; L <= E; ++L)
+            Lines.insert(L);
+    }
+    return Lines.size();
+}
+
+// Greedy affinity clustering: start from the hottest field, then repeatedly
+// append the field most often accessed together with those already placed.
+// Each cache-line-sized run is then sorted by alignment so that grouping does
+// not cost extra padding. Fields that are never accessed go last.
+std::vector<unsigned> recommendOrder(StructType *ST, ArrayRef<AccessPattern> Patterns,
+                                     const DataLayout &DL, unsigned CacheLine) {
+    unsigned N = ST->getNumElements();
+    std::vector<double> Heat(N, 0);
+    std::vector<std::vector<double>> Affinity(N, std::vector<double>(N, 0));
+    for (const AccessPattern &P : Patterns)
+        for (unsigned i : P.Fields.set_bits()) {
+            Heat[i] += P.Weight;
+            for (unsigned j : P.Fields.set_bits())
+                Affinity[i][j] += P.Weight;
+        }
+
+    std::vector<unsigned> Order;
+    std::vector<bool> Placed(N, false);
+    std::vector<double> Pull(N, 0); // affinity to the fields placed so far
+    for (;;) {
+        int Best = -1;
+        for (unsigned i = 0; i < N; ++i) {
+            if (Placed[i] || Heat[i] == 0)
+                continue;
+            if (Best < 0 || Pull[i] > Pull[Best] || (Pull[i] == Pull[Best] && Heat[i] > Heat[Best]))
+                Best = i;
+        }
+        if (Best < 0)
+            break;
+        Placed[Best] = true;
+        Order.push_back(Best);
+        for (unsigned i = 0; i < N; ++i)
+            Pull[i] += Affinity[Best][i];
+    }
+    size_t NumHot = Order.size();
+    for (unsigned i = 0; i < N; ++i)
+        if (!Placed[i])
+            Order.push_back(i);
+
+    auto AlignOf = [&](unsigned i) { return DL.getABITypeAlign(ST->getElementType(i)); };
+    auto SortRuns = [&](size_t Begin, size_t End) {
+        size_t RunStart = Begin;
+        uint64_t RunBytes = 0;
+        for (size_t k = Begin; k <= End; ++k) {
+            uint64_t Size = k < End ? DL.getTypeAllocSize(ST->getElementType(Order[k])).getFixedValue() : 0;
+            if (k == End || (RunBytes && RunBytes + Size > CacheLine)) {
+                std::stable_sort(Order.begin() + RunStart, Order.begin() + k,
+                                 [&](unsigned A, unsigned B) { return AlignOf(A) > AlignOf(B); });
+                RunStart = k;
+                RunBytes = 0;
+            }
+            RunBytes += Size;
+        }
+    };
+    if (!ST->isPacked()) {
+        SortRuns(0, NumHot);
+        SortRuns(NumHot, Order.size());
+    }
+    return Order;
+}
+
+} // namespace
+
+void reportFieldCoAccess(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                         Report &R, unsigned CacheLine) {
+    const DataLayout &DL = M.getDataLayout();
+    auto Patterns = collectPatterns(M, FAM, PSI);
+    bool HeaderDone = false;
+
+    for (auto &[ST, Ps] : Patterns) {
+        if (!ST->isSized() || DL.getTypeAllocSize(ST).isScalable() || ST->getNumElements() < 2)
+            continue;
+
+        // Scopes touching the same set of fields form one pattern.
+        std::vector<AccessPattern> Merged;
+        for (AccessPattern &P : Ps) {
+            auto It = llvm::find_if(Merged, [&](auto &Q) { return Q.Fields == P.Fields; });
+            if (It == Merged.end()) {
+                Merged.push_back(P);
+            } else {
+                It->Weight += P.Weight;
+                if (It->Scopes++ < 3)
+                    It->Where += ", " + P.Where;
+                else if (It->Scopes == 4)
+                    It->Where += ", ...";
+            }
+        }
+        llvm::stable_sort(Merged, [](auto &A, auto &B) { return A.Weight > B.Weight; });
+
+        std::vector<unsigned> Order = recommendOrder(ST, Merged, DL, CacheLine);
+        SmallVector<uint64_t, 16> Current, Proposed;
+        std::vector<unsigned> Identity(ST->getNumElements());
+        std::iota(Identity.begin(), Identity.end(), 0);
+        uint64_t SizeBefore = layoutInOrder(ST, Identity, DL, Current);
+        uint64_t SizeAfter = layoutInOrder(ST, Order, DL, Proposed);
+
+        double Total = 0, LinesBefore = 0, LinesAfter = 0;
+        std::vector<std::pair<unsigned, unsigned>> Lines;
+        for (const AccessPattern &P : Merged) {
+            Lines.emplace_back(linesTouched(ST, P.Fields, Current, DL, CacheLine),
+                               linesTouched(ST, P.Fields, Proposed, DL, CacheLine));
+            Total += P.Weight;
+            LinesBefore += P.Weight * Lines.back().first;
+            LinesAfter += P.Weight * Lines.back().second;
+        }
+        if (Total > 0) {
+            LinesBefore /= Total;
+            LinesAfter /= Total;
+        }
+        // Only structs where the new order actually saves lines or bytes.
+        if (!(LinesAfter < LinesBefore - 1e-9 || SizeAfter < SizeBefore))
+            continue;
+        if (!R.withinBudget())
+            return;
+
+        if (!R.isText()) {
+            R.record("field_coaccess", [&](json::OStream &J) {
+                J.attribute("struct", typeName(ST));
+                J.attribute("size_before", static_cast<int64_t>(SizeBefore));
+                J.attribute("size_after", static_cast<int64_t>(SizeAfter));
+                J.attributeArray("order", [&] {
+                    for (unsigned i : Order)
+                        J.value(i);
+                });
+                J.attribute("lines_before", LinesBefore);
+                J.attribute("lines_after", LinesAfter);
+                J.attributeArray("patterns", [&] {
+                    for (unsigned k = 0; k < Merged.size(); ++k)
+                        J.object([&] {
+                            J.attributeArray("fields", [&] {
+                                for (unsigned f : Merged[k].Fields.set_bits())
+                                    J.value(f);
+                            });
+                            J.attribute("weight", Merged[k].Weight);
+                            J.attribute("where", Merged[k].Where);
+                            J.attribute("lines_before", Lines[k].first);
+                            J.attribute("lines_after", Lines[k].second);
+                        });
+                });
+            });
+            continue;
+        }
+
+        raw_ostream &OS = R.stream();
+        if (!HeaderDone) {
+            OS << "🔗 Field Co-Access (fields used together per loop/function, recommended order)\n";
+            HeaderDone = true;
+        }
+        OS << "   ┌─ " << typeName(ST) << ": " << SizeBefore << " → " << SizeAfter << " bytes, "
+           << format("%.2f → %.2f", LinesBefore, LinesAfter)
+           << " cache lines per access pattern (weighted)\n";
+        OS << "   │  Recommended order:";
+        for (unsigned i : Order)
+            OS << " " << i;
+        OS << "\n";
+        for (unsigned k = 0; k < Merged.size() && k < 8; ++k) {
+            OS << "   │  {";
+            ListSeparator LS(",");
+            for (unsigned f : Merged[k].Fields.set_bits())
+                OS << LS << f;
+            OS << "} ×" << format("%.1f", Merged[k].Weight) << ": " << Lines[k].first << " → "
+               << Lines[k].second << " lines  (" << Merged[k].Where << ")\n";
+        }
+        if (Merged.size() > 8)
+            OS << "   │  ... " << Merged.size() - 8 << " more patterns\n";
+        OS << "   └─────────────────────────────────────────────────────\n";
+    }
+    if (HeaderDone)
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
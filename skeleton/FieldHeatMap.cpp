@@ -0,0 +1,85 @@
+#include "Analyses.h"
+#include "Report.h"
+#include "StructInfo.h"
+
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+
+using namespace llvm;
+
+namespace skeleton {
+
+void reportFieldHeatMap(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                        Report &R) {
+    const DataLayout &DL = M.getDataLayout();
+    FieldAccessMap Map = collectFieldAccesses(M, FAM, PSI);
+
+    std::vector<std::pair<StructType *, const StructAccessStats *>> Sorted;
+    for (auto &[ST, SS] : Map) {
+        bool Accessed = llvm::any_of(SS.Fields, [](auto &FS) { return FS.accesses() != 0; });
+        if (Accessed && ST->isSized() && !DL.getTypeAllocSize(ST).isScalable())
+            Sorted.emplace_back(ST, &SS);
+    }
+    if (Sorted.empty())
+        return;
+    llvm::stable_sort(Sorted, [](auto &A, auto &B) {
+        return A.second->weighted() > B.second->weighted();
+    });
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🌡️  Field Access Heat Map (loads / stores / estimated executions"
+                   << (PerCall ? ", per call" : "") << ")\n";
+
+    for (auto &[ST, SS] : Sorted) {
+        if (!R.withinBudget())
+            return;
+        const StructLayout *SL = DL.getStructLayout(ST);
+        double Max = 0;
+        for (const FieldAccessStats &FS : SS->Fields)
+            Max = std::max(Max, FS.Weighted);
+
+        if (!R.isText()) {
+            R.record("field_heat", [&](json::OStream &J) {
+                J.attribute("struct", typeName(ST));
+                J.attribute("per_call", PerCall);
+                J.attribute("geps", static_cast<int64_t>(SS->GEPs));
+                J.attributeArray("fields", [&] {
+                    for (unsigned i = 0, e = SS->Fields.size(); i != e; ++i)
+                        J.object([&] {
+                            const FieldAccessStats &FS = SS->Fields[i];
+                            J.attribute("field", i);
+                            J.attribute("offset", static_cast<int64_t>(SL->getElementOffset(i)));
+                            J.attribute("loads", static_cast<int64_t>(FS.Loads));
+                            J.attribute("stores", static_cast<int64_t>(FS.Stores));
+                            J.attribute("weighted", FS.Weighted);
+                        });
+                });
+            });
+            continue;
+        }
+
+        raw_ostream &OS = R.stream();
+        OS << "   ┌─ " << typeName(ST) << ": " << format("%.1f", SS->weighted())
+           << " weighted accesses, " << SS->GEPs << " GEPs\n";
+        for (unsigned i = 0, e = SS->Fields.size(); i != e; ++i) {
+            const FieldAccessStats &FS = SS->Fields[i];
+            unsigned Bar = Max > 0 ? static_cast<unsigned>(20 * FS.Weighted / Max + 0.5) : 0;
+            OS << "   │  #" << left_justify(std::to_string(i), 3) << " @"
+               << left_justify(std::to_string(SL->getElementOffset(i)), 5)
+               << left_justify(typeName(ST->getElementType(i)), 16) << " "
+               << format("%6llu / %-6llu %14.1f  ", (unsigned long long)FS.Loads,
+                         (unsigned long long)FS.Stores, FS.Weighted);
+            for (unsigned b = 0; b < Bar; ++b)
+                OS << "█";
+            OS << (FS.accesses() ? "\n" : "cold\n");
+        }
+        OS << "   └─────────────────────────────────────────────────────\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
@@ -0,0 +1,425 @@
+#include "FloatingPoint.h"
+#include "Analyses.h"
+#include "Profile.h"
+#include "Report.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/IVDescriptors.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/Format.h"
+
+#include <map>
+#include <optional>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// C math library functions, without their float (f) and long double (l)
+// suffixes.
+const char *const MathFunctions[] = {
+    "acos", "asin",  "atan", "atan2", "cbrt", "ceil",  "copysign", "cos",   "cosh",  "exp",
+    "exp2", "expm1", "fabs", "floor", "fma",  "fmax",  "fmin",     "fmod",  "hypot", "log",
+    "log10", "log1p", "log2", "pow",  "round", "sin",  "sinh",     "sqrt",  "tan",   "tanh",
+    "trunc",
+};
+
+const char *const ExpensiveOperations[] = {
+    "fdiv", "frem",  "sqrt", "cbrt", "pow",  "exp",  "exp2", "exp10", "expm1", "log",
+    "log2", "log10", "log1p", "sin", "cos",  "tan",  "asin", "acos",  "atan",  "atan2",
+    "sinh", "cosh",  "tanh", "fmod", "hypot",
+};
+
+StringRef mathFunctionName(StringRef Name) {
+    for (StringRef Base : MathFunctions)
+        if (Name == Base || (Name.size() == Base.size() + 1 && Name.starts_with(Base) &&
+                             (Name.back() == 'f' || Name.back() == 'l')))
+            return Base;
+    return "";
+}
+
+// The value as an IR operand without its type, e.g. "%sum".
+std::string valueName(const Value *V) {
+    std::string S;
+    raw_string_ostream OS(S);
+    V->printAsOperand(OS, /*PrintType=*/false);
+    return OS.str();
+}
+
+const char *recurrenceName(RecurKind K) {
+    switch (K) {
+    case RecurKind::FAdd:
+        return "fadd";
+    case RecurKind::FMul:
+        return "fmul";
+    case RecurKind::FMin:
+        return "fmin";
+    case RecurKind::FMax:
+        return "fmax";
+    default:
+        return "fp";
+    }
+}
+
+struct FPCounts {
+    unsigned Ops = 0;
+    unsigned WithFlags = 0; // at least one fast-math flag
+    unsigned Fast = 0;      // all of them
+    unsigned Expensive = 0;
+    double Executions = 0;  // ops weighted by estimated block executions
+    std::map<std::string, unsigned> ByOperation;
+    StringMap<unsigned> ByFlag;
+
+    void add(const Instruction &I, const std::string &Op, double BlockCount) {
+        ++Ops;
+        Executions += BlockCount;
+        ++ByOperation[Op];
+        Expensive += isExpensiveFPOperation(Op);
+        // Every operation fpOperationName() names, fcmp and calls included,
+        // is an FPMathOperator and may carry flags.
+        FastMathFlags FMF = I.getFastMathFlags();
+        WithFlags += FMF.any();
+        Fast += FMF.isFast();
+        for (StringRef Flag : fastMathFlagNames(FMF))
+            ++ByFlag[Flag];
+    }
+};
+
+struct FPReduction {
+    std::string Accumulator;
+    const char *Operation;
+    bool InMemory; // loaded and stored through a loop-invariant address each iteration
+    bool Blocked;  // some step lacks reassoc, so the order must be kept
+};
+
+struct FPLoop {
+    Loop *L = nullptr;
+    std::string Name; // function:header
+    double Iterations = 0;
+    FPCounts Counts;
+    std::vector<FPReduction> Reductions;
+    unsigned InvariantDivisions = 0; // fdiv by a loop-invariant value without arcp
+    unsigned ErrnoCalls = 0;         // math library calls that may write errno
+
+    unsigned blockedReductions() const {
+        unsigned N = 0;
+        for (const FPReduction &Red : Reductions)
+            N += Red.Blocked;
+        return N;
+    }
+    bool gainsFromFastMath() const {
+        return blockedReductions() || InvariantDivisions || ErrnoCalls;
+    }
+};
+
+struct FPFunction {
+    Function *F;
+    FPCounts Counts;
+    std::vector<FPLoop> Loops;
+};
+
+// Reductions into a header phi, as the loop vectorizer recognizes them, and
+// into memory: "load P; fadd; store P" with P loop-invariant, which is how
+// they look before mem2reg and LICM promote them.
+void collectReductions(Loop &L, LoopInfo &LI, std::vector<FPReduction> &Reductions) {
+    for (PHINode &Phi : L.getHeader()->phis()) {
+        if (!Phi.getType()->isFloatingPointTy())
+            continue;
+        RecurrenceDescriptor RD;
+        if (!RecurrenceDescriptor::isReductionPHI(&Phi, &L, RD) ||
+            !RecurrenceDescriptor::isFloatingPointRecurrenceKind(RD.getRecurrenceKind()))
+            continue;
+        Reductions.push_back({valueName(&Phi), recurrenceName(RD.getRecurrenceKind()), false,
+                              RD.getExactFPMathInst() != nullptr});
+    }
+    for (BasicBlock *BB : L.blocks()) {
+        if (LI.getLoopFor(BB) != &L)
+            continue;
+        for (Instruction &I : *BB) {
+            auto *Store = dyn_cast<StoreInst>(&I);
+            if (!Store || Store->isVolatile())
+                continue;
+            auto *Op = dyn_cast<BinaryOperator>(Store->getValueOperand());
+            if (!Op || (Op->getOpcode() != Instruction::FAdd &&
+                        Op->getOpcode() != Instruction::FSub &&
+                        Op->getOpcode() != Instruction::FMul))
+                continue;
+            Value *Ptr = Store->getPointerOperand();
+            if (!L.isLoopInvariant(Ptr))
+                continue;
+            // sum - x accumulates, x - sum does not.
+            unsigned Accumulating = Op->getOpcode() == Instruction::FSub ? 1 : 2;
+            bool FromPtr = false;
+            for (unsigned i = 0; i < Accumulating; ++i)
+                if (auto *Load = dyn_cast<LoadInst>(Op->getOperand(i)))
+                    FromPtr |= Load->getPointerOperand() == Ptr && L.contains(Load);
+            if (FromPtr)
+                Reductions.push_back(
+                    {valueName(Ptr), Op->getOpcodeName(), true, !Op->hasAllowReassoc()});
+        }
+    }
+}
+
+// Whether every iteration divides by the same value, so that arcp would let
+// the reciprocal be computed once: a loop-invariant value, or a load from an
+// invariant address the loop never stores to. Constants with an exact
+// reciprocal are left out; those divisions become multiplications anyway.
+bool isInvariantDivisor(Loop &L, Value *D, const SmallPtrSetImpl<Value *> &Stored) {
+    if (auto *C = dyn_cast<ConstantFP>(D))
+        return !C->getValueAPF().getExactInverse(nullptr);
+    if (L.isLoopInvariant(D))
+        return true;
+    auto *Load = dyn_cast<LoadInst>(D);
+    return Load && !Load->isVolatile() && L.isLoopInvariant(Load->getPointerOperand()) &&
+           !Stored.count(Load->getPointerOperand());
+}
+
+void printCounts(raw_ostream &OS, const FPCounts &C) {
+    OS << C.Ops << " ops (";
+    ListSeparator LS(", ");
+    for (const auto &[Op, N] : C.ByOperation)
+        OS << LS << Op << " " << N;
+    OS << "), " << C.WithFlags << " with fast-math flags";
+    if (C.WithFlags)
+        OS << " (" << C.Fast << " fast)";
+    OS << ", " << C.Expensive << " expensive";
+}
+
+void emitCounts(json::OStream &J, const FPCounts &C) {
+    J.attribute("ops", C.Ops);
+    J.attributeObject("by_op", [&] {
+        for (const auto &[Op, N] : C.ByOperation)
+            J.attribute(Op, N);
+    });
+    J.attribute("with_flags", C.WithFlags);
+    J.attribute("fast", C.Fast);
+    J.attributeObject("flags", [&] {
+        for (StringRef Flag : fastMathFlagNames(FastMathFlags::getFast()))
+            J.attribute(Flag, C.ByFlag.lookup(Flag));
+    });
+    J.attribute("expensive", C.Expensive);
+    J.attribute("executions", C.Executions);
+}
+
+} // namespace
+
+SmallVector<StringRef, 7> fastMathFlagNames(FastMathFlags FMF) {
+    SmallVector<StringRef, 7> Names;
+    if (FMF.allowReassoc())
+        Names.push_back("reassoc");
+    if (FMF.noNaNs())
+        Names.push_back("nnan");
+    if (FMF.noInfs())
+        Names.push_back("ninf");
+    if (FMF.noSignedZeros())
+        Names.push_back("nsz");
+    if (FMF.allowReciprocal())
+        Names.push_back("arcp");
+    if (FMF.allowContract())
+        Names.push_back("contract");
+    if (FMF.approxFunc())
+        Names.push_back("afn");
+    return Names;
+}
+
+std::string fpOperationName(const Instruction &I) {
+    switch (I.getOpcode()) {
+    case Instruction::FAdd:
+    case Instruction::FSub:
+    case Instruction::FMul:
+    case Instruction::FDiv:
+    case Instruction::FRem:
+    case Instruction::FNeg:
+    case Instruction::FCmp:
+        return I.getOpcodeName();
+    default:
+        break;
+    }
+    const auto *Call = dyn_cast<CallInst>(&I);
+    if (!Call || !Call->getType()->isFPOrFPVectorTy())
+        return "";
+    if (const auto *II = dyn_cast<IntrinsicInst>(Call)) {
+        // llvm.sqrt, llvm.fma and the like; dotted names such as
+        // llvm.masked.load only move FP values around.
+        StringRef Name = Intrinsic::getBaseName(II->getIntrinsicID());
+        Name.consume_front("llvm.");
+        return Name.contains('.') ? "" : Name.str();
+    }
+    if (const Function *Callee = Call->getCalledFunction())
+        return mathFunctionName(Callee->getName()).str();
+    return "";
+}
+
+bool isExpensiveFPOperation(StringRef Op) {
+    for (StringRef E : ExpensiveOperations)
+        if (Op == E)
+            return true;
+    return false;
+}
+
+void reportFloatingPoint(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                         Report &R) {
+    std::vector<FPFunction> Functions;
+    unsigned TotalOps = 0, NumLoops = 0, Gaining = 0;
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        FPFunction FF{&F};
+        LoopInfo *LI = nullptr;
+        std::optional<FunctionProfile> Prof;
+        MapVector<Loop *, FPLoop> ByLoop;
+        DenseMap<Loop *, SmallPtrSet<Value *, 8>> StoredIn;
+        auto LoopEntry = [&](Loop *L) -> FPLoop & {
+            FPLoop &FL = ByLoop[L];
+            if (!FL.L) {
+                FL.L = L;
+                BasicBlock *Header = L->getHeader();
+                FL.Name = F.getName().str() + ":" +
+                          (Header->hasName() ? Header->getName().str() : std::string("loop"));
+                FL.Iterations = Prof->blockCount(*Header);
+            }
+            return FL;
+        };
+        for (BasicBlock &BB : F) {
+            for (Instruction &I : BB) {
+                std::string Op = fpOperationName(I);
+                if (Op.empty())
+                    continue;
+                if (!LI) {
+                    LI = &FAM.getResult<LoopAnalysis>(F);
+                    Prof.emplace(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+                }
+                double Count = Prof->blockCount(BB);
+                FF.Counts.add(I, Op, Count);
+                Loop *L = LI->getLoopFor(&BB);
+                if (!L)
+                    continue;
+                FPLoop &FL = LoopEntry(L);
+                FL.Counts.add(I, Op, Count);
+                if (Op == "fdiv" && !I.hasAllowReciprocal()) {
+                    auto It = StoredIn.find(L);
+                    if (It == StoredIn.end()) {
+                        It = StoredIn.try_emplace(L).first;
+                        for (BasicBlock *LB : L->blocks())
+                            for (Instruction &Other : *LB)
+                                if (auto *Store = dyn_cast<StoreInst>(&Other))
+                                    It->second.insert(Store->getPointerOperand());
+                    }
+                    FL.InvariantDivisions += isInvariantDivisor(*L, I.getOperand(1), It->second);
+                }
+                // With -fno-math-errno the front end marks these readnone.
+                if (isa<CallInst>(I) && !isa<IntrinsicInst>(I) &&
+                    !cast<CallInst>(I).doesNotAccessMemory())
+                    FL.ErrnoCalls++;
+            }
+        }
+        if (!FF.Counts.Ops)
+            continue;
+        for (Loop *L : LI->getLoopsInPreorder()) {
+            std::vector<FPReduction> Reductions;
+            collectReductions(*L, *LI, Reductions);
+            if (Reductions.empty() && !ByLoop.count(L))
+                continue;
+            FPLoop &FL = LoopEntry(L);
+            FL.Reductions = std::move(Reductions);
+            Gaining += FL.gainsFromFastMath();
+            FF.Loops.push_back(std::move(FL));
+        }
+        TotalOps += FF.Counts.Ops;
+        NumLoops += FF.Loops.size();
+        Functions.push_back(std::move(FF));
+    }
+    if (Functions.empty())
+        return;
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🧮 Floating Point (" << TotalOps << " ops in " << Functions.size()
+                   << " functions; " << Gaining << " of " << NumLoops
+                   << " loops would gain from local fast-math)\n";
+
+    for (const FPFunction &FF : Functions) {
+        if (!R.withinBudget())
+            return;
+        if (!R.isText()) {
+            R.record("fp_function", [&](json::OStream &J) {
+                J.attribute("function", FF.F->getName());
+                J.attribute("per_call", PerCall);
+                emitCounts(J, FF.Counts);
+            });
+            for (const FPLoop &FL : FF.Loops) {
+                R.record("fp_loop", [&](json::OStream &J) {
+                    J.attribute("loop", FL.Name);
+                    J.attribute("depth", FL.L->getLoopDepth());
+                    J.attribute("iterations", FL.Iterations);
+                    emitCounts(J, FL.Counts);
+                    J.attributeArray("reductions", [&] {
+                        for (const FPReduction &Red : FL.Reductions)
+                            J.object([&] {
+                                J.attribute("accumulator", Red.Accumulator);
+                                J.attribute("op", Red.Operation);
+                                J.attribute("form", Red.InMemory ? "memory" : "phi");
+                                J.attribute("blocked", Red.Blocked);
+                            });
+                    });
+                    J.attribute("invariant_divisions", FL.InvariantDivisions);
+                    J.attribute("errno_calls", FL.ErrnoCalls);
+                    J.attribute("gains_from_fast_math", FL.gainsFromFastMath());
+                });
+            }
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   ┌─ " << FF.F->getName() << ": ";
+        printCounts(OS, FF.Counts);
+        OS << "  [" << format("%.1f", FF.Counts.Executions) << " executions"
+           << (PerCall ? " per call" : "") << "]\n";
+        if (!FF.Counts.ByFlag.empty()) {
+            OS << "   │  Flags:";
+            ListSeparator LS(",");
+            for (StringRef Flag : fastMathFlagNames(FastMathFlags::getFast()))
+                if (unsigned N = FF.Counts.ByFlag.lookup(Flag))
+                    OS << LS << " " << Flag << " " << N;
+            OS << "\n";
+        }
+        for (const FPLoop &FL : FF.Loops) {
+            OS << "   │  ↻ " << FL.Name << " (depth " << FL.L->getLoopDepth() << "): ";
+            printCounts(OS, FL.Counts);
+            OS << "  [" << format("%.1f", FL.Iterations) << " iterations]\n";
+            for (const FPReduction &Red : FL.Reductions) {
+                OS << "   │     ⊕ reduction " << Red.Accumulator << " (" << Red.Operation
+                   << (Red.InMemory ? ", in memory" : "") << "): ";
+                OS << (Red.Blocked ? "ordered, cannot vectorize without reassoc"
+                                   : "reassociable")
+                   << "\n";
+            }
+            if (unsigned N = FL.blockedReductions())
+                OS << "   │     💡 reassoc would let " << N << " reduction"
+                   << (N == 1 ? "" : "s") << " vectorize\n";
+            if (FL.InvariantDivisions)
+                OS << "   │     💡 arcp would turn " << FL.InvariantDivisions
+                   << " division" << (FL.InvariantDivisions == 1 ? "" : "s")
+                   << " by a loop-invariant value into multiplications\n";
+            if (FL.ErrnoCalls)
+                OS << "   │     💡 " << FL.ErrnoCalls << " math library call"
+                   << (FL.ErrnoCalls == 1 ? " sets" : "s set")
+                   << " errno; -fno-math-errno (implied by -ffast-math) lets them vectorize\n";
+        }
+        OS << "   └─────────────────────────────────────────────────────\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
@@ -0,0 +1,32 @@
+#ifndef SKELETON_FLOATINGPOINT_H
+#define SKELETON_FLOATINGPOINT_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace llvm {
+class FastMathFlags;
+class Instruction;
+} // namespace llvm
+
+namespace skeleton {
+
+// The fast-math flags set in FMF, as spelled and ordered in the IR: "reassoc",
+// "nnan", "ninf", "nsz", "arcp", "contract" and "afn".
+llvm::SmallVector<llvm::StringRef, 7> fastMathFlagNames(llvm::FastMathFlags FMF);
+
+// The floating-point operation I performs: the opcode of fadd, fsub, fmul,
+// fdiv, frem, fneg and fcmp, or the function a call to an llvm.* math
+// intrinsic or a C math library function computes ("sqrt", "fma", "pow").
+// Empty for anything else.
+std::string fpOperationName(const llvm::Instruction &I);
+
+// Whether an operation named by fpOperationName() costs many times an add or
+// multiply: division, remainder, roots and the transcendental functions.
+bool isExpensiveFPOperation(llvm::StringRef Op);
+
+} // namespace skeleton
+
+#endif // SKELETON_FLOATINGPOINT_H
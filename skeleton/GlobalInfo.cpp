@@ -0,0 +1,188 @@
+#include "GlobalInfo.h"
+#include "Profile.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+
+#include <optional>
+
+using namespace llvm;
+
+namespace skeleton {
+
+uint64_t GlobalAccessStats::loads() const {
+    uint64_t N = 0;
+    for (const auto &[F, A] : Functions)
+        N += A.Loads;
+    return N;
+}
+
+uint64_t GlobalAccessStats::stores() const {
+    uint64_t N = 0;
+    for (const auto &[F, A] : Functions)
+        N += A.Stores;
+    return N;
+}
+
+uint64_t GlobalAccessStats::atomicWrites() const {
+    uint64_t N = 0;
+    for (const auto &[F, A] : Functions)
+        N += A.AtomicWrites;
+    return N;
+}
+
+double GlobalAccessStats::weighted() const {
+    double N = 0;
+    for (const auto &[F, A] : Functions)
+        N += A.Weighted;
+    return N;
+}
+
+GlobalAccessMap collectGlobalAccesses(Module &M, FunctionAnalysisManager *FAM,
+                                      ProfileSummaryInfo *PSI) {
+    GlobalAccessMap Accesses;
+    std::optional<FunctionProfile> Prof;
+    Instruction *Current = nullptr;
+    auto Access = [&](Function &F, Value *Ptr) -> GlobalFunctionAccess * {
+        auto *GV = dyn_cast<GlobalVariable>(getUnderlyingObject(Ptr));
+        if (!GV)
+            return nullptr;
+        GlobalFunctionAccess &A = Accesses[GV].Functions[&F];
+        if (FAM && PSI) {
+            if (!Prof)
+                Prof.emplace(F, *PSI, FAM->getResult<BlockFrequencyAnalysis>(F));
+            A.Weighted += Prof->blockCount(*Current->getParent());
+        }
+        return &A;
+    };
+    for (Function &F : M) {
+        Prof.reset();
+        for (Instruction &I : instructions(F)) {
+            Current = &I;
+            if (auto *LI = dyn_cast<LoadInst>(&I)) {
+                if (GlobalFunctionAccess *A = Access(F, LI->getPointerOperand()))
+                    A->Loads++;
+            } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
+                if (GlobalFunctionAccess *A = Access(F, SI->getPointerOperand())) {
+                    A->Stores++;
+                    A->AtomicWrites += SI->isAtomic();
+                }
+            } else if (isa<AtomicRMWInst>(I) || isa<AtomicCmpXchgInst>(I)) {
+                Value *Ptr = isa<AtomicRMWInst>(I) ? cast<AtomicRMWInst>(I).getPointerOperand()
+                                                   : cast<AtomicCmpXchgInst>(I).getPointerOperand();
+                if (GlobalFunctionAccess *A = Access(F, Ptr)) {
+                    A->Loads++;
+                    A->Stores++;
+                    A->AtomicWrites++;
+                }
+            } else if (auto *MI = dyn_cast<MemIntrinsic>(&I)) {
+                if (GlobalFunctionAccess *A = Access(F, MI->getRawDest()))
+                    A->Stores++;
+                if (auto *MT = dyn_cast<MemTransferInst>(MI))
+                    if (GlobalFunctionAccess *A = Access(F, MT->getRawSource()))
+                        A->Loads++;
+            }
+        }
+    }
+    return Accesses;
+}
+
+bool addressEscapes(const GlobalVariable &GV) {
+    SmallVector<const Value *, 8> Worklist{&GV};
+    SmallPtrSet<const Value *, 8> Visited;
+    while (!Worklist.empty()) {
+        const Value *V = Worklist.pop_back_val();
+        if (!Visited.insert(V).second)
+            continue;
+        for (const Use &U : V->uses()) {
+            const User *Usr = U.getUser();
+            if (isa<GEPOperator>(Usr) || isa<BitCastOperator>(Usr) ||
+                isa<AddrSpaceCastOperator>(Usr)) {
+                Worklist.push_back(Usr);
+            } else if (isa<LoadInst>(Usr) || isa<ICmpInst>(Usr)) {
+                continue;
+            } else if (isa<StoreInst>(Usr) || isa<AtomicRMWInst>(Usr) ||
+                       isa<AtomicCmpXchgInst>(Usr)) {
+                // Only as the address, not as the stored or compared value.
+                unsigned PtrIndex = isa<StoreInst>(Usr) ? StoreInst::getPointerOperandIndex() : 0;
+                if (U.getOperandNo() != PtrIndex)
+                    return true;
+            } else if (auto *MI = dyn_cast<MemIntrinsic>(Usr)) {
+                if (!MI->isArgOperand(&U) || U.getOperandNo() > 1 ||
+                    (U.getOperandNo() == 1 && !isa<MemTransferInst>(MI)))
+                    return true;
+            } else {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+StringRef linkageName(const GlobalValue &GV) {
+    switch (GV.getLinkage()) {
+    case GlobalValue::ExternalLinkage:
+        return "external";
+    case GlobalValue::AvailableExternallyLinkage:
+        return "available_externally";
+    case GlobalValue::LinkOnceAnyLinkage:
+        return "linkonce";
+    case GlobalValue::LinkOnceODRLinkage:
+        return "linkonce_odr";
+    case GlobalValue::WeakAnyLinkage:
+        return "weak";
+    case GlobalValue::WeakODRLinkage:
+        return "weak_odr";
+    case GlobalValue::AppendingLinkage:
+        return "appending";
+    case GlobalValue::InternalLinkage:
+        return "internal";
+    case GlobalValue::PrivateLinkage:
+        return "private";
+    case GlobalValue::ExternalWeakLinkage:
+        return "extern_weak";
+    case GlobalValue::CommonLinkage:
+        return "common";
+    }
+    llvm_unreachable("unknown linkage");
+}
+
+StringRef globalSection(const GlobalVariable &GV) {
+    if (GV.hasSection())
+        return GV.getSection();
+    bool Zero = !GV.hasInitializer() || GV.getInitializer()->isNullValue();
+    if (GV.isThreadLocal())
+        return Zero ? ".tbss" : ".tdata";
+    if (GV.isConstant())
+        return ".rodata";
+    return Zero ? ".bss" : ".data";
+}
+
+std::vector<GlobalPlacement> layoutGlobals(Module &M, const DataLayout &DL) {
+    std::vector<GlobalPlacement> Placements;
+    StringMap<uint64_t> SectionEnd;
+    for (GlobalVariable &GV : M.globals()) {
+        // available_externally definitions are never emitted here.
+        if (GV.isDeclaration() || GV.hasCommonLinkage() || GV.hasAvailableExternallyLinkage() ||
+            !GV.getValueType()->isSized())
+            continue;
+        StringRef Section = globalSection(GV);
+        uint64_t Size = DL.getTypeAllocSize(GV.getValueType());
+        uint64_t Alignment = DL.getPreferredAlign(&GV).value();
+        uint64_t &End = SectionEnd[Section];
+        uint64_t Offset = alignTo(End, Alignment);
+        End = Offset + Size;
+        Placements.push_back({&GV, Section, Offset, Size, Alignment});
+    }
+    return Placements;
+}
+
+} // namespace skeleton
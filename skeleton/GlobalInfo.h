@@ -0,0 +1,80 @@
+#ifndef SKELETON_GLOBALINFO_H
+#define SKELETON_GLOBALINFO_H
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/PassManager.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace llvm {
+class DataLayout;
+class Function;
+class GlobalValue;
+class GlobalVariable;
+class Module;
+class ProfileSummaryInfo;
+} // namespace llvm
+
+namespace skeleton {
+
+// Accesses to one global from one function. Atomic read-modify-writes count
+// as a load and a store; memset/memcpy/memmove count as the store (or load)
+// of the global they write (or read).
+struct GlobalFunctionAccess {
+    uint64_t Loads = 0;
+    uint64_t Stores = 0;
+    uint64_t AtomicWrites = 0; // atomic stores, atomicrmw and cmpxchg
+    double Weighted = 0;       // loads and stores weighted by estimated block executions
+
+    uint64_t accesses() const { return Loads + Stores; }
+};
+
+struct GlobalAccessStats {
+    llvm::MapVector<const llvm::Function *, GlobalFunctionAccess> Functions;
+
+    uint64_t loads() const;
+    uint64_t stores() const;
+    uint64_t atomicWrites() const;
+    double weighted() const;
+};
+
+using GlobalAccessMap = llvm::MapVector<llvm::GlobalVariable *, GlobalAccessStats>;
+
+// Loads and stores of every global variable, attributed through
+// getUnderlyingObject(), so accesses through constant or instruction GEPs
+// into a global count for it. Weighted counts are only filled in when FAM and
+// PSI are given.
+GlobalAccessMap collectGlobalAccesses(llvm::Module &M,
+                                      llvm::FunctionAnalysisManager *FAM = nullptr,
+                                      llvm::ProfileSummaryInfo *PSI = nullptr);
+
+// Whether GV's address is used other than to load, store or copy through it:
+// passed to a call, stored as a value, converted to an integer, and so on.
+// Accesses through such copies are invisible to collectGlobalAccesses().
+bool addressEscapes(const llvm::GlobalVariable &GV);
+
+// The linkage as spelled in the IR, e.g. "internal" or "linkonce_odr".
+llvm::StringRef linkageName(const llvm::GlobalValue &GV);
+
+// The object-file section a definition goes to: its explicit section, or the
+// one the usual ELF lowering picks (.rodata, .tdata, .tbss, .bss or .data).
+llvm::StringRef globalSection(const llvm::GlobalVariable &GV);
+
+struct GlobalPlacement {
+    llvm::GlobalVariable *GV;
+    llvm::StringRef Section;
+    uint64_t Offset; // from the start of this module's part of the section
+    uint64_t Size;
+    uint64_t Align;
+};
+
+// Lays out the module's global definitions the way the code generator emits
+// them: in module order within each section, each at its alignment. Common
+// symbols, which the linker places, are left out.
+std::vector<GlobalPlacement> layoutGlobals(llvm::Module &M, const llvm::DataLayout &DL);
+
+} // namespace skeleton
+
+#endif // SKELETON_GLOBALINFO_H
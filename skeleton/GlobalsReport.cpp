@@ -0,0 +1,183 @@
+#include "Analyses.h"
+#include "GlobalInfo.h"
+#include "Report.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// Never-written mutable globals at least this large are read-only tables that
+// belong in .rodata rather than a writable, copy-on-write data page.
+constexpr uint64_t LargeTableBytes = 256;
+
+// A global is hot when it takes at least this share of all global accesses.
+constexpr double HotShare = 0.10;
+
+struct GlobalEntry {
+    GlobalVariable *GV;
+    const GlobalAccessStats *Stats = nullptr; // null when never accessed
+    uint64_t Size = 0;
+    double Key = 0; // sort key: profile-weighted or static accesses
+    bool Escapes = false;
+    bool Hot = false;
+    std::vector<const char *> Suggestions;
+};
+
+bool isSkipped(const GlobalVariable &GV) {
+    return GV.getName().starts_with("llvm.") || GV.getSection() == "llvm.metadata";
+}
+
+// "const", "rodata" and "internal" for globals that could carry a stronger
+// declaration, judged from this module alone.
+void suggest(GlobalEntry &E, const SmallPtrSetImpl<GlobalValue *> &Used) {
+    GlobalVariable &GV = *E.GV;
+    if (GV.isDeclaration())
+        return;
+    bool Written = E.Stats && E.Stats->stores();
+    if (!GV.isConstant() && !GV.isThreadLocal() && GV.hasDefinitiveInitializer() && !Written &&
+        !E.Escapes)
+        E.Suggestions.push_back(E.Size >= LargeTableBytes ? "rodata" : "const");
+    if (!GV.hasLocalLinkage() && !Used.count(&GV))
+        E.Suggestions.push_back("internal");
+}
+
+const char *suggestionText(StringRef S) {
+    if (S == "rodata")
+        return "💡 never written: const would move it to .rodata";
+    if (S == "const")
+        return "💡 never written: could be const";
+    return "💡 could be static/internal";
+}
+
+} // namespace
+
+void reportGlobals(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI, Report &R) {
+    const DataLayout &DL = M.getDataLayout();
+    bool Weighted = PSI.hasProfileSummary();
+    GlobalAccessMap Accesses = collectGlobalAccesses(M, &FAM, &PSI);
+
+    SmallVector<GlobalValue *, 8> UsedVec;
+    collectUsedGlobalVariables(M, UsedVec, /*CompilerUsed=*/false);
+    collectUsedGlobalVariables(M, UsedVec, /*CompilerUsed=*/true);
+    SmallPtrSet<GlobalValue *, 8> Used(UsedVec.begin(), UsedVec.end());
+
+    std::vector<GlobalEntry> Entries;
+    uint64_t DefinedBytes = 0;
+    double TotalKey = 0;
+    for (GlobalVariable &GV : M.globals()) {
+        if (isSkipped(GV) || !GV.getValueType()->isSized())
+            continue;
+        GlobalEntry E{&GV};
+        E.Size = DL.getTypeAllocSize(GV.getValueType());
+        auto It = Accesses.find(&GV);
+        if (It != Accesses.end()) {
+            E.Stats = &It->second;
+            E.Key = Weighted ? E.Stats->weighted()
+                             : double(E.Stats->loads() + E.Stats->stores());
+        }
+        E.Escapes = addressEscapes(GV);
+        suggest(E, Used);
+        if (!GV.isDeclaration())
+            DefinedBytes += E.Size;
+        TotalKey += E.Key;
+        Entries.push_back(std::move(E));
+    }
+    if (Entries.empty())
+        return;
+    for (GlobalEntry &E : Entries)
+        E.Hot = !E.GV->isConstant() && E.Key > 0 && E.Key >= HotShare * TotalKey;
+    std::stable_sort(Entries.begin(), Entries.end(),
+                     [](const GlobalEntry &A, const GlobalEntry &B) { return A.Key > B.Key; });
+
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🌐 Global Variables (" << Entries.size() << " globals, " << DefinedBytes
+                   << " bytes defined; sorted by "
+                   << (Weighted ? "profile-weighted" : "static") << " accesses)\n";
+
+    for (const GlobalEntry &E : Entries) {
+        if (!R.withinBudget())
+            return;
+        GlobalVariable &GV = *E.GV;
+        bool Decl = GV.isDeclaration();
+        if (!R.isText()) {
+            R.record("global", [&](json::OStream &J) {
+                J.attribute("name", GV.getName());
+                J.attribute("size", static_cast<int64_t>(E.Size));
+                J.attribute("align", static_cast<int64_t>(DL.getPreferredAlign(&GV).value()));
+                J.attribute("linkage", linkageName(GV));
+                if (Decl)
+                    J.attribute("section", nullptr);
+                else
+                    J.attribute("section", globalSection(GV));
+                J.attribute("declaration", Decl);
+                J.attribute("constant", GV.isConstant());
+                J.attribute("thread_local", GV.isThreadLocal());
+                J.attribute("loads", static_cast<int64_t>(E.Stats ? E.Stats->loads() : 0));
+                J.attribute("stores", static_cast<int64_t>(E.Stats ? E.Stats->stores() : 0));
+                J.attribute("atomic_writes",
+                            static_cast<int64_t>(E.Stats ? E.Stats->atomicWrites() : 0));
+                J.attribute("weighted", E.Stats ? E.Stats->weighted() : 0.0);
+                J.attribute("address_escapes", E.Escapes);
+                J.attribute("hot", E.Hot);
+                J.attributeArray("suggestions", [&] {
+                    for (const char *S : E.Suggestions)
+                        J.value(S);
+                });
+                J.attributeArray("functions", [&] {
+                    if (!E.Stats)
+                        return;
+                    for (const auto &[F, A] : E.Stats->Functions)
+                        J.object([&] {
+                            J.attribute("function", F->getName());
+                            J.attribute("loads", static_cast<int64_t>(A.Loads));
+                            J.attribute("stores", static_cast<int64_t>(A.Stores));
+                            J.attribute("weighted", A.Weighted);
+                        });
+                });
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   • " << GV.getName() << "  " << E.Size << " bytes  "
+           << (Decl ? StringRef("declaration") : globalSection(GV)) << "  " << linkageName(GV)
+           << "  " << (GV.isConstant() ? "const" : "mutable");
+        if (GV.isThreadLocal())
+            OS << " thread_local";
+        if (E.Stats)
+            OS << "  [" << E.Stats->loads() << " loads, " << E.Stats->stores() << " stores in "
+               << E.Stats->Functions.size() << " functions, "
+               << format("%.1f", E.Stats->weighted()) << " weighted]";
+        else
+            OS << "  [not accessed]";
+        if (E.Escapes)
+            OS << "  address escapes";
+        if (E.Hot)
+            OS << "  🔥 hot";
+        OS << "\n";
+        if (E.Stats)
+            for (const auto &[F, A] : E.Stats->Functions)
+                OS << "       ↳ " << F->getName() << ": " << A.Loads << " loads, " << A.Stores
+                   << " stores\n";
+        for (const char *S : E.Suggestions) {
+            OS << "       " << suggestionText(S);
+            if (StringRef(S) != "internal" && !GV.hasLocalLinkage())
+                OS << " (unless another translation unit writes it)";
+            else if (StringRef(S) == "internal")
+                OS << " (if no other translation unit refers to it)";
+            OS << "\n";
+        }
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
@@ -0,0 +1,194 @@
+#include "Analyses.h"
+#include "Instrumentation.h"
+#include "Profile.h"
+#include "Report.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/InlineCost.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+enum class Decision { Always, Inline, TooCostly, Never };
+
+StringRef decisionName(Decision D) {
+    switch (D) {
+    case Decision::Always: return "always";
+    case Decision::Inline: return "inline";
+    case Decision::TooCostly: return "too_costly";
+    case Decision::Never: return "never";
+    }
+    llvm_unreachable("unknown inline decision");
+}
+
+struct InlineSite {
+    CallBase *Call;
+    std::string Site;
+    Decision D;
+    int Cost = 0;      // variable decisions only; a lower bound when too costly
+    int Threshold = 0;
+    std::string Reason;
+    double Executions;
+    Hotness Hot;
+    StringRef Suggestion; // "always_inline" or "noinline", if worth adding
+    bool OnCallee = false; // on the callee rather than as a call-site attribute
+};
+
+} // namespace
+
+void reportInlining(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI, Report &R,
+                    const InlineParams &Params, unsigned Top) {
+    auto GetAC = [&](Function &F) -> AssumptionCache & {
+        return FAM.getResult<AssumptionAnalysis>(F);
+    };
+    auto GetTLI = [&](Function &F) -> const TargetLibraryInfo & {
+        return FAM.getResult<TargetLibraryAnalysis>(F);
+    };
+    auto GetBFI = [&](Function &F) -> BlockFrequencyInfo & {
+        return FAM.getResult<BlockFrequencyAnalysis>(F);
+    };
+
+    std::vector<InlineSite> Sites;
+    unsigned Counts[4] = {};
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        FunctionProfile Prof(F, PSI, GetBFI(F));
+        for (Instruction &I : instructions(F)) {
+            auto *CB = dyn_cast<CallBase>(&I);
+            Function *Callee = CB ? CB->getCalledFunction() : nullptr;
+            if (!Callee || Callee->isDeclaration() || Callee->isIntrinsic())
+                continue;
+            InlineCost IC = getInlineCost(*CB, Params, FAM.getResult<TargetIRAnalysis>(*Callee),
+                                          GetAC, GetTLI, GetBFI, &PSI);
+            InlineSite S{CB, siteName(*CB)};
+            if (IC.isAlways())
+                S.D = Decision::Always;
+            else if (IC.isNever())
+                S.D = Decision::Never;
+            else {
+                S.Cost = IC.getCost();
+                S.Threshold = IC.getThreshold();
+                S.D = IC ? Decision::Inline : Decision::TooCostly;
+            }
+            if (const char *Reason = IC.getReason())
+                S.Reason = Reason;
+            S.Executions = Prof.blockCount(*CB->getParent());
+            S.Hot = Prof.blockHotness(*CB->getParent());
+
+            // Hot calls the inliner refuses only on size may be worth forcing;
+            // cold ones it takes anyway only grow their callers.
+            if (S.D == Decision::TooCostly && S.Hot == Hotness::Hot &&
+                S.Cost <= 3 * S.Threshold)
+                S.Suggestion = "always_inline";
+            else if (S.D == Decision::Inline && S.Hot == Hotness::Cold &&
+                     2 * S.Cost > S.Threshold)
+                S.Suggestion = "noinline";
+            ++Counts[static_cast<unsigned>(S.D)];
+            Sites.push_back(std::move(S));
+        }
+    }
+    if (Sites.empty())
+        return;
+
+    // A callee attribute changes every call, so it is only suggested when all
+    // of the callee's calls want the same one and no other module or
+    // indirect call can reach it. Otherwise the attribute goes on the call.
+    DenseMap<const Function *, StringRef> Agreed;
+    for (const InlineSite &S : Sites) {
+        auto [It, Inserted] = Agreed.try_emplace(S.Call->getCalledFunction(), S.Suggestion);
+        if (!Inserted && It->second != S.Suggestion)
+            It->second = StringRef();
+    }
+    for (InlineSite &S : Sites) {
+        const Function *Callee = S.Call->getCalledFunction();
+        S.OnCallee = !S.Suggestion.empty() && Agreed.lookup(Callee) == S.Suggestion &&
+                     Callee->hasLocalLinkage() && !Callee->hasAddressTaken();
+    }
+
+    llvm::stable_sort(Sites, [](const InlineSite &A, const InlineSite &B) {
+        return A.Executions > B.Executions;
+    });
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "📥 Inlining (" << Sites.size() << " direct call sites: "
+                   << Counts[unsigned(Decision::Always)] << " always, "
+                   << Counts[unsigned(Decision::Inline)] << " under threshold, "
+                   << Counts[unsigned(Decision::TooCostly)] << " too costly, "
+                   << Counts[unsigned(Decision::Never)]
+                   << " never; hottest sites not inlined, estimated executions"
+                   << (PerCall ? " per call" : "") << ")\n";
+
+    unsigned Shown = 0;
+    for (const InlineSite &S : Sites) {
+        if (!R.withinBudget())
+            return;
+        if (!R.isText()) {
+            R.record("inline_site", [&](json::OStream &J) {
+                J.attribute("site", S.Site);
+                J.attribute("caller", S.Call->getFunction()->getName());
+                J.attribute("callee", S.Call->getCalledFunction()->getName());
+                J.attribute("decision", decisionName(S.D));
+                if (S.D == Decision::Inline || S.D == Decision::TooCostly) {
+                    J.attribute("cost", S.Cost);
+                    J.attribute("threshold", S.Threshold);
+                }
+                if (!S.Reason.empty())
+                    J.attribute("reason", S.Reason);
+                J.attribute("executions", S.Executions);
+                J.attribute("hotness", hotnessName(S.Hot));
+                if (!S.Suggestion.empty()) {
+                    J.attribute("suggestion", S.Suggestion);
+                    J.attribute("suggestion_scope", S.OnCallee ? "callee" : "call_site");
+                }
+            });
+            continue;
+        }
+        // Text lists what the inliner would leave behind, plus any site with
+        // a suggestion.
+        bool NotInlined = S.D == Decision::TooCostly || S.D == Decision::Never;
+        if (!NotInlined && S.Suggestion.empty())
+            continue;
+        if (Top && Shown++ >= Top)
+            continue;
+        raw_ostream &OS = R.stream();
+        OS << "   • " << S.Site << "  → " << S.Call->getCalledFunction()->getName() << "  "
+           << format("%.1f", S.Executions) << " executions"
+           << (S.Hot == Hotness::Hot ? "  🔥" : "") << "\n";
+        OS << "      ";
+        // The analysis stops once the cost reaches the threshold, so the cost
+        // of a refused site is only a lower bound.
+        if (S.D == Decision::Never)
+            OS << "never inlined";
+        else if (S.D == Decision::TooCostly)
+            OS << "cost ≥ " << S.Cost << ", over threshold " << S.Threshold;
+        else
+            OS << "cost " << S.Cost << " under threshold " << S.Threshold;
+        if (!S.Reason.empty())
+            OS << ": " << S.Reason;
+        if (S.OnCallee)
+            OS << "  💡 " << S.Suggestion << " on " << S.Call->getCalledFunction()->getName();
+        else if (!S.Suggestion.empty())
+            OS << "  💡 [[clang::" << S.Suggestion << "]] on this call";
+        OS << "\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
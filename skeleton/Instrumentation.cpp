@@ -0,0 +1,233 @@
+#include "Instrumentation.h"
+#include "Report.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace skeleton {
+
+// Must match SKELETON_RT_VERSION in runtime/SkeletonRuntime.h.
+constexpr unsigned RuntimeVersion = 1;
+
+std::string siteName(const Instruction &I) {
+    const BasicBlock *BB = I.getParent();
+    const Function *F = BB->getParent();
+    std::string Name = F->getName().str() + ":";
+    if (BB->hasName()) {
+        Name += BB->getName().str();
+    } else {
+        unsigned Index = 1;
+        for (const BasicBlock &Other : *F) {
+            if (&Other == BB)
+                break;
+            ++Index;
+        }
+        Name += "#" + std::to_string(Index);
+    }
+    unsigned Pos = 1;
+    for (const Instruction &Other : *BB) {
+        if (&Other == &I)
+            break;
+        ++Pos;
+    }
+    return Name + ":" + std::to_string(Pos);
+}
+
+void reportInstrumentation(Report &R, StringRef Kind, unsigned NumSites) {
+    if (!R.isText()) {
+        R.record("instrumentation", [&](json::OStream &J) {
+            J.attribute("kind", Kind);
+            J.attribute("sites", NumSites);
+        });
+        return;
+    }
+    R.stream() << "🧪 Instrumented " << NumSites << " " << Kind
+               << " sites; link with libskeleton_rt.a, counters are appended to "
+                  "$SKELETON_PROFILE at exit\n\n";
+}
+
+SiteCounters::SiteCounters(Module &M, StringRef Kind, ArrayRef<StringRef> Names,
+                           bool PerThread)
+    : M(M), Kind(Kind.str()) {
+    for (StringRef N : Names)
+        CounterNames.push_back(N.str());
+    Placeholder = new GlobalVariable(M, Type::getInt64Ty(M.getContext()), false,
+                                     GlobalValue::ExternalLinkage, nullptr,
+                                     "__skeleton_" + Kind + "_counters.placeholder");
+    if (PerThread)
+        ThreadCountersFn = Function::Create(
+            FunctionType::get(PointerType::get(M.getContext(), 0), false),
+            GlobalValue::InternalLinkage, "__skeleton_" + Kind + "_thread_counters", M);
+}
+
+unsigned SiteCounters::addSite(const Twine &Description) {
+    Sites.push_back(Description.str());
+    return Sites.size() - 1;
+}
+
+Value *SiteCounters::address(IRBuilder<> &B, Value *Base, unsigned Site, unsigned Counter) {
+    return B.CreateConstInBoundsGEP1_64(B.getInt64Ty(), Base,
+                                        uint64_t(Site) * CounterNames.size() + Counter);
+}
+
+Value *SiteCounters::counterAddress(IRBuilder<> &B, unsigned Site, unsigned Counter) {
+    return address(B, Placeholder, Site, Counter);
+}
+
+void SiteCounters::increment(IRBuilder<> &B, unsigned Site, unsigned Counter, Value *Amount) {
+    B.CreateAtomicRMW(AtomicRMWInst::Add, counterAddress(B, Site, Counter),
+                      Amount ? Amount : B.getInt64(1), MaybeAlign(8), AtomicOrdering::Monotonic);
+}
+
+Value *SiteCounters::threadCounters(IRBuilder<> &B) {
+    assert(ThreadCountersFn && "counters are not per-thread");
+    return B.CreateCall(ThreadCountersFn, {}, Kind + ".counters");
+}
+
+void SiteCounters::add(IRBuilder<> &B, Value *Base, unsigned Site, unsigned Counter,
+                       Value *Amount) {
+    Value *Addr = address(B, Base, Site, Counter);
+    B.CreateAlignedStore(B.CreateAdd(B.CreateAlignedLoad(B.getInt64Ty(), Addr, Align(8)), Amount),
+                         Addr, Align(8));
+}
+
+void SiteCounters::max(IRBuilder<> &B, Value *Base, unsigned Site, unsigned Counter, Value *V) {
+    Value *Addr = address(B, Base, Site, Counter);
+    Value *Old = B.CreateAlignedLoad(B.getInt64Ty(), Addr, Align(8));
+    B.CreateAlignedStore(B.CreateBinaryIntrinsic(Intrinsic::umax, Old, V), Addr, Align(8));
+}
+
+void SiteCounters::finish() {
+    LLVMContext &Ctx = M.getContext();
+    if (Sites.empty()) {
+        Placeholder->eraseFromParent();
+        if (ThreadCountersFn)
+            ThreadCountersFn->eraseFromParent();
+        return;
+    }
+
+    Type *Int32 = Type::getInt32Ty(Ctx);
+    Type *Int64 = Type::getInt64Ty(Ctx);
+    PointerType *Ptr = PointerType::get(Ctx, 0);
+    auto String = [&](StringRef S) -> Constant * {
+        Constant *Init = ConstantDataArray::getString(Ctx, S);
+        auto *GV = new GlobalVariable(M, Init->getType(), true, GlobalValue::PrivateLinkage, Init,
+                                      "__skeleton_str");
+        GV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+        GV->setAlignment(Align(1));
+        return GV;
+    };
+    auto Array = [&](ArrayRef<std::string> Strings, StringRef Name) {
+        std::vector<Constant *> Elems;
+        for (const std::string &S : Strings)
+            Elems.push_back(String(S));
+        auto *Ty = ArrayType::get(Ptr, Elems.size());
+        return new GlobalVariable(M, Ty, true, GlobalValue::PrivateLinkage,
+                                  ConstantArray::get(Ty, Elems), Name);
+    };
+
+    auto *CountersTy = ArrayType::get(Int64, Sites.size() * CounterNames.size());
+    auto *Counters = new GlobalVariable(M, CountersTy, false, GlobalValue::InternalLinkage,
+                                        ConstantAggregateZero::get(CountersTy),
+                                        "__skeleton_" + Kind + "_counters");
+    Counters->setAlignment(Align(8));
+    Placeholder->replaceAllUsesWith(Counters);
+    Placeholder->eraseFromParent();
+
+    // struct __skeleton_site_table
+    auto *TableTy = StructType::get(Ctx, {Int32, Int32, Int32, Ptr, Ptr, Ptr, Ptr, Ptr});
+    Constant *Fields[] = {
+        ConstantInt::get(Int32, RuntimeVersion),
+        ConstantInt::get(Int32, Sites.size()),
+        ConstantInt::get(Int32, CounterNames.size()),
+        String(Kind),
+        String(M.getSourceFileName()),
+        Array(CounterNames, "__skeleton_" + Kind + "_counter_names"),
+        Array(Sites, "__skeleton_" + Kind + "_sites"),
+        Counters,
+    };
+    auto *Table = new GlobalVariable(M, TableTy, true, GlobalValue::PrivateLinkage,
+                                     ConstantStruct::get(TableTy, Fields),
+                                     "__skeleton_" + Kind + "_table");
+
+    FunctionCallee Register = M.getOrInsertFunction(
+        "__skeleton_register", FunctionType::get(Type::getVoidTy(Ctx), {Ptr}, false));
+    Function *Ctor = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                                      GlobalValue::InternalLinkage,
+                                      "__skeleton_register_" + Kind, M);
+    IRBuilder<> B(BasicBlock::Create(Ctx, "", Ctor));
+    B.CreateCall(Register, {Table});
+    B.CreateRetVoid();
+    appendToGlobalCtors(M, Ctor, /*Priority=*/65535);
+
+    if (!ThreadCountersFn)
+        return;
+    // Caches the runtime's buffer for this thread in a thread-local pointer:
+    //   if (!cache) cache = __skeleton_thread_counters(&table);
+    //   return cache;
+    auto *Cache = new GlobalVariable(M, Ptr, false, GlobalValue::InternalLinkage,
+                                     ConstantPointerNull::get(Ptr),
+                                     "__skeleton_" + Kind + "_thread_counters.cache", nullptr,
+                                     GlobalValue::GeneralDynamicTLSModel);
+    FunctionCallee Allocate = M.getOrInsertFunction("__skeleton_thread_counters",
+                                                    FunctionType::get(Ptr, {Ptr}, false));
+    BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", ThreadCountersFn);
+    BasicBlock *Miss = BasicBlock::Create(Ctx, "miss", ThreadCountersFn);
+    BasicBlock *Hit = BasicBlock::Create(Ctx, "hit", ThreadCountersFn);
+    B.SetInsertPoint(Entry);
+    Value *Cached = B.CreateLoad(Ptr, Cache, "cached");
+    B.CreateCondBr(B.CreateIsNull(Cached), Miss, Hit,
+                   MDBuilder(Ctx).createBranchWeights(1, 1 << 20));
+    B.SetInsertPoint(Miss);
+    Value *Fresh = B.CreateCall(Allocate, {Table}, "fresh");
+    B.CreateStore(Fresh, Cache);
+    B.CreateBr(Hit);
+    B.SetInsertPoint(Hit);
+    PHINode *Result = B.CreatePHI(Ptr, 2);
+    Result->addIncoming(Cached, Entry);
+    Result->addIncoming(Fresh, Miss);
+    B.CreateRet(Result);
+}
+
+Expected<SiteProfile> readSiteProfile(StringRef Path, StringRef Kind, StringRef SourceFile) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFile(Path);
+    if (!Buf)
+        return createFileError(Path, Buf.getError());
+
+    SiteProfile Profile;
+    for (line_iterator L(**Buf, /*SkipBlanks=*/true); !L.is_at_end(); ++L) {
+        Expected<json::Value> V = json::parse(*L);
+        if (!V)
+            return createFileError(Path, L.line_number(), V.takeError());
+        const json::Object *O = V->getAsObject();
+        if (!O)
+            return createFileError(Path, L.line_number(),
+                                   createStringError(inconvertibleErrorCode(),
+                                                     "record is not an object"));
+        auto LineKind = O->getString("kind");
+        auto Module = O->getString("module");
+        auto Site = O->getString("site");
+        const json::Object *Counters = O->getObject("counters");
+        if (!LineKind || *LineKind != Kind || !Module || *Module != SourceFile || !Site ||
+            !Counters)
+            continue;
+        StringMap<uint64_t> &Values = Profile[*Site];
+        for (const auto &[Name, Value] : *Counters)
+            if (auto N = Value.getAsUINT64()) {
+                uint64_t &Total = Values[Name.str()];
+                Total = StringRef(Name).starts_with("max_") ? std::max(Total, *N) : Total + *N;
+            }
+    }
+    return Profile;
+}
+
+} // namespace skeleton
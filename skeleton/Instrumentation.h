@@ -0,0 +1,93 @@
+#ifndef SKELETON_INSTRUMENTATION_H
+#define SKELETON_INSTRUMENTATION_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Support/Error.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Function;
+class GlobalVariable;
+class Instruction;
+class Module;
+} // namespace llvm
+
+namespace skeleton {
+
+class Report;
+
+// "function:block:index" naming an instruction in reports and profiles, with
+// the 1-based position in its block. Unnamed blocks are written as #N.
+std::string siteName(const llvm::Instruction &I);
+
+// Tells the report how many sites of a kind were instrumented.
+void reportInstrumentation(Report &R, llvm::StringRef Kind, unsigned NumSites);
+
+// Counters of one kind of instrumented site, e.g. "atomic". Sites are
+// numbered as they are added and each has the same named counters. finish()
+// emits the counter array, the site table and a module constructor that
+// registers them with the runtime in runtime/SkeletonRuntime.h.
+//
+// Shared counters are updated with relaxed atomic adds. Per-thread counters
+// are plain memory the runtime hands each thread on first use and folds into
+// the shared array when the thread exits, for sites that are hot on many
+// threads at once; counters named max_* are folded by maximum, not sum.
+class SiteCounters {
+public:
+    SiteCounters(llvm::Module &M, llvm::StringRef Kind,
+                 llvm::ArrayRef<llvm::StringRef> CounterNames, bool PerThread = false);
+
+    unsigned addSite(const llvm::Twine &Description);
+    unsigned size() const { return Sites.size(); }
+
+    // Adds Amount (1 when null) to a shared counter with a relaxed atomic add.
+    void increment(llvm::IRBuilder<> &B, unsigned Site, unsigned Counter,
+                   llvm::Value *Amount = nullptr);
+    // Address of a shared counter, for instrumentation that updates it itself.
+    llvm::Value *counterAddress(llvm::IRBuilder<> &B, unsigned Site, unsigned Counter);
+
+    // The calling thread's counter array, for add() and max(). Get it once
+    // per site and update its counters through it.
+    llvm::Value *threadCounters(llvm::IRBuilder<> &B);
+    void add(llvm::IRBuilder<> &B, llvm::Value *Base, unsigned Site, unsigned Counter,
+             llvm::Value *Amount);
+    void max(llvm::IRBuilder<> &B, llvm::Value *Base, unsigned Site, unsigned Counter,
+             llvm::Value *V);
+
+    void finish();
+
+private:
+    llvm::Value *address(llvm::IRBuilder<> &B, llvm::Value *Base, unsigned Site,
+                         unsigned Counter);
+
+    llvm::Module &M;
+    std::string Kind;
+    std::vector<std::string> CounterNames;
+    std::vector<std::string> Sites;
+    // Stands in for the counter array until its size is known.
+    llvm::GlobalVariable *Placeholder;
+    // Per-thread mode: returns the calling thread's counters. Its body needs
+    // the site table, so finish() fills it in.
+    llvm::Function *ThreadCountersFn = nullptr;
+};
+
+// Counters read back from a profile the runtime wrote: site name to counter
+// name to value. Lines for the same site are summed (max_* counters take the
+// maximum), so several runs appended to one profile add up.
+using SiteProfile = llvm::StringMap<llvm::StringMap<uint64_t>>;
+
+// Reads the sites of one kind recorded for the module built from SourceFile,
+// as named by Module::getSourceFileName().
+llvm::Expected<SiteProfile> readSiteProfile(llvm::StringRef Path, llvm::StringRef Kind,
+                                            llvm::StringRef SourceFile);
+
+} // namespace skeleton
+
+#endif // SKELETON_INSTRUMENTATION_H
@@ -0,0 +1,351 @@
+#include "Locks.h"
+#include "Analyses.h"
+#include "Instrumentation.h"
+#include "Profile.h"
+#include "Report.h"
+#include "Transforms.h"
+
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Demangle/Demangle.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// The pieces of a demangled C++ function name that classification needs.
+struct CxxName {
+    std::string Full;    // "std::unique_lock<std::mutex>::unique_lock(std::mutex&)"
+    std::string Context; // "std::unique_lock<std::mutex>", inline namespaces dropped
+    std::string Base;    // "unique_lock"
+    std::string Params;  // "(std::mutex&)"
+    unsigned NumParams = 0;
+};
+
+std::string takeString(char *S) {
+    std::string Result = S ? S : "";
+    std::free(S);
+    return Result;
+}
+
+// Drops libc++'s and libstdc++'s inline namespaces, so that both spell
+// std::mutex the same way.
+std::string dropInlineNamespaces(std::string S) {
+    for (const char *NS : {"__1::", "__cxx11::"})
+        for (size_t Pos; (Pos = S.find(NS)) != std::string::npos;)
+            S.erase(Pos, std::strlen(NS));
+    return S;
+}
+
+// "(std::mutex&, std::defer_lock_t)" has two parameters.
+unsigned countParams(StringRef Params) {
+    Params = Params.trim("()");
+    if (Params.empty())
+        return 0;
+    unsigned Count = 1, Depth = 0;
+    for (char C : Params) {
+        if (C == '<' || C == '(')
+            ++Depth;
+        else if (C == '>' || C == ')')
+            --Depth;
+        else if (C == ',' && !Depth)
+            ++Count;
+    }
+    return Count;
+}
+
+std::optional<CxxName> demangleFunction(StringRef Symbol) {
+    if (!Symbol.starts_with("_Z"))
+        return std::nullopt;
+    ItaniumPartialDemangler D;
+    std::string Mangled = Symbol.str();
+    if (D.partialDemangle(Mangled.c_str()) || !D.isFunction())
+        return std::nullopt;
+    size_t N = 0;
+    CxxName Name;
+    Name.Full = takeString(D.finishDemangle(nullptr, &N));
+    Name.Context = dropInlineNamespaces(takeString(D.getFunctionDeclContextName(nullptr, &N)));
+    Name.Base = takeString(D.getFunctionBaseName(nullptr, &N));
+    Name.Params = takeString(D.getFunctionParameters(nullptr, &N));
+    Name.NumParams = countParams(Name.Params);
+    return Name;
+}
+
+// "std::unique_lock<std::mutex>" -> "unique_lock", for std:: classes only.
+StringRef stdClassName(StringRef Context) {
+    if (!Context.consume_front("std::"))
+        return "";
+    StringRef Class = Context.take_until([](char C) { return C == '<'; });
+    return Class.contains("::") ? "" : Class;
+}
+
+LockKind classifyC(StringRef Name) {
+    LockKind K = StringSwitch<LockKind>(Name)
+                     .Cases("pthread_mutex_lock", "mtx_lock", LockKind::Mutex)
+                     .Cases("pthread_mutex_trylock", "pthread_mutex_timedlock",
+                            "pthread_mutex_clocklock", "mtx_trylock", "mtx_timedlock",
+                            LockKind::TryLock)
+                     .Case("pthread_rwlock_rdlock", LockKind::Read)
+                     .Case("pthread_rwlock_wrlock", LockKind::Write)
+                     .Cases("pthread_rwlock_tryrdlock", "pthread_rwlock_trywrlock",
+                            "pthread_rwlock_timedrdlock", "pthread_rwlock_timedwrlock",
+                            "pthread_rwlock_clockrdlock", "pthread_rwlock_clockwrlock",
+                            LockKind::TryLock)
+                     .Case("pthread_spin_trylock", LockKind::TryLock)
+                     .Cases("pthread_cond_wait", "pthread_cond_timedwait",
+                            "pthread_cond_clockwait", "cnd_wait", "cnd_timedwait",
+                            LockKind::CondWait)
+                     .Default(LockKind::None);
+    // pthread_spin_lock, and hand-rolled raw_spin_lock()-style functions.
+    if (K == LockKind::None && Name.ends_with("spin_lock"))
+        K = LockKind::Spin;
+    return K;
+}
+
+LockKind classifyCxx(const CxxName &Name) {
+    StringRef Class = stdClassName(Name.Context);
+    StringRef Base = Name.Base;
+    bool TryLock = Base.starts_with("try_lock");
+    if (Class.empty()) {
+        if (Name.Context == "std" && (Base == "lock" || Base == "try_lock"))
+            return TryLock ? LockKind::TryLock : LockKind::Mutex;
+        // tbb::spin_mutex::lock() and the like.
+        if (Base == "lock" && StringRef(Name.Context).contains("spin"))
+            return LockKind::Spin;
+        return LockKind::None;
+    }
+
+    if (Class == "mutex" || Class == "recursive_mutex" || Class == "timed_mutex" ||
+        Class == "recursive_timed_mutex") {
+        if (Base == "lock")
+            return LockKind::Mutex;
+        return TryLock ? LockKind::TryLock : LockKind::None;
+    }
+    if (Class == "shared_mutex" || Class == "shared_timed_mutex") {
+        if (Base == "lock")
+            return LockKind::Write;
+        if (Base == "lock_shared")
+            return LockKind::Read;
+        return TryLock || Base.starts_with("try_lock_shared") ? LockKind::TryLock
+                                                              : LockKind::None;
+    }
+    if (Class == "condition_variable" || Class == "condition_variable_any")
+        return Base.starts_with("wait") ? LockKind::CondWait : LockKind::None;
+
+    // RAII wrappers. lock_guard, unique_lock and shared_lock only acquire when
+    // constructed from the mutex alone; the tag-taking constructors defer,
+    // adopt or try. scoped_lock takes any number of mutexes, after an
+    // adopt_lock_t if it adopts them.
+    bool Shared = Class == "shared_lock";
+    if (Class == "lock_guard")
+        return Base == Class && Name.NumParams == 1 ? LockKind::Mutex : LockKind::None;
+    if (Class == "scoped_lock")
+        return Base == Class && Name.NumParams &&
+                       !StringRef(Name.Params).contains("adopt_lock_t")
+                   ? LockKind::Mutex
+                   : LockKind::None;
+    if (Class == "unique_lock" || Shared) {
+        if (Base == "lock" || (Base == Class && Name.NumParams == 1))
+            return Shared ? LockKind::Read : LockKind::Mutex;
+        return TryLock ? LockKind::TryLock : LockKind::None;
+    }
+    return LockKind::None;
+}
+
+struct LockSite {
+    CallBase *Call;
+    LockPrimitive Lock;
+    unsigned LoopDepth = 0;
+    double Executions = 0;
+};
+
+// Direct calls to lock primitives from outside lock implementations.
+std::vector<LockSite> findLockSites(Module &M) {
+    std::vector<LockSite> Sites;
+    for (Function &F : M) {
+        if (F.isDeclaration() || isLockImplementation(F))
+            continue;
+        for (Instruction &I : instructions(F)) {
+            auto *CB = dyn_cast<CallBase>(&I);
+            Function *Callee = CB && !isa<CallBrInst>(CB) ? CB->getCalledFunction() : nullptr;
+            if (!Callee)
+                continue;
+            if (LockPrimitive Lock = classifyLockFunction(*Callee))
+                Sites.push_back({CB, std::move(Lock)});
+        }
+    }
+    return Sites;
+}
+
+} // namespace
+
+StringRef lockKindName(LockKind K) {
+    switch (K) {
+    case LockKind::None:
+        return "none";
+    case LockKind::Mutex:
+        return "mutex";
+    case LockKind::Read:
+        return "read";
+    case LockKind::Write:
+        return "write";
+    case LockKind::TryLock:
+        return "trylock";
+    case LockKind::Spin:
+        return "spin";
+    case LockKind::CondWait:
+        return "condvar_wait";
+    }
+    llvm_unreachable("unknown lock kind");
+}
+
+LockPrimitive classifyLockFunction(const Function &F) {
+    LockPrimitive P;
+    if (std::optional<CxxName> Name = demangleFunction(F.getName())) {
+        P.Kind = classifyCxx(*Name);
+        P.Name = Name->Full;
+        P.Returns = Name->Context == "std" && Name->Base == "try_lock"
+                        ? LockPrimitive::FailedIndex
+                        : LockPrimitive::Acquired;
+    } else {
+        P.Kind = classifyC(F.getName());
+        P.Name = F.getName().str();
+    }
+    return P;
+}
+
+bool isLockImplementation(const Function &F) {
+    if (F.getName().starts_with("__gthread_"))
+        return true;
+    std::optional<CxxName> Name = demangleFunction(F.getName());
+    if (!Name)
+        return classifyC(F.getName()) != LockKind::None;
+    // Besides the primitives, members of the lock classes that are not
+    // primitives themselves, such as condition_variable::wait(lock, pred) or
+    // unique_lock::~unique_lock().
+    StringRef Class = stdClassName(Name->Context);
+    return classifyCxx(*Name) != LockKind::None || Class.ends_with("mutex") ||
+           Class.ends_with("_lock") || Class == "lock_guard" ||
+           Class.starts_with("condition_variable");
+}
+
+void reportLockSites(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI, Report &R) {
+    std::vector<LockSite> Sites = findLockSites(M);
+    if (Sites.empty())
+        return;
+
+    unsigned InLoops = 0;
+    Function *Current = nullptr;
+    LoopInfo *LI = nullptr;
+    std::optional<FunctionProfile> Prof;
+    for (LockSite &S : Sites) {
+        BasicBlock *BB = S.Call->getParent();
+        if (BB->getParent() != Current) {
+            Current = BB->getParent();
+            LI = &FAM.getResult<LoopAnalysis>(*Current);
+            Prof.emplace(*Current, PSI, FAM.getResult<BlockFrequencyAnalysis>(*Current));
+        }
+        S.LoopDepth = LI->getLoopDepth(BB);
+        S.Executions = Prof->blockCount(*BB);
+        InLoops += S.LoopDepth && S.Lock.Kind != LockKind::CondWait;
+    }
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🔒 Lock Sites (" << Sites.size() << " sites, " << InLoops
+                   << " acquired in loops; kind, callee, estimated executions"
+                   << (PerCall ? " per call" : "") << ")\n";
+
+    for (const LockSite &S : Sites) {
+        if (!R.withinBudget())
+            return;
+        // Waiting on a condition variable in a loop is the normal predicate
+        // check; taking a lock on every iteration is worth a look.
+        bool Flag = S.LoopDepth && S.Lock.Kind != LockKind::CondWait;
+        if (!R.isText()) {
+            R.record("lock_site", [&](json::OStream &J) {
+                J.attribute("site", siteName(*S.Call));
+                J.attribute("kind", lockKindName(S.Lock.Kind));
+                J.attribute("callee", S.Lock.Name);
+                J.attribute("loop_depth", S.LoopDepth);
+                J.attribute("executions", S.Executions);
+                J.attribute("acquired_in_loop", Flag);
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   • " << siteName(*S.Call) << "  " << lockKindName(S.Lock.Kind) << "  "
+           << S.Lock.Name << "  [loop depth " << S.LoopDepth << ", "
+           << format("%.1f", S.Executions) << " executions]";
+        if (Flag)
+            OS << "  ⚠️  acquired in loop";
+        OS << "\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+bool instrumentLocks(Module &M, Report &R) {
+    std::vector<LockSite> Sites = findLockSites(M);
+
+    enum { Calls, WaitNs, MaxWaitNs, Failures };
+    SiteCounters Counters(M, "lock", {"calls", "wait_ns", "max_wait_ns", "failures"},
+                          /*PerThread=*/true);
+    for (const LockSite &S : Sites)
+        Counters.addSite(siteName(*S.Call) + " " + lockKindName(S.Lock.Kind) + " " + S.Lock.Name);
+
+    LLVMContext &Ctx = M.getContext();
+    FunctionCallee Now =
+        M.getOrInsertFunction("__skeleton_now", FunctionType::get(Type::getInt64Ty(Ctx), false));
+    for (unsigned Site = 0; Site != Sites.size(); ++Site) {
+        CallBase *Call = Sites[Site].Call;
+        IRBuilder<> B(Call);
+        Value *Start = B.CreateCall(Now, {}, "lock.start");
+
+        // An invoke's result is only available on its normal edge.
+        if (auto *Invoke = dyn_cast<InvokeInst>(Call))
+            B.SetInsertPoint(&*SplitEdge(Invoke->getParent(), Invoke->getNormalDest())
+                                   ->getFirstInsertionPt());
+        else
+            B.SetInsertPoint(Call->getNextNode());
+        Value *Wait = B.CreateSub(B.CreateCall(Now, {}, "lock.end"), Start, "lock.wait");
+
+        Value *Base = Counters.threadCounters(B);
+        Counters.add(B, Base, Site, Calls, B.getInt64(1));
+        Counters.add(B, Base, Site, WaitNs, Wait);
+        Counters.max(B, Base, Site, MaxWaitNs, Wait);
+        if (Sites[Site].Lock.Kind == LockKind::TryLock && Call->getType()->isIntegerTy()) {
+            Value *Failed;
+            switch (Sites[Site].Lock.Returns) {
+            case LockPrimitive::ErrorCode:
+                Failed = B.CreateIsNotNull(Call);
+                break;
+            case LockPrimitive::Acquired:
+                Failed = B.CreateIsNull(Call);
+                break;
+            case LockPrimitive::FailedIndex:
+                Failed = B.CreateICmpNE(Call, Constant::getAllOnesValue(Call->getType()));
+                break;
+            }
+            Counters.add(B, Base, Site, Failures, B.CreateZExt(Failed, B.getInt64Ty()));
+        }
+    }
+    Counters.finish();
+    reportInstrumentation(R, "lock", Sites.size());
+    return !Sites.empty();
+}
+
+} // namespace skeleton
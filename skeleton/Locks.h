@@ -0,0 +1,52 @@
+#ifndef SKELETON_LOCKS_H
+#define SKELETON_LOCKS_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace llvm {
+class Function;
+} // namespace llvm
+
+namespace skeleton {
+
+// What a call to a lock primitive does to the calling thread.
+enum class LockKind {
+    None,
+    Mutex,    // blocks until the lock is held exclusively
+    Read,     // blocks until the lock is held shared
+    Write,    // blocks until an rwlock is held exclusively
+    TryLock,  // returns at once (or after a timeout) whether the lock was taken
+    Spin,     // busy-waits until the lock is held
+    CondWait, // releases a mutex and blocks until notified
+};
+
+llvm::StringRef lockKindName(LockKind K);
+
+// A recognized lock primitive: pthread_mutex_*, pthread_rwlock_*,
+// pthread_spin_*, pthread_cond_*wait, the C11 mtx_*/cnd_* functions, and the
+// demangled C++ std::mutex family, std::shared_mutex, std::condition_variable
+// and the RAII lock constructors that acquire on construction.
+struct LockPrimitive {
+    LockKind Kind = LockKind::None;
+    // Demangled name of the callee, or its symbol for C functions.
+    std::string Name;
+    // What the callee returns, for telling failed try-locks apart: a C error
+    // code (0 on success), the C++ bool "acquired", or, for std::try_lock,
+    // -1 on success and the index of the lock it could not take otherwise.
+    enum { ErrorCode, Acquired, FailedIndex } Returns = ErrorCode;
+
+    explicit operator bool() const { return Kind != LockKind::None; }
+};
+
+LockPrimitive classifyLockFunction(const llvm::Function &F);
+
+// Whether F is part of a lock implementation (a primitive itself, or a
+// libstdc++/libc++ helper such as __gthread_mutex_lock), whose own calls to
+// lock primitives are counted at the caller instead.
+bool isLockImplementation(const llvm::Function &F);
+
+} // namespace skeleton
+
+#endif // SKELETON_LOCKS_H
@@ -0,0 +1,424 @@
+#include "Profile.h"
+#include "Report.h"
+#include "TargetCompare.h"
+#include "Transforms.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/GlobalIFunc.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <optional>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// The x86-64 micro-architecture levels the resolver can detect, and the
+// features each one adds over the level below.
+struct Level {
+    unsigned Number;
+    StringLiteral CPU;
+    StringLiteral Features;
+};
+
+constexpr Level Levels[] = {
+    {2, "x86-64-v2", "+cx16,+popcnt,+sahf,+sse3,+sse4.1,+sse4.2,+ssse3"},
+    {3, "x86-64-v3", "+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe,+xsave"},
+    {4, "x86-64-v4", "+avx512bw,+avx512cd,+avx512dq,+avx512f,+avx512vl"},
+};
+
+// The x86-64 baseline every level builds on.
+constexpr StringLiteral BaseFeatures = "+cmov,+cx8,+fxsr,+mmx,+sse,+sse2";
+
+// Everything a clone for L needs: the baseline and every level up to L.
+std::string levelFeatures(const Level &L) {
+    std::string Features = BaseFeatures.str();
+    for (const Level &Lower : Levels)
+        if (Lower.Number <= L.Number)
+            Features += ("," + Lower.Features).str();
+    return Features;
+}
+
+// A feature L needs that F's own target-features turn off, where the last
+// mention of a feature wins, or an empty string.
+std::string disabledFeature(const Function &F, const Level &L) {
+    Attribute Attr = F.getFnAttribute("target-features");
+    if (!Attr.isValid())
+        return "";
+    StringMap<bool> Enabled;
+    SmallVector<StringRef, 32> Own;
+    Attr.getValueAsString().split(Own, ',', -1, /*KeepEmpty=*/false);
+    for (StringRef Feature : Own)
+        Enabled[Feature.drop_front()] = Feature.front() == '+';
+    SmallVector<StringRef, 32> Needed;
+    std::string Features = levelFeatures(L);
+    StringRef(Features).split(Needed, ',');
+    for (StringRef Feature : Needed) {
+        auto It = Enabled.find(Feature.drop_front());
+        if (It != Enabled.end() && !It->second)
+            return Feature.drop_front().str();
+    }
+    return "";
+}
+
+const Level *findLevel(StringRef CPU) {
+    for (const Level &L : Levels)
+        if (L.CPU == CPU)
+            return &L;
+    return nullptr;
+}
+
+// The highest level whose features F's own CPU and features already have.
+unsigned ownLevel(const Function &F, const Target &T, const Triple &TT) {
+    Attribute CPU = F.getFnAttribute("target-cpu");
+    Attribute Features = F.getFnAttribute("target-features");
+    std::unique_ptr<MCSubtargetInfo> STI(T.createMCSubtargetInfo(
+        TT.str(), CPU.isValid() ? CPU.getValueAsString() : "x86-64",
+        Features.isValid() ? Features.getValueAsString() : ""));
+    unsigned Own = 1;
+    for (const Level &L : Levels) {
+        if (!STI->checkFeatures(L.Features))
+            break;
+        Own = L.Number;
+    }
+    return Own;
+}
+
+// Returns the level of the running CPU, 1 to 4, from cpuid and xgetbv, in a
+// helper shared by every resolver. Leaves beyond the CPU's maximum read as
+// zero, and xgetbv only runs when the OS has enabled it.
+Function *getLevelFunction(Module &M) {
+    constexpr StringLiteral Name = "skeleton.x86_64_level";
+    if (Function *F = M.getFunction(Name))
+        return F;
+    LLVMContext &Ctx = M.getContext();
+    Type *I32 = Type::getInt32Ty(Ctx);
+    Function *F = Function::Create(FunctionType::get(I32, false),
+                                   GlobalValue::LinkOnceODRLinkage, Name, M);
+    F->setVisibility(GlobalValue::HiddenVisibility);
+    F->addFnAttr(Attribute::NoUnwind);
+
+    auto *CPUID = InlineAsm::get(
+        FunctionType::get(StructType::get(I32, I32, I32, I32), {I32, I32}, false), "cpuid",
+        "={ax},={bx},={cx},={dx},{ax},{cx},~{dirflag},~{fpsr},~{flags}",
+        /*hasSideEffects=*/false);
+    auto *XGETBV = InlineAsm::get(FunctionType::get(StructType::get(I32, I32), {I32}, false),
+                                  "xgetbv", "={ax},={dx},{cx},~{dirflag},~{fpsr},~{flags}",
+                                  /*hasSideEffects=*/true);
+    auto *Entry = BasicBlock::Create(Ctx, "entry", F);
+    auto *Leaf7 = BasicBlock::Create(Ctx, "leaf7", F);
+    auto *Ext = BasicBlock::Create(Ctx, "ext", F);
+    auto *ExtLeaf = BasicBlock::Create(Ctx, "ext.leaf", F);
+    auto *XSave = BasicBlock::Create(Ctx, "xsave", F);
+    auto *XGetBV = BasicBlock::Create(Ctx, "xgetbv", F);
+    auto *Done = BasicBlock::Create(Ctx, "levels", F);
+    IRBuilder<> B(Entry);
+    auto Leaf = [&](uint32_t N, unsigned Reg) {
+        return B.CreateExtractValue(B.CreateCall(CPUID, {B.getInt32(N), B.getInt32(0)}), Reg);
+    };
+
+    Value *MaxLeaf = Leaf(0, 0);
+    Value *ECX1 = Leaf(1, 2);
+    B.CreateCondBr(B.CreateICmpUGE(MaxLeaf, B.getInt32(7)), Leaf7, Ext);
+    B.SetInsertPoint(Leaf7);
+    Value *EBX7Leaf = Leaf(7, 1);
+    B.CreateBr(Ext);
+
+    B.SetInsertPoint(Ext);
+    PHINode *EBX7 = B.CreatePHI(I32, 2, "ebx7");
+    EBX7->addIncoming(B.getInt32(0), Entry);
+    EBX7->addIncoming(EBX7Leaf, Leaf7);
+    B.CreateCondBr(B.CreateICmpUGE(Leaf(0x80000000, 0), B.getInt32(0x80000001)), ExtLeaf,
+                   XSave);
+    B.SetInsertPoint(ExtLeaf);
+    Value *ECXExtLeaf = Leaf(0x80000001, 2);
+    B.CreateBr(XSave);
+
+    B.SetInsertPoint(XSave);
+    PHINode *ECXExt = B.CreatePHI(I32, 2, "ecx.ext");
+    ECXExt->addIncoming(B.getInt32(0), Ext);
+    ECXExt->addIncoming(ECXExtLeaf, ExtLeaf);
+    B.CreateCondBr(B.CreateIsNotNull(B.CreateAnd(ECX1, 1u << 27)), XGetBV, Done);
+    B.SetInsertPoint(XGetBV);
+    Value *XCR0Read = B.CreateExtractValue(B.CreateCall(XGETBV, {B.getInt32(0)}), 0);
+    B.CreateBr(Done);
+
+    B.SetInsertPoint(Done);
+    PHINode *XCR0 = B.CreatePHI(I32, 2, "xcr0");
+    XCR0->addIncoming(B.getInt32(0), XSave);
+    XCR0->addIncoming(XCR0Read, XGetBV);
+    auto Has = [&](Value *Reg, uint32_t Mask) {
+        return B.CreateICmpEQ(B.CreateAnd(Reg, Mask), B.getInt32(Mask));
+    };
+    // CPUID.1:ECX SSE3, SSSE3, CX16, SSE4.1, SSE4.2, POPCNT; 80000001H:ECX LAHF.
+    Value *V2 = B.CreateAnd(Has(ECX1, 0x00982201), Has(ECXExt, 1u << 0));
+    // CPUID.1:ECX FMA, MOVBE, OSXSAVE, AVX, F16C; 7:EBX BMI1, AVX2, BMI2;
+    // 80000001H:ECX LZCNT; XCR0 SSE and AVX state.
+    Value *V3 = B.CreateAnd({V2, Has(ECX1, 0x38401000), Has(EBX7, 0x00000128),
+                             Has(ECXExt, 1u << 5), Has(XCR0, 0x06)});
+    // 7:EBX AVX512F, DQ, CD, BW, VL; XCR0 opmask and ZMM state.
+    Value *V4 = B.CreateAnd({V3, Has(EBX7, 0xD0030000), Has(XCR0, 0xE6)});
+    Value *Result = B.getInt32(1);
+    for (Value *V : {V2, V3, V4})
+        Result = B.CreateAdd(Result, B.CreateZExt(V, I32));
+    B.CreateRet(Result);
+    return F;
+}
+
+// What the transform decided for one function.
+struct Decision {
+    Function *F;
+    std::string Name;
+    std::string Reason; // empty when cloned
+    std::vector<std::pair<const Level *, std::optional<double>>> Clones; // with gain
+};
+
+std::string unsupportedReason(const Function &F) {
+    if (F.isDeclaration())
+        return "not defined in this module";
+    if (F.hasComdat() || !(F.hasExternalLinkage() || F.hasLocalLinkage()))
+        return "linkage other than external or internal";
+    if (F.hasFnAttribute(Attribute::Naked))
+        return "naked function";
+    return "";
+}
+
+// Replaces F by an ifunc named like it. F becomes the internal default and
+// the resolver returns the clone of the highest level the CPU supports.
+void dispatch(Function &F, ArrayRef<std::pair<const Level *, Function *>> Clones) {
+    Module &M = *F.getParent();
+    std::string Name = F.getName().str();
+    GlobalValue::LinkageTypes Linkage = F.getLinkage();
+    GlobalValue::VisibilityTypes Visibility = F.getVisibility();
+    F.setName(Name + ".default");
+    F.setLinkage(GlobalValue::InternalLinkage);
+    F.setVisibility(GlobalValue::DefaultVisibility);
+
+    auto *PtrTy = PointerType::getUnqual(M.getContext());
+    Function *Resolver = Function::Create(FunctionType::get(PtrTy, false),
+                                          GlobalValue::InternalLinkage, Name + ".resolver", M);
+    GlobalIFunc *IFunc = GlobalIFunc::create(F.getValueType(), F.getAddressSpace(), Linkage,
+                                             Name, Resolver, &M);
+    IFunc->setVisibility(Visibility);
+    // Every use so far, recursive calls in the clones included, goes through
+    // the ifunc; only the resolver refers to F itself.
+    F.replaceAllUsesWith(IFunc);
+
+    IRBuilder<> B(BasicBlock::Create(M.getContext(), "entry", Resolver));
+    Value *CPULevel = B.CreateCall(getLevelFunction(M));
+    Value *Chosen = &F;
+    for (const auto &[L, Clone] : Clones)
+        Chosen = B.CreateSelect(B.CreateICmpUGE(CPULevel, B.getInt32(L->Number)), Clone, Chosen);
+    B.CreateRet(Chosen);
+}
+
+} // namespace
+
+bool multiversionFunctions(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                           Report &R, ArrayRef<std::string> Functions,
+                           ArrayRef<std::string> CPUs, double MinGain) {
+    if (Functions.empty())
+        return false;
+    // Earlier transforms may have rewritten any function; auto mode's cost
+    // estimates read its loops and block frequencies.
+    for (Function &F : M)
+        if (!F.isDeclaration())
+            FAM.invalidate(F, PreservedAnalyses::none());
+    std::vector<const Level *> Targets;
+    for (const std::string &CPU : CPUs) {
+        if (const Level *L = findLevel(CPU))
+            Targets.push_back(L);
+        else
+            WithColor::warning() << "skeleton: cannot dispatch on CPU '" << CPU
+                                 << "'; multiversioning supports x86-64-v2, v3 and v4\n";
+    }
+    llvm::sort(Targets, [](const Level *A, const Level *B) { return A->Number < B->Number; });
+    Targets.erase(std::unique(Targets.begin(), Targets.end()), Targets.end());
+
+    Triple TT(M.getTargetTriple());
+    std::string Error;
+    const Target *T = TargetRegistry::lookupTarget(TT.str(), Error);
+    std::string ModuleReason;
+    if (TT.getArch() != Triple::x86_64 || !TT.isOSBinFormatELF() || !T)
+        ModuleReason = "ifuncs need an x86-64 ELF target";
+    else if (Targets.empty())
+        ModuleReason = "no x86-64 level to clone for";
+
+    // Auto mode takes the candidates of the target comparison: every level
+    // that makes the function at least MinGain cheaper than its own CPU.
+    bool Auto = Functions.size() == 1 && Functions.front() == "auto";
+    std::vector<Function *> Selected;
+    if (Auto) {
+        for (Function &F : M)
+            if (!F.isDeclaration() && !F.getName().starts_with("skeleton."))
+                Selected.push_back(&F);
+    } else {
+        for (const std::string &Name : Functions)
+            if (Function *F = M.getFunction(Name))
+                Selected.push_back(F);
+            else
+                WithColor::warning() << "skeleton: no function '" << Name
+                                     << "' to multiversion in " << M.getSourceFileName() << "\n";
+    }
+
+    StringMap<std::unique_ptr<TargetMachine>> Machines;
+    auto machine = [&](StringRef CPU) -> TargetMachine * {
+        auto &TM = Machines[CPU];
+        if (!TM) {
+            auto Created = createTargetMachines(M, {CPU.str()});
+            if (!Created) {
+                consumeError(Created.takeError());
+                return nullptr;
+            }
+            TM = std::move(Created->front());
+        }
+        return TM.get();
+    };
+
+    // Decide everything before the first clone changes the module.
+    std::vector<Decision> Decisions;
+    for (Function *F : Selected) {
+        Decision D{F, F->getName().str(), ModuleReason.empty() ? unsupportedReason(*F)
+                                                               : ModuleReason};
+        if (D.Reason.empty()) {
+            unsigned Own = ownLevel(*F, *T, TT);
+            // A function built with a level's feature turned off (say
+            // -mno-avx) does not get that level's clone, nor any above.
+            std::vector<const Level *> Usable;
+            std::string Disabled;
+            for (const Level *L : Targets) {
+                if (L->Number <= Own)
+                    continue;
+                std::string Feature = disabledFeature(*F, *L);
+                if (!Feature.empty()) {
+                    Disabled = "target-features disable " + Feature + ", needed by " +
+                               L->CPU.str();
+                    break;
+                }
+                Usable.push_back(L);
+            }
+            std::optional<TargetCost> Baseline;
+            if (Auto) {
+                Attribute CPU = F->getFnAttribute("target-cpu");
+                if (TargetMachine *TM = machine(CPU.isValid() ? CPU.getValueAsString() : "x86-64")) {
+                    FunctionProfile Prof(*F, PSI, FAM.getResult<BlockFrequencyAnalysis>(*F));
+                    const LoopInfo &LI = FAM.getResult<LoopAnalysis>(*F);
+                    Baseline = estimateTargetCost(*F, *TM, Prof, LI);
+                    // A level earns a clone only if it beats the one below.
+                    double Cheapest = Baseline->Throughput;
+                    for (const Level *L : Usable) {
+                        if (!Baseline->Throughput)
+                            continue;
+                        TargetMachine *LevelTM = machine(L->CPU);
+                        if (!LevelTM)
+                            continue;
+                        TargetCost TC = estimateTargetCost(*F, *LevelTM, Prof, LI);
+                        double Gain = 1 - TC.Throughput / Baseline->Throughput;
+                        if (Gain >= MinGain && TC.Throughput < Cheapest) {
+                            D.Clones.emplace_back(L, Gain);
+                            Cheapest = TC.Throughput;
+                        }
+                    }
+                }
+                if (D.Clones.empty() && Disabled.empty())
+                    continue; // not a candidate: nothing to report
+            } else {
+                for (const Level *L : Usable)
+                    D.Clones.emplace_back(L, std::nullopt);
+            }
+            if (D.Clones.empty())
+                D.Reason = !Disabled.empty()
+                               ? Disabled
+                               : "already built for x86-64-v" + std::to_string(Own);
+        }
+        Decisions.push_back(std::move(D));
+    }
+
+    bool Changed = false;
+    for (const Decision &D : Decisions) {
+        if (!D.Reason.empty())
+            continue;
+        SmallVector<std::pair<const Level *, Function *>, 3> Clones;
+        for (const auto &[L, Gain] : D.Clones) {
+            ValueToValueMapTy VMap;
+            Function *Clone = CloneFunction(D.F, VMap);
+            Clone->setName(D.Name + "." + L->CPU.str());
+            Clone->setLinkage(GlobalValue::InternalLinkage);
+            Clone->setVisibility(GlobalValue::DefaultVisibility);
+            Clone->removeFnAttr("tune-cpu");
+            Clone->addFnAttr("target-cpu", L->CPU);
+            // The function's own features would otherwise cap the clone at
+            // the CPU the module was built for.
+            Attribute Own = D.F->getFnAttribute("target-features");
+            std::string Features = levelFeatures(*L);
+            if (Own.isValid() && !Own.getValueAsString().empty())
+                Features = (Own.getValueAsString() + "," + Features).str();
+            Clone->addFnAttr("target-features", Features);
+            Clones.emplace_back(L, Clone);
+        }
+        dispatch(*D.F, Clones);
+        Changed = true;
+    }
+
+    bool HeaderDone = false;
+    for (const Decision &D : Decisions) {
+        if (!R.withinBudget())
+            break;
+        if (!R.isText()) {
+            R.record("multiversion", [&](json::OStream &J) {
+                J.attribute("function", D.Name);
+                J.attribute("cloned", D.Reason.empty());
+                if (!D.Reason.empty())
+                    J.attribute("reason", D.Reason);
+                J.attributeArray("clones", [&] {
+                    if (D.Reason.empty())
+                        for (const auto &[L, Gain] : D.Clones)
+                            J.object([&] {
+                                J.attribute("cpu", L->CPU);
+                                J.attribute("name", D.Name + "." + L->CPU.str());
+                                if (Gain)
+                                    J.attribute("gain", *Gain);
+                            });
+                });
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        if (!HeaderDone) {
+            OS << "🔀 Function Multiversioning (x86-64 level clones behind an ifunc)\n";
+            HeaderDone = true;
+        }
+        OS << "   • " << D.Name;
+        if (!D.Reason.empty()) {
+            OS << "; kept: " << D.Reason << "\n";
+            continue;
+        }
+        OS << "; cloned for ";
+        ListSeparator LS(", ");
+        for (const auto &[L, Gain] : D.Clones) {
+            OS << LS << L->CPU;
+            if (Gain)
+                OS << " (" << format("%.0f", *Gain * 100) << "% cheaper)";
+        }
+        OS << "; dispatched by " << D.Name << ".resolver\n";
+    }
+    if (HeaderDone)
+        R.stream() << "\n";
+    return Changed;
+}
+
+} // namespace skeleton
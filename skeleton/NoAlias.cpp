@@ -0,0 +1,401 @@
+#include "Analyses.h"
+#include "Instrumentation.h"
+#include "Profile.h"
+#include "Report.h"
+#include "Transforms.h"
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+enum class ArgStatus {
+    Provable, // noalias holds at every call, and all of them are visible
+    Distinct, // the visible calls pass non-aliasing pointers, but that is all
+    MayAlias, // some call passes pointers that may alias
+};
+
+StringRef statusName(ArgStatus S) {
+    switch (S) {
+    case ArgStatus::Provable: return "provable";
+    case ArgStatus::Distinct: return "distinct";
+    case ArgStatus::MayAlias: return "may_alias";
+    }
+    llvm_unreachable("unknown argument status");
+}
+
+struct ArgInfo {
+    Argument *Arg;
+    ArgStatus Status = ArgStatus::Provable;
+    std::string Reason; // why it is not provable
+};
+
+// A loop in which every pair of accesses that may alias involves a pointer
+// argument without noalias and a distinct object.
+struct LoopBenefit {
+    Loop *L;
+    unsigned Pairs = 0;
+    SmallSetVector<Argument *, 4> Args; // the arguments those pairs go through
+    unsigned Hoistable = 0;             // loop-invariant accesses among them
+    bool Vectorizable = false;          // innermost, with affine accesses only
+    double Executions;
+    Hotness Hot;
+};
+
+struct FunctionNoAlias {
+    Function *F;
+    SmallVector<ArgInfo, 4> Args;
+    SmallVector<LoopBenefit, 2> Loops;
+};
+
+std::string operandName(const Value *V) {
+    std::string S;
+    raw_string_ostream OS(S);
+    V->printAsOperand(OS, /*PrintType=*/false);
+    return S;
+}
+
+bool isCandidate(const Argument &A) {
+    return A.getType()->isPointerTy() && !A.hasNoAliasAttr() && !A.hasByValAttr();
+}
+
+MemoryLocation anywhere(const Instruction &I) {
+    return MemoryLocation::getBeforeOrAfter(getLoadStorePointerOperand(&I), I.getAAMetadata());
+}
+
+// Whether noalias on A would hold for every call of its function: all calls
+// are visible and direct, each passes an identified object of the caller (an
+// alloca, a noalias call or argument) not captured before the call and not
+// aliasing the other pointer arguments, and the function does not capture A.
+ArgInfo classifyArgument(Argument &A, FunctionAnalysisManager &FAM) {
+    ArgInfo Info{&A};
+    Function &F = *A.getParent();
+    auto NotProvable = [&](std::string Reason) {
+        if (Info.Reason.empty())
+            Info.Reason = std::move(Reason);
+        if (Info.Status == ArgStatus::Provable)
+            Info.Status = ArgStatus::Distinct;
+    };
+    if (!F.hasLocalLinkage())
+        NotProvable("callers outside the module");
+    if (PointerMayBeCaptured(&A, /*ReturnCaptures=*/false, /*StoreCaptures=*/true))
+        NotProvable(F.getName().str() + " captures it");
+
+    unsigned Calls = 0;
+    for (Use &U : F.uses()) {
+        auto *CB = dyn_cast<CallBase>(U.getUser());
+        if (!CB || !CB->isCallee(&U)) {
+            NotProvable("address taken");
+            continue;
+        }
+        ++Calls;
+        // A call through a mismatched prototype may pass anything, or
+        // nothing, in A's position.
+        if (CB->getFunctionType() != F.getFunctionType()) {
+            Info.Status = ArgStatus::MayAlias;
+            Info.Reason = siteName(*CB) + " calls " + F.getName().str() +
+                          " with a different function type";
+            return Info;
+        }
+        Function &Caller = *CB->getFunction();
+        AAResults &AA = FAM.getResult<AAManager>(Caller);
+        Value *Actual = CB->getArgOperand(A.getArgNo());
+        for (unsigned J = 0; J < CB->arg_size(); ++J) {
+            Value *Other = CB->getArgOperand(J);
+            if (J == A.getArgNo() || !Other->getType()->isPointerTy())
+                continue;
+            if (AA.alias(MemoryLocation::getBeforeOrAfter(Actual),
+                         MemoryLocation::getBeforeOrAfter(Other)) != AliasResult::NoAlias) {
+                Info.Status = ArgStatus::MayAlias;
+                Info.Reason = siteName(*CB) + " passes it a pointer that may alias the one for " +
+                              (J < F.arg_size() ? operandName(F.getArg(J))
+                                                : "variadic argument " + std::to_string(J));
+                return Info;
+            }
+        }
+        const Value *Obj = getUnderlyingObject(Actual);
+        if (!isIdentifiedFunctionLocal(Obj))
+            NotProvable(siteName(*CB) + " passes " + operandName(Obj) +
+                        ", which the callee may reach another way");
+        else if (PointerMayBeCapturedBefore(Obj, /*ReturnCaptures=*/true,
+                                            /*StoreCaptures=*/true, CB,
+                                            &FAM.getResult<DominatorTreeAnalysis>(Caller)))
+            NotProvable(siteName(*CB) + " passes " + operandName(Obj) +
+                        ", captured before the call");
+    }
+    if (!Calls)
+        NotProvable("no calls in the module");
+    return Info;
+}
+
+// Whether noalias on a candidate argument would let AA separate two distinct
+// underlying objects: the other one is another argument, a global or an
+// alloca, or anything at all if the argument does not escape F.
+bool separable(const Value *A, const Value *B) {
+    for (auto [X, Y] : {std::pair(A, B), std::pair(B, A)}) {
+        auto *Arg = dyn_cast<Argument>(X);
+        if (!Arg || !isCandidate(*Arg))
+            continue;
+        if (isa<Argument>(Y) || isa<GlobalValue>(Y) || isa<AllocaInst>(Y) ||
+            !PointerMayBeCaptured(Arg, /*ReturnCaptures=*/false, /*StoreCaptures=*/true))
+            return true;
+    }
+    return false;
+}
+
+bool isAffineIn(ScalarEvolution &SE, Value *Ptr, const Loop *L) {
+    if (L->isLoopInvariant(Ptr))
+        return true;
+    auto *AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(Ptr));
+    return AR && AR->getLoop() == L && AR->isAffine();
+}
+
+// The loops of F that possible aliasing between pointer arguments alone keeps
+// from being optimized.
+SmallVector<LoopBenefit, 2> findLoopBenefits(Function &F, FunctionAnalysisManager &FAM,
+                                             const FunctionProfile &Prof) {
+    SmallVector<LoopBenefit, 2> Benefits;
+    LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+    if (LI.empty())
+        return Benefits;
+    AAResults &AA = FAM.getResult<AAManager>(F);
+    ScalarEvolution &SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+    for (Loop *L : LI.getLoopsInPreorder()) {
+        SmallVector<Instruction *, 16> Accesses;
+        bool Blocked = false;
+        for (BasicBlock *BB : L->blocks())
+            for (Instruction &I : *BB) {
+                if (isa<LoadInst>(I) || isa<StoreInst>(I)) {
+                    if (I.isAtomic() || I.isVolatile())
+                        Blocked = true;
+                    Accesses.push_back(&I);
+                } else if (I.mayWriteToMemory()) {
+                    Blocked = true; // calls and atomics alias on their own
+                }
+            }
+        if (Blocked)
+            continue;
+
+        LoopBenefit B{L};
+        SmallPtrSet<Instruction *, 8> Involved;
+        for (size_t I = 0; I < Accesses.size() && !Blocked; ++I) {
+            for (size_t J = I + 1; J < Accesses.size(); ++J) {
+                Instruction *S = Accesses[I], *X = Accesses[J];
+                if (!isa<StoreInst>(S) && !isa<StoreInst>(X))
+                    continue;
+                if (AA.alias(anywhere(*S), anywhere(*X)) != AliasResult::MayAlias)
+                    continue;
+                const Value *ObjS = getUnderlyingObject(getLoadStorePointerOperand(S));
+                const Value *ObjX = getUnderlyingObject(getLoadStorePointerOperand(X));
+                if (ObjS == ObjX || !separable(ObjS, ObjX)) {
+                    Blocked = true;
+                    break;
+                }
+                ++B.Pairs;
+                for (const Value *Obj : {ObjS, ObjX})
+                    if (auto *A = dyn_cast<Argument>(Obj); A && isCandidate(*A))
+                        B.Args.insert(const_cast<Argument *>(A));
+                Involved.insert(S);
+                Involved.insert(X);
+            }
+        }
+        if (Blocked || !B.Pairs)
+            continue;
+        for (Instruction *I : Involved)
+            if (L->isLoopInvariant(getLoadStorePointerOperand(I)))
+                ++B.Hoistable;
+        B.Vectorizable = L->isInnermost() && llvm::all_of(Accesses, [&](Instruction *I) {
+            return isAffineIn(SE, getLoadStorePointerOperand(I), L);
+        });
+        B.Executions = Prof.blockCount(*L->getHeader());
+        B.Hot = Prof.blockHotness(*L->getHeader());
+        Benefits.push_back(std::move(B));
+    }
+    return Benefits;
+}
+
+std::vector<FunctionNoAlias> analyzeModule(Module &M, FunctionAnalysisManager &FAM,
+                                           ProfileSummaryInfo &PSI) {
+    std::vector<FunctionNoAlias> Result;
+    for (Function &F : M) {
+        if (F.isDeclaration() || llvm::none_of(F.args(), isCandidate))
+            continue;
+        FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+        FunctionNoAlias FN{&F};
+        FN.Loops = findLoopBenefits(F, FAM, Prof);
+        for (Argument &A : F.args())
+            if (isCandidate(A))
+                FN.Args.push_back(classifyArgument(A, FAM));
+        Result.push_back(std::move(FN));
+    }
+    return Result;
+}
+
+double hottestLoop(const FunctionNoAlias &FN) {
+    double Max = 0;
+    for (const LoopBenefit &B : FN.Loops)
+        Max = std::max(Max, B.Executions);
+    return Max;
+}
+
+} // namespace
+
+void reportNoAliasCandidates(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                             Report &R) {
+    std::vector<FunctionNoAlias> Functions = analyzeModule(M, FAM, PSI);
+    llvm::erase_if(Functions, [](const FunctionNoAlias &FN) { return FN.Loops.empty(); });
+    if (Functions.empty())
+        return;
+    llvm::stable_sort(Functions, [](const FunctionNoAlias &A, const FunctionNoAlias &B) {
+        return hottestLoop(A) > hottestLoop(B);
+    });
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🧷 noalias Opportunities (" << Functions.size()
+                   << " functions with loops held back only by possible aliasing of pointer "
+                      "arguments; estimated executions"
+                   << (PerCall ? " per call" : "") << ")\n";
+
+    for (const FunctionNoAlias &FN : Functions) {
+        if (!R.withinBudget())
+            return;
+        if (!R.isText()) {
+            R.record("noalias_candidate", [&](json::OStream &J) {
+                J.attribute("function", FN.F->getName());
+                J.attributeArray("arguments", [&] {
+                    for (const ArgInfo &A : FN.Args)
+                        J.object([&] {
+                            J.attribute("name", operandName(A.Arg));
+                            J.attribute("status", statusName(A.Status));
+                            if (!A.Reason.empty())
+                                J.attribute("reason", A.Reason);
+                        });
+                });
+                J.attributeArray("loops", [&] {
+                    for (const LoopBenefit &B : FN.Loops)
+                        J.object([&] {
+                            J.attribute("header", B.L->getHeader()->getName());
+                            J.attribute("depth", B.L->getLoopDepth());
+                            J.attribute("alias_pairs", B.Pairs);
+                            J.attributeArray("arguments", [&] {
+                                for (Argument *A : B.Args)
+                                    J.value(operandName(A));
+                            });
+                            J.attribute("hoistable", B.Hoistable);
+                            J.attribute("vectorizable", B.Vectorizable);
+                            J.attribute("executions", B.Executions);
+                            J.attribute("hotness", hotnessName(B.Hot));
+                        });
+                });
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   • " << FN.F->getName() << "\n";
+        for (const LoopBenefit &B : FN.Loops) {
+            OS << "      ↳ loop " << B.L->getHeader()->getName() << " (depth "
+               << B.L->getLoopDepth() << ")  " << format("%.1f", B.Executions) << " executions"
+               << (B.Hot == Hotness::Hot ? "  🔥" : "") << ": " << B.Pairs
+               << " may-alias pairs through ";
+            ListSeparator LS(", ");
+            for (Argument *A : B.Args)
+                OS << LS << operandName(A);
+            if (B.Hoistable)
+                OS << "; " << B.Hoistable << " invariant accesses for LICM";
+            if (B.Vectorizable)
+                OS << "; vectorizable without runtime alias checks";
+            OS << "\n";
+        }
+        for (const ArgInfo &A : FN.Args) {
+            OS << "      " << operandName(A.Arg) << ": ";
+            if (A.Status == ArgStatus::Provable)
+                OS << "noalias is provably safe\n";
+            else
+                OS << (A.Status == ArgStatus::MayAlias ? "may alias: " : "not provable: ")
+                   << A.Reason << "\n";
+        }
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+bool addNoAliasArguments(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                         Report &R) {
+    // Earlier transforms may have rewritten any caller. A stale dominator
+    // tree hides captures in new blocks from CaptureTracking, which would
+    // make an unsafe noalias look provable.
+    for (Function &F : M)
+        if (!F.isDeclaration())
+            FAM.invalidate(F, PreservedAnalyses::none());
+    std::vector<FunctionNoAlias> Functions = analyzeModule(M, FAM, PSI);
+    std::vector<std::pair<Argument *, const ArgInfo *>> Decisions;
+    for (const FunctionNoAlias &FN : Functions) {
+        if (!FN.F->hasLocalLinkage())
+            continue;
+        for (const ArgInfo &A : FN.Args) {
+            // Unprovable arguments are only worth mentioning where a loop
+            // is waiting for them.
+            bool Wanted = llvm::any_of(FN.Loops, [&](const LoopBenefit &B) {
+                return B.Args.contains(A.Arg);
+            });
+            if (A.Status == ArgStatus::Provable)
+                A.Arg->addAttr(Attribute::NoAlias);
+            else if (!Wanted)
+                continue;
+            Decisions.emplace_back(A.Arg, &A);
+        }
+    }
+
+    bool Changed = false;
+    bool HeaderDone = false;
+    for (const auto &[Arg, A] : Decisions) {
+        bool Added = A->Status == ArgStatus::Provable;
+        Changed |= Added;
+        if (!R.withinBudget())
+            continue;
+        if (!R.isText()) {
+            R.record("noalias_added", [&](json::OStream &J) {
+                J.attribute("function", Arg->getParent()->getName());
+                J.attribute("argument", operandName(Arg));
+                J.attribute("added", Added);
+                if (!Added)
+                    J.attribute("reason", A->Reason);
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        if (!HeaderDone) {
+            OS << "🧷 noalias Arguments (internal functions, every call checked)\n";
+            HeaderDone = true;
+        }
+        OS << "   • " << Arg->getParent()->getName() << " " << operandName(Arg);
+        if (Added)
+            OS << "; added\n";
+        else
+            OS << "; kept: " << A->Reason << "\n";
+    }
+    if (HeaderDone)
+        R.stream() << "\n";
+    return Changed;
+}
+
+} // namespace skeleton
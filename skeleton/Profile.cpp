@@ -0,0 +1,55 @@
+#include "Profile.h"
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/Function.h"
+
+using namespace llvm;
+
+namespace skeleton {
+
+StringRef hotnessName(Hotness H) {
+    switch (H) {
+    case Hotness::Unknown: return "unknown";
+    case Hotness::Cold: return "cold";
+    case Hotness::Normal: return "normal";
+    case Hotness::Hot: return "hot";
+    }
+    llvm_unreachable("unknown hotness");
+}
+
+FunctionProfile::FunctionProfile(Function &F, ProfileSummaryInfo &PSI, BlockFrequencyInfo &BFI)
+    : PSI(PSI), BFI(BFI) {
+    if (auto Count = F.getEntryCount()) {
+        HasEntryCount = true;
+        EntryCount = Count->getCount();
+    }
+    if (uint64_t Freq = BFI.getBlockFreq(&F.getEntryBlock()).getFrequency())
+        EntryFreq = static_cast<double>(Freq);
+
+    if (!PSI.hasProfileSummary())
+        FnHotness = Hotness::Unknown;
+    else if (PSI.isFunctionHotInCallGraph(&F, BFI))
+        FnHotness = Hotness::Hot;
+    else if (PSI.isFunctionColdInCallGraph(&F, BFI))
+        FnHotness = Hotness::Cold;
+    else
+        FnHotness = Hotness::Normal;
+}
+
+double FunctionProfile::blockCount(const BasicBlock &BB) const {
+    double Relative = BFI.getBlockFreq(&BB).getFrequency() / EntryFreq;
+    return HasEntryCount ? Relative * static_cast<double>(EntryCount) : Relative;
+}
+
+Hotness FunctionProfile::blockHotness(const BasicBlock &BB) const {
+    if (!PSI.hasProfileSummary())
+        return Hotness::Unknown;
+    if (PSI.isHotBlock(&BB, &BFI))
+        return Hotness::Hot;
+    if (PSI.isColdBlock(&BB, &BFI))
+        return Hotness::Cold;
+    return Hotness::Normal;
+}
+
+} // namespace skeleton
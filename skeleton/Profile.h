@@ -0,0 +1,52 @@
+#ifndef SKELETON_PROFILE_H
+#define SKELETON_PROFILE_H
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+
+namespace llvm {
+class BasicBlock;
+class BlockFrequencyInfo;
+class Function;
+class ProfileSummaryInfo;
+} // namespace llvm
+
+namespace skeleton {
+
+// Unknown means the module carries no profile summary to classify against.
+enum class Hotness { Unknown, Cold, Normal, Hot };
+
+llvm::StringRef hotnessName(Hotness H);
+
+// Execution-frequency view of one function, used to turn static instruction
+// counts into estimated dynamic ones.
+//
+// With a profile (an entry count on the function), block counts are the
+// profile counts scaled through BlockFrequencyInfo. Without one, they are
+// estimates per invocation of the function, based on the static branch
+// probabilities.
+class FunctionProfile {
+public:
+    FunctionProfile(llvm::Function &F, llvm::ProfileSummaryInfo &PSI,
+                    llvm::BlockFrequencyInfo &BFI);
+
+    bool hasProfile() const { return HasEntryCount; }
+    uint64_t entryCount() const { return EntryCount; }
+    Hotness hotness() const { return FnHotness; }
+
+    double blockCount(const llvm::BasicBlock &BB) const;
+    Hotness blockHotness(const llvm::BasicBlock &BB) const;
+
+private:
+    llvm::ProfileSummaryInfo &PSI;
+    llvm::BlockFrequencyInfo &BFI;
+    bool HasEntryCount = false;
+    uint64_t EntryCount = 0;
+    double EntryFreq = 1.0;
+    Hotness FnHotness = Hotness::Unknown;
+};
+
+} // namespace skeleton
+
+#endif // SKELETON_PROFILE_H
@@ -0,0 +1,256 @@
+#include "Analyses.h"
+#include "Instrumentation.h"
+#include "Profile.h"
+#include "Report.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/MemorySSA.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// Writes followed above a redundant load before giving up on it.
+constexpr unsigned MaxBlockers = 8;
+
+// An instruction between two loads of the same location that may write it.
+struct Blocker {
+    Instruction *Inst;
+    StringRef Kind;     // "store", "call" or "ordering"
+    std::string Reason;
+    SmallVector<Argument *, 2> NoAlias; // arguments whose noalias would drop it
+};
+
+struct RedundantLoad {
+    LoadInst *Load;
+    LoadInst *Earlier; // same location, dominates Load
+    SmallVector<Blocker, 2> Blockers;
+    double Executions;
+    Hotness Hot;
+};
+
+std::string operandName(const Value *V) {
+    std::string S;
+    raw_string_ostream OS(S);
+    V->printAsOperand(OS, /*PrintType=*/false);
+    return S;
+}
+
+std::string describeObject(const Value *Obj) {
+    if (isa<Argument>(Obj))
+        return "argument " + operandName(Obj);
+    if (isa<GlobalValue>(Obj))
+        return "global " + operandName(Obj);
+    if (isa<AllocaInst>(Obj))
+        return "stack object " + operandName(Obj);
+    if (isa<LoadInst>(Obj))
+        return "pointer loaded as " + operandName(Obj);
+    if (isa<CallBase>(Obj))
+        return "pointer returned as " + operandName(Obj);
+    return "pointer " + operandName(Obj);
+}
+
+// An argument AA would trust not to alias other objects if it were noalias.
+Argument *noaliasCandidate(const Value *Obj) {
+    auto *A = dyn_cast<Argument>(const_cast<Value *>(Obj));
+    if (!A || !A->getType()->isPointerTy() || A->hasNoAliasAttr() || A->hasByValAttr())
+        return nullptr;
+    return A;
+}
+
+// Why Def may write the location Load reads, or false if it surely does
+// (a must or partial alias): then the load is not redundant at all.
+bool describeBlocker(Instruction &Def, LoadInst &Load, AAResults &AA, Blocker &B) {
+    B.Inst = &Def;
+    MemoryLocation Loc = MemoryLocation::get(&Load);
+    const Value *LoadObj = getUnderlyingObject(Load.getPointerOperand());
+    if (auto *SI = dyn_cast<StoreInst>(&Def)) {
+        B.Kind = "store";
+        if (!SI->isUnordered()) {
+            B.Kind = "ordering";
+            B.Reason = "atomic or volatile store";
+            return true;
+        }
+        if (AA.alias(MemoryLocation::get(SI), Loc) != AliasResult::MayAlias)
+            return false;
+        const Value *StoreObj = getUnderlyingObject(SI->getPointerOperand());
+        if (StoreObj == LoadObj) {
+            B.Reason = "store into the same " + describeObject(LoadObj) +
+                       " at an offset not known to differ";
+            return true;
+        }
+        B.Reason = "store through " + describeObject(StoreObj) + " may alias " +
+                   describeObject(LoadObj);
+        for (const Value *Obj : {LoadObj, StoreObj})
+            if (Argument *A = noaliasCandidate(Obj))
+                B.NoAlias.push_back(A);
+        return true;
+    }
+    if (auto *CB = dyn_cast<CallBase>(&Def)) {
+        B.Kind = "call";
+        ModRefInfo MRI = AA.getModRefInfo(CB, Loc);
+        if (!isModSet(MRI))
+            return false;
+        Function *Callee = CB->getCalledFunction();
+        B.Reason = (Callee ? "call to " + operandName(Callee) : std::string("indirect call")) +
+                   " may write " + describeObject(LoadObj);
+        if (Argument *A = noaliasCandidate(LoadObj))
+            B.NoAlias.push_back(A);
+        return true;
+    }
+    B.Kind = "ordering";
+    B.Reason = Def.getOpcodeName();
+    B.Reason += " orders memory";
+    return true;
+}
+
+// Finds what separates Load from Earlier in MemorySSA. Returns false when a
+// write surely clobbers the location, or the walk reaches a MemoryPhi (paths
+// merging, some of which may write it) or gives up.
+bool collectBlockers(LoadInst &Load, LoadInst &Earlier, MemorySSA &MSSA, AAResults &AA,
+                     SmallVectorImpl<Blocker> &Blockers) {
+    MemorySSAWalker *Walker = MSSA.getWalker();
+    MemoryAccess *EarlierAccess = MSSA.getMemoryAccess(&Earlier);
+    MemoryLocation Loc = MemoryLocation::get(&Load);
+    MemoryAccess *Clobber = Walker->getClobberingMemoryAccess(&Load);
+    while (!MSSA.isLiveOnEntryDef(Clobber) && !MSSA.dominates(Clobber, EarlierAccess)) {
+        auto *Def = dyn_cast<MemoryDef>(Clobber);
+        if (!Def || Blockers.size() == MaxBlockers)
+            return false;
+        Blocker B;
+        if (!describeBlocker(*Def->getMemoryInst(), Load, AA, B))
+            return false;
+        Blockers.push_back(std::move(B));
+        Clobber = Walker->getClobberingMemoryAccess(Def->getDefiningAccess(), Loc);
+    }
+    return true;
+}
+
+} // namespace
+
+void reportRedundantLoads(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                          Report &R, StringRef Stage, unsigned Top) {
+    std::vector<RedundantLoad> Loads;
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        MemorySSA &MSSA = FAM.getResult<MemorySSAAnalysis>(F).getMSSA();
+        AAResults &AA = FAM.getResult<AAManager>(F);
+        DominatorTree &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+        FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+
+        // Loads seen so far by underlying object; only those can must-alias.
+        DenseMap<const Value *, SmallVector<LoadInst *, 4>> ByObject;
+        for (BasicBlock *BB : depth_first(&F.getEntryBlock()))
+            for (Instruction &I : *BB) {
+                auto *LI = dyn_cast<LoadInst>(&I);
+                if (!LI || !LI->isUnordered())
+                    continue;
+                auto &Seen = ByObject[getUnderlyingObject(LI->getPointerOperand())];
+                // The nearest earlier load of the same location that
+                // dominates this one.
+                LoadInst *Earlier = nullptr;
+                for (LoadInst *Prev : Seen)
+                    if (Prev->getType() == LI->getType() && DT.dominates(Prev, LI) &&
+                        (!Earlier || DT.dominates(Earlier, Prev)) &&
+                        AA.isMustAlias(MemoryLocation::get(Prev), MemoryLocation::get(LI)))
+                        Earlier = Prev;
+                Seen.push_back(LI);
+                if (!Earlier)
+                    continue;
+                RedundantLoad RL{LI, Earlier};
+                if (!collectBlockers(*LI, *Earlier, MSSA, AA, RL.Blockers))
+                    continue;
+                RL.Executions = Prof.blockCount(*BB);
+                RL.Hot = Prof.blockHotness(*BB);
+                Loads.push_back(std::move(RL));
+            }
+    }
+    if (Loads.empty())
+        return;
+    llvm::stable_sort(Loads, [](const RedundantLoad &A, const RedundantLoad &B) {
+        return A.Executions > B.Executions;
+    });
+
+    unsigned Blocked = llvm::count_if(Loads, [](const RedundantLoad &L) {
+        return !L.Blockers.empty();
+    });
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "♻️  Redundant Loads "
+                   << (Stage == "optimizer_last" ? "after optimization" : "at pipeline start")
+                   << " (" << Loads.size()
+                   << " loads of a location already loaded: " << Loads.size() - Blocked
+                   << " with no write in between, " << Blocked
+                   << " kept by a possible alias; estimated executions"
+                   << (PerCall ? " per call" : "") << ")\n";
+
+    unsigned Shown = 0;
+    for (const RedundantLoad &L : Loads) {
+        if (!R.withinBudget())
+            return;
+        if (!R.isText()) {
+            R.record("redundant_load", [&](json::OStream &J) {
+                J.attribute("site", siteName(*L.Load));
+                J.attribute("function", L.Load->getFunction()->getName());
+                J.attribute("stage", Stage);
+                J.attribute("earlier", siteName(*L.Earlier));
+                J.attribute("load_type", typeName(L.Load->getType()));
+                J.attribute("status", L.Blockers.empty() ? "redundant" : "blocked");
+                J.attributeArray("blockers", [&] {
+                    for (const Blocker &B : L.Blockers)
+                        J.object([&] {
+                            J.attribute("site", siteName(*B.Inst));
+                            J.attribute("kind", B.Kind);
+                            J.attribute("reason", B.Reason);
+                            if (!B.NoAlias.empty())
+                                J.attributeArray("noalias", [&] {
+                                    for (Argument *A : B.NoAlias)
+                                        J.value(operandName(A));
+                                });
+                        });
+                });
+                J.attribute("executions", L.Executions);
+                J.attribute("hotness", hotnessName(L.Hot));
+            });
+            continue;
+        }
+        if (Top && Shown++ >= Top)
+            continue;
+        raw_ostream &OS = R.stream();
+        OS << "   • " << siteName(*L.Load) << "  load " << *L.Load->getType() << " from "
+           << operandName(L.Load->getPointerOperand()) << "  "
+           << format("%.1f", L.Executions) << " executions"
+           << (L.Hot == Hotness::Hot ? "  🔥" : "") << "\n";
+        OS << "      same location as " << siteName(*L.Earlier);
+        if (L.Blockers.empty())
+            OS << "; no write in between\n";
+        else
+            OS << "; kept by:\n";
+        for (const Blocker &B : L.Blockers) {
+            OS << "      ↳ " << siteName(*B.Inst) << ": " << B.Reason;
+            for (Argument *A : B.NoAlias)
+                OS << (A == B.NoAlias.front() ? "  💡 noalias on " : " or ")
+                   << operandName(A);
+            OS << "\n";
+        }
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
@@ -0,0 +1,49 @@
+#include "Report.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Type.h"
+
+using namespace llvm;
+
+namespace skeleton {
+
+std::string typeName(Type *T) {
+    std::string S;
+    raw_string_ostream OS(S);
+    T->print(OS, /*IsForDebug=*/false, /*NoDetails=*/true);
+    return OS.str();
+}
+
+std::string syncScopeName(LLVMContext &Ctx, uint8_t ScopeID) {
+    if (ScopeID == SyncScope::System)
+        return "system";
+    SmallVector<StringRef, 8> Names;
+    Ctx.getSyncScopeNames(Names);
+    return ScopeID < Names.size() ? Names[ScopeID].str() : "scope" + std::to_string(ScopeID);
+}
+
+bool Report::truncate(StringRef Reason) {
+    Truncated = true;
+    auto Elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - Start);
+    if (isText()) {
+        OS << "\n⚠️  Report truncated: ";
+        if (Reason == "bytes")
+            OS << "output budget of " << MaxBytes << " bytes";
+        else
+            OS << "time budget of " << MaxTime.count() << " ms";
+        OS << " exceeded after " << bytesWritten() << " bytes and " << Elapsed.count()
+           << " ms; only summaries follow\n\n";
+    } else {
+        record("truncated", [&](json::OStream &J) {
+            J.attribute("reason", Reason);
+            J.attribute("limit", static_cast<int64_t>(Reason == "bytes" ? MaxBytes
+                                                                        : MaxTime.count()));
+            J.attribute("bytes", static_cast<int64_t>(bytesWritten()));
+            J.attribute("elapsed_ms", static_cast<int64_t>(Elapsed.count()));
+        });
+    }
+    return false;
+}
+
+} // namespace skeleton
@@ -0,0 +1,98 @@
+#ifndef SKELETON_REPORT_H
+#define SKELETON_REPORT_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace llvm {
+class LLVMContext;
+class Type;
+} // namespace llvm
+
+namespace skeleton {
+
+// Prints a type without expanding named struct bodies, e.g. "%struct.S".
+std::string typeName(llvm::Type *T);
+
+// Name of an atomic's synchronization scope: "system", "singlethread" or a
+// target scope such as "agent".
+std::string syncScopeName(llvm::LLVMContext &Ctx, uint8_t ScopeID);
+
+enum class ReportFormat { Text, NDJSON };
+
+// Version of the NDJSON record schema documented in README.md. Bump it when a
+// field is removed or changes meaning; adding fields or record types does not.
+constexpr unsigned ReportSchemaVersion = 5;
+
+// Destination of the module report. Text mode writes the decorated report to
+// stream(); NDJSON mode emits one self-contained record per line.
+//
+// The report optionally carries a budget on the bytes written and the time
+// spent on the module. Detail sections ask withinBudget() before printing;
+// once a limit is hit, a single truncation marker is written and every later
+// call returns false, leaving only the summaries.
+class Report {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Report(llvm::raw_ostream &OS, ReportFormat Format)
+        : OS(OS), Format(Format), StartPos(OS.tell()), Start(Clock::now()) {}
+
+    bool isText() const { return Format == ReportFormat::Text; }
+    llvm::raw_ostream &stream() { return OS; }
+
+    // A zero limit means unlimited.
+    void setBudget(uint64_t Bytes, std::chrono::milliseconds Time) {
+        MaxBytes = Bytes;
+        MaxTime = Time;
+    }
+
+    // Cheap enough to call per instruction: the byte count is a subtraction
+    // and the clock is only read on every 64th call.
+    bool withinBudget() {
+        if (Truncated)
+            return false;
+        if (MaxBytes && bytesWritten() > MaxBytes)
+            return truncate("bytes");
+        if (MaxTime.count() && (++Checks & 63) == 0 && Clock::now() - Start > MaxTime)
+            return truncate("time");
+        return true;
+    }
+
+    bool isTruncated() const { return Truncated; }
+    uint64_t bytesWritten() const { return OS.tell() - StartPos; }
+
+    // Streams {"type": Type, ...} straight to the output; no DOM is built, so
+    // memory use does not grow with the size of the module.
+    template <typename Fn> void record(llvm::StringRef Type, Fn Fields) {
+        {
+            llvm::json::OStream J(OS);
+            J.object([&] {
+                J.attribute("type", Type);
+                Fields(J);
+            });
+        }
+        OS << '\n';
+    }
+
+private:
+    bool truncate(llvm::StringRef Reason);
+
+    llvm::raw_ostream &OS;
+    ReportFormat Format;
+    uint64_t StartPos;
+    Clock::time_point Start;
+    uint64_t MaxBytes = 0;
+    std::chrono::milliseconds MaxTime{0};
+    unsigned Checks = 0;
+    bool Truncated = false;
+};
+
+} // namespace skeleton
+
+#endif // SKELETON_REPORT_H
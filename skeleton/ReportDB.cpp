@@ -0,0 +1,410 @@
+#include "ReportDB.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// Emits one JSON object followed by a newline. json::OStream without
+// indentation never writes newlines itself, so each record is one line.
+template <typename Fn> void writeRecord(raw_ostream &OS, Fn Fields) {
+    {
+        json::OStream J(OS);
+        J.object([&] { Fields(J); });
+    }
+    OS << "\n";
+}
+
+void writeShard(raw_ostream &OS, const ModuleRecord &MR) {
+    writeRecord(OS, [&](json::OStream &J) {
+        J.attribute("kind", "module");
+        J.attribute("schema", ReportDBSchemaVersion);
+        J.attribute("module", MR.ModuleID);
+        J.attribute("source", MR.SourceFile);
+        J.attribute("output", MR.OutputFile);
+    });
+    for (const FunctionRecord &FR : MR.Functions) {
+        writeRecord(OS, [&](json::OStream &J) {
+            J.attribute("kind", "function");
+            J.attribute("name", FR.Name);
+            J.attribute("blocks", static_cast<int64_t>(FR.Blocks));
+            J.attribute("instructions", static_cast<int64_t>(FR.Instructions));
+            J.attribute("loads", static_cast<int64_t>(FR.Loads));
+            J.attribute("stores", static_cast<int64_t>(FR.Stores));
+            J.attribute("calls", static_cast<int64_t>(FR.Calls));
+            J.attribute("indirect_calls", static_cast<int64_t>(FR.IndirectCalls));
+            J.attribute("hotness", FR.Hotness);
+            J.attribute("dyn_instructions", FR.DynInstructions);
+            J.attribute("dyn_loads", FR.DynLoads);
+            J.attribute("dyn_stores", FR.DynStores);
+            J.attribute("dyn_calls", FR.DynCalls);
+        });
+    }
+    for (const CallSiteRecord &CS : MR.CallSites) {
+        writeRecord(OS, [&](json::OStream &J) {
+            J.attribute("kind", "callsite");
+            J.attribute("caller", CS.Caller);
+            J.attribute("block", CS.Block);
+            J.attribute("index", static_cast<int64_t>(CS.Index));
+            J.attribute("callee", CS.Callee);
+            J.attribute("callee_type", CS.CalleeType);
+        });
+    }
+}
+
+uint64_t getUInt(const json::Object &O, StringRef Key) {
+    if (auto V = O.getInteger(Key))
+        return *V < 0 ? 0 : static_cast<uint64_t>(*V);
+    return 0;
+}
+
+double getDouble(const json::Object &O, StringRef Key) {
+    if (auto V = O.getNumber(Key))
+        return *V;
+    return 0;
+}
+
+std::string getString(const json::Object &O, StringRef Key) {
+    if (auto V = O.getString(Key))
+        return V->str();
+    return std::string();
+}
+
+// Identity of the translation unit a module or index record describes.
+// Records written before output paths were recorded only have the module ID.
+std::string unitKey(const json::Object &O) {
+    if (!O.get("output"))
+        return getString(O, "module");
+    return getString(O, "source") + '\0' + getString(O, "output");
+}
+
+struct ShardModule {
+    std::string Key;
+    ModuleRecord MR;
+};
+
+Expected<std::vector<ShardModule>> readShard(StringRef Path) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFile(Path);
+    if (!Buf)
+        return createFileError(Path, Buf.getError());
+
+    std::vector<ShardModule> Modules;
+    for (line_iterator L(**Buf, /*SkipBlanks=*/true); !L.is_at_end(); ++L) {
+        Expected<json::Value> V = json::parse(*L);
+        if (!V)
+            return createFileError(Path, L.line_number(), V.takeError());
+        const json::Object *O = V->getAsObject();
+        if (!O)
+            return createFileError(Path, L.line_number(),
+                                   createStringError(inconvertibleErrorCode(),
+                                                     "record is not an object"));
+
+        std::string Kind = getString(*O, "kind");
+        if (Kind == "module") {
+            if (getUInt(*O, "schema") > ReportDBSchemaVersion)
+                return createFileError(Path, createStringError(
+                    inconvertibleErrorCode(), "shard uses a newer schema version"));
+            ShardModule &SM = Modules.emplace_back();
+            SM.Key = unitKey(*O);
+            SM.MR.ModuleID = getString(*O, "module");
+            SM.MR.SourceFile = getString(*O, "source");
+            SM.MR.OutputFile = getString(*O, "output");
+            continue;
+        }
+        if (Kind != "function" && Kind != "callsite")
+            continue; // unknown kinds come from newer writers
+        if (Modules.empty())
+            return createFileError(Path, L.line_number(),
+                                   createStringError(inconvertibleErrorCode(),
+                                                     "record before the module record"));
+        ModuleRecord &MR = Modules.back().MR;
+        if (Kind == "function") {
+            FunctionRecord FR;
+            FR.Name = getString(*O, "name");
+            FR.Blocks = getUInt(*O, "blocks");
+            FR.Instructions = getUInt(*O, "instructions");
+            FR.Loads = getUInt(*O, "loads");
+            FR.Stores = getUInt(*O, "stores");
+            FR.Calls = getUInt(*O, "calls");
+            FR.IndirectCalls = getUInt(*O, "indirect_calls");
+            FR.Hotness = getString(*O, "hotness");
+            FR.DynInstructions = getDouble(*O, "dyn_instructions");
+            FR.DynLoads = getDouble(*O, "dyn_loads");
+            FR.DynStores = getDouble(*O, "dyn_stores");
+            FR.DynCalls = getDouble(*O, "dyn_calls");
+            MR.Functions.push_back(std::move(FR));
+        } else {
+            CallSiteRecord CS;
+            CS.Caller = getString(*O, "caller");
+            CS.Block = getString(*O, "block");
+            CS.Index = getUInt(*O, "index");
+            CS.Callee = getString(*O, "callee");
+            CS.CalleeType = getString(*O, "callee_type");
+            MR.CallSites.push_back(std::move(CS));
+        }
+    }
+    return Modules;
+}
+
+// Writes a shard named <Prefix>-XXXXXXXX.ndjson under <DBDir>/shards and
+// returns its path relative to DBDir.
+template <typename Fn>
+Expected<std::string> writeShardFile(StringRef DBDir, StringRef Prefix, Fn Write) {
+    SmallString<256> ShardDir(DBDir);
+    sys::path::append(ShardDir, "shards");
+    if (std::error_code EC = sys::fs::create_directories(ShardDir))
+        return createFileError(ShardDir, EC);
+
+    // Write the shard under a unique temporary name and rename it once it is
+    // complete, so a concurrent reader can only see finished shards.
+    SmallString<256> Model(ShardDir);
+    sys::path::append(Model, Prefix + "-%%%%%%%%.tmp");
+    int FD;
+    SmallString<256> TmpPath;
+    if (std::error_code EC = sys::fs::createUniqueFile(Model, FD, TmpPath))
+        return createFileError(Model, EC);
+    {
+        raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        Write(OS);
+        OS.close();
+        if (std::error_code EC = OS.error()) {
+            OS.clear_error();
+            sys::fs::remove(TmpPath);
+            return createFileError(TmpPath, EC);
+        }
+    }
+
+    SmallString<256> ShardPath(TmpPath);
+    sys::path::replace_extension(ShardPath, "ndjson");
+    if (std::error_code EC = sys::fs::rename(TmpPath, ShardPath)) {
+        sys::fs::remove(TmpPath);
+        return createFileError(ShardPath, EC);
+    }
+    return ("shards/" + sys::path::filename(ShardPath)).str();
+}
+
+void writeIndexLine(raw_ostream &OS, StringRef Shard, const ModuleRecord &MR) {
+    writeRecord(OS, [&](json::OStream &J) {
+        J.attribute("shard", Shard);
+        J.attribute("module", MR.ModuleID);
+        J.attribute("source", MR.SourceFile);
+        J.attribute("output", MR.OutputFile);
+    });
+}
+
+// Holds <db>/lock, which writers take around index updates so compaction
+// cannot drop a line appended while it rewrites the index.
+class DatabaseLock {
+    int FD = -1;
+
+public:
+    ~DatabaseLock() {
+        if (FD == -1)
+            return;
+        sys::fs::unlockFile(FD);
+        sys::fs::closeFile(FD);
+    }
+
+    Error acquire(StringRef DBDir) {
+        SmallString<256> LockPath(DBDir);
+        sys::path::append(LockPath, "lock");
+        if (std::error_code EC = sys::fs::openFileForWrite(LockPath, FD,
+                                                           sys::fs::CD_OpenAlways))
+            return createFileError(LockPath, EC);
+        if (std::error_code EC = sys::fs::lockFile(FD))
+            return createFileError(LockPath, EC);
+        return Error::success();
+    }
+};
+
+// The live shard of every translation unit, in order of first appearance.
+struct Index {
+    std::vector<std::string> Keys;
+    StringMap<std::string> Latest;   // key -> shard
+    StringSet<> Shards;              // every shard the index mentions
+};
+
+Expected<Index> readIndex(StringRef DBDir) {
+    SmallString<256> IndexPath(DBDir);
+    sys::path::append(IndexPath, "index");
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFile(IndexPath);
+    if (!Buf)
+        return createFileError(IndexPath, Buf.getError());
+
+    // Later index lines for the same translation unit replace earlier ones.
+    // Lines that do not parse (e.g. torn by a crashed writer) are ignored.
+    Index I;
+    for (line_iterator L(**Buf, /*SkipBlanks=*/true); !L.is_at_end(); ++L) {
+        Expected<json::Value> V = json::parse(*L);
+        if (!V) {
+            consumeError(V.takeError());
+            continue;
+        }
+        const json::Object *O = V->getAsObject();
+        if (!O || !O->getString("shard"))
+            continue;
+        std::string Shard = getString(*O, "shard");
+        std::string Key = unitKey(*O);
+        I.Shards.insert(Shard);
+        auto [It, Inserted] = I.Latest.try_emplace(Key, Shard);
+        if (Inserted)
+            I.Keys.push_back(std::move(Key));
+        else
+            It->second = std::move(Shard);
+    }
+    return I;
+}
+
+// Reads each live shard once, keeping only the translation units it is the
+// latest shard for.
+std::vector<ModuleRecord> loadLive(StringRef DBDir, const Index &I,
+                                   function_ref<void(Error)> Warn) {
+    StringMap<std::vector<ShardModule>> Loaded;
+    for (const std::string &Key : I.Keys) {
+        const std::string &Shard = I.Latest.find(Key)->second;
+        if (Loaded.count(Shard))
+            continue;
+        SmallString<256> Path(DBDir);
+        sys::path::append(Path, Shard);
+        Expected<std::vector<ShardModule>> Modules = readShard(Path);
+        if (!Modules) {
+            Warn(Modules.takeError());
+            Loaded[Shard];
+            continue;
+        }
+        Loaded[Shard] = std::move(*Modules);
+    }
+
+    std::vector<ModuleRecord> Records;
+    Records.reserve(I.Keys.size());
+    for (const std::string &Key : I.Keys) {
+        auto &Modules = Loaded[I.Latest.find(Key)->second];
+        auto It = llvm::find_if(Modules, [&](const ShardModule &SM) { return SM.Key == Key; });
+        if (It != Modules.end())
+            Records.push_back(std::move(It->MR));
+        else if (!Modules.empty())
+            Warn(createStringError(inconvertibleErrorCode(),
+                                   "%s: translation unit missing from its indexed shard",
+                                   I.Latest.find(Key)->second.c_str()));
+    }
+    return Records;
+}
+
+} // namespace
+
+Error appendModuleRecord(StringRef DBDir, const ModuleRecord &MR) {
+    Expected<std::string> Shard =
+        writeShardFile(DBDir, utohexstr(xxHash64(MR.SourceFile + MR.OutputFile)),
+                       [&](raw_ostream &OS) { writeShard(OS, MR); });
+    if (!Shard)
+        return Shard.takeError();
+
+    // Build the index line up front and append it with a single write; with
+    // O_APPEND this keeps lines from concurrent compilers from interleaving.
+    std::string Line;
+    raw_string_ostream LS(Line);
+    writeIndexLine(LS, *Shard, MR);
+    LS.flush();
+
+    DatabaseLock Lock;
+    if (Error E = Lock.acquire(DBDir))
+        return E;
+    SmallString<256> IndexPath(DBDir);
+    sys::path::append(IndexPath, "index");
+    int FD;
+    if (std::error_code EC = sys::fs::openFileForWrite(IndexPath, FD, sys::fs::CD_OpenAlways,
+                                                       sys::fs::OF_Append))
+        return createFileError(IndexPath, EC);
+    raw_fd_ostream IS(FD, /*shouldClose=*/true);
+    IS.write(Line.data(), Line.size());
+    IS.close();
+    if (std::error_code EC = IS.error()) {
+        IS.clear_error();
+        return createFileError(IndexPath, EC);
+    }
+    return Error::success();
+}
+
+Expected<std::vector<ModuleRecord>> loadModuleRecords(StringRef DBDir,
+                                                      function_ref<void(Error)> Warn) {
+    Expected<Index> I = readIndex(DBDir);
+    if (!I)
+        return I.takeError();
+    return loadLive(DBDir, *I, Warn);
+}
+
+Expected<CompactStats> compactDatabase(StringRef DBDir, function_ref<void(Error)> Warn) {
+    DatabaseLock Lock;
+    if (Error E = Lock.acquire(DBDir))
+        return E;
+    Expected<Index> I = readIndex(DBDir);
+    if (!I)
+        return I.takeError();
+    std::vector<ModuleRecord> Records = loadLive(DBDir, *I, Warn);
+
+    CompactStats Stats;
+    Stats.Modules = Records.size();
+    std::string IndexText;
+    raw_string_ostream IS(IndexText);
+    if (!Records.empty()) {
+        Expected<std::string> Shard = writeShardFile(DBDir, "compact", [&](raw_ostream &OS) {
+            for (const ModuleRecord &MR : Records)
+                writeShard(OS, MR);
+        });
+        if (!Shard)
+            return Shard.takeError();
+        for (const ModuleRecord &MR : Records)
+            writeIndexLine(IS, *Shard, MR);
+    }
+    IS.flush();
+
+    // Replace the index in one rename; appenders wait on the lock meanwhile.
+    SmallString<256> IndexPath(DBDir);
+    sys::path::append(IndexPath, "index");
+    SmallString<256> Model(IndexPath);
+    Model += "-%%%%%%%%.tmp";
+    int FD;
+    SmallString<256> TmpPath;
+    if (std::error_code EC = sys::fs::createUniqueFile(Model, FD, TmpPath))
+        return createFileError(Model, EC);
+    {
+        raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        OS << IndexText;
+        OS.close();
+        if (std::error_code EC = OS.error()) {
+            OS.clear_error();
+            sys::fs::remove(TmpPath);
+            return createFileError(TmpPath, EC);
+        }
+    }
+    if (std::error_code EC = sys::fs::rename(TmpPath, IndexPath)) {
+        sys::fs::remove(TmpPath);
+        return createFileError(IndexPath, EC);
+    }
+
+    // Every shard the old index named is now superseded. Shards not yet
+    // indexed belong to compilers still running and are left alone.
+    for (const auto &Shard : I->Shards) {
+        SmallString<256> Path(DBDir);
+        sys::path::append(Path, Shard.getKey());
+        if (!sys::fs::remove(Path, /*IgnoreNonExisting=*/false))
+            ++Stats.RemovedShards;
+    }
+    return Stats;
+}
+
+} // namespace skeleton
@@ -0,0 +1,89 @@
+#ifndef SKELETON_REPORTDB_H
+#define SKELETON_REPORTDB_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk store that aggregates per-module reports across translation units.
+//
+// Layout of a database directory:
+//   <db>/index            one JSON line per translation unit in a committed shard
+//   <db>/shards/*.ndjson  one JSON record per line; a "module" record starts
+//                         each translation unit's records
+//   <db>/lock             serializes index updates
+//
+// A shard is written to a temporary file and renamed into place before its
+// index line is appended, so readers never observe a partially written shard.
+// Several compiler processes may append to the same database concurrently.
+// A translation unit is identified by its absolute source and output paths;
+// when it is compiled more than once, the last indexed shard wins.
+//
+// Each compilation adds a shard holding one translation unit. Compaction
+// rewrites the live translation units into a single shard and index, and
+// removes the shards they supersede.
+
+namespace skeleton {
+
+constexpr unsigned ReportDBSchemaVersion = 1;
+
+struct FunctionRecord {
+    std::string Name;
+    uint64_t Blocks = 0;
+    uint64_t Instructions = 0;
+    uint64_t Loads = 0;
+    uint64_t Stores = 0;
+    uint64_t Calls = 0;
+    uint64_t IndirectCalls = 0;
+    std::string Hotness;       // "hot", "normal", "cold" or "unknown"
+    // Executions estimated from block frequencies: profile counts when the
+    // module has a profile, otherwise per invocation of the function.
+    double DynInstructions = 0;
+    double DynLoads = 0;
+    double DynStores = 0;
+    double DynCalls = 0;
+};
+
+struct CallSiteRecord {
+    std::string Caller;
+    std::string Block;
+    uint64_t Index = 0;       // 1-based position of the call in its block
+    std::string Callee;       // empty for indirect calls
+    std::string CalleeType;   // printed function type of the call
+};
+
+struct ModuleRecord {
+    std::string ModuleID;
+    std::string SourceFile;   // absolute
+    std::string OutputFile;   // absolute, or empty when unknown
+    std::vector<FunctionRecord> Functions;
+    std::vector<CallSiteRecord> CallSites;
+};
+
+// Writes MR as a new shard of the database rooted at DBDir and indexes it.
+llvm::Error appendModuleRecord(llvm::StringRef DBDir, const ModuleRecord &MR);
+
+// Loads the latest indexed record of every translation unit in the database.
+// Shards that are missing or do not parse are passed to Warn and skipped.
+llvm::Expected<std::vector<ModuleRecord>>
+loadModuleRecords(llvm::StringRef DBDir, llvm::function_ref<void(llvm::Error)> Warn);
+
+struct CompactStats {
+    size_t Modules = 0;        // translation units in the compacted shard
+    size_t RemovedShards = 0;  // shard files deleted
+};
+
+// Rewrites the database rooted at DBDir as one shard holding the latest
+// record of every translation unit. Unreadable shards are passed to Warn and
+// dropped. Compilers may keep appending meanwhile, but a query running
+// concurrently may find its shards gone.
+llvm::Expected<CompactStats> compactDatabase(llvm::StringRef DBDir,
+                                             llvm::function_ref<void(llvm::Error)> Warn);
+
+} // namespace skeleton
+
+#endif // SKELETON_REPORTDB_H
@@ -0,0 +1,112 @@
+#ifndef SKELETON_SAMPLING_H
+#define SKELETON_SAMPLING_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/xxhash.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace skeleton {
+
+// Decides which parts of a module get a per-instruction detail dump.
+//
+// A unit (a whole function, or a single block) is kept with probability Rate.
+// The decision hashes the function name, block index and seed rather than
+// drawing from a generator, so it is reproducible across runs and does not
+// depend on the order in which functions are visited. On top of that, at most
+// MaxPerCategory instructions of each category are detailed per module, which
+// bounds the cost of the dump regardless of module size. The capped examples
+// are the ones with the smallest hashes, so they spread across the module
+// instead of being its first instructions. Finding them takes a first pass
+// over the module that offers every candidate to addCandidate().
+class DetailSampler {
+public:
+    enum class Unit { Function, Block };
+
+    DetailSampler(double Rate, uint64_t Seed, Unit U, unsigned MaxPerCategory,
+                  unsigned NumCategories)
+        : Rate(Rate), Seed(Seed), U(U), MaxPerCategory(MaxPerCategory),
+          Taken(NumCategories, 0), Smallest(NumCategories) {}
+
+    // True when every instruction is detailed, i.e. sampling is off.
+    bool isExhaustive() const { return Rate >= 1.0 && MaxPerCategory == 0; }
+
+    bool sampleFunction(llvm::StringRef Fn) const {
+        return U == Unit::Block || keep(llvm::xxHash64(Fn));
+    }
+
+    // Only meaningful for functions that passed sampleFunction().
+    bool sampleBlock(llvm::StringRef Fn, unsigned BlockIndex) const {
+        return U == Unit::Function || keep(llvm::xxHash64(Fn) + BlockIndex);
+    }
+
+    // True when the categories are capped and need the candidate pass.
+    bool isCapped() const { return MaxPerCategory != 0; }
+
+    // First pass: offers an instruction of a sampled block as an example.
+    // Each category keeps the MaxPerCategory smallest hashes in a max-heap.
+    void addCandidate(unsigned Category, llvm::StringRef Fn, unsigned BlockIndex,
+                      unsigned InstIndex) {
+        std::vector<uint64_t> &Heap = Smallest[Category];
+        uint64_t H = instructionHash(Fn, BlockIndex, InstIndex);
+        if (Heap.size() < MaxPerCategory) {
+            Heap.push_back(H);
+            std::push_heap(Heap.begin(), Heap.end());
+        } else if (H < Heap.front()) {
+            std::pop_heap(Heap.begin(), Heap.end());
+            Heap.back() = H;
+            std::push_heap(Heap.begin(), Heap.end());
+        }
+    }
+
+    // Second pass: whether the instruction is one of its category's examples.
+    bool takeExample(unsigned Category, llvm::StringRef Fn, unsigned BlockIndex,
+                     unsigned InstIndex) {
+        if (MaxPerCategory) {
+            const std::vector<uint64_t> &Heap = Smallest[Category];
+            uint64_t Cutoff = Heap.size() < MaxPerCategory
+                                  ? std::numeric_limits<uint64_t>::max()
+                                  : Heap.front();
+            // Equal hashes could exceed the cap; the count keeps it exact.
+            if (Taken[Category] >= MaxPerCategory ||
+                instructionHash(Fn, BlockIndex, InstIndex) > Cutoff)
+                return false;
+        }
+        ++Taken[Category];
+        return true;
+    }
+
+private:
+    // splitmix64 finalizer.
+    uint64_t mix(uint64_t Key) const {
+        uint64_t Z = Key + Seed * 0x9e3779b97f4a7c15ULL;
+        Z = (Z ^ (Z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        Z = (Z ^ (Z >> 27)) * 0x94d049bb133111ebULL;
+        return Z ^ (Z >> 31);
+    }
+
+    uint64_t instructionHash(llvm::StringRef Fn, unsigned BlockIndex, unsigned InstIndex) const {
+        return mix(llvm::xxHash64(Fn) ^ mix(uint64_t(BlockIndex) << 32 | InstIndex));
+    }
+
+    bool keep(uint64_t Key) const {
+        if (Rate >= 1.0)
+            return true;
+        // The top 53 bits give a uniform double in [0, 1).
+        return static_cast<double>(mix(Key) >> 11) * 0x1.0p-53 < Rate;
+    }
+
+    double Rate;
+    uint64_t Seed;
+    Unit U;
+    unsigned MaxPerCategory;
+    std::vector<unsigned> Taken;
+    std::vector<std::vector<uint64_t>> Smallest; // by category
+};
+
+} // namespace skeleton
+
+#endif // SKELETON_SAMPLING_H
@@ -1,202 +1,1145 @@
 #include "llvm/Pass.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/InlineCost.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/Operator.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ScopedPrinter.h"
+#include "llvm/Support/WithColor.h"
+
+#include "Analyses.h"
+#include "Cost.h"
+#include "FloatingPoint.h"
+#include "Locks.h"
+#include "Profile.h"
+#include "Report.h"
+#include "ReportDB.h"
+#include "Sampling.h"
+#include "StructInfo.h"
+#include "Switches.h"
+#include "Transforms.h"
+#include "Vectors.h"
 
 using namespace llvm;
+using skeleton::Report;
+using skeleton::DetailSampler;
+using skeleton::hotnessName;
+using skeleton::ReportFormat;
+
+static cl::opt<std::string> ReportDBDir(
+    "skeleton-db", cl::value_desc("dir"),
+    cl::desc("Append per-module records to the cross-TU report database in <dir>"));
+
+static cl::opt<std::string> ReportDBOutput(
+    "skeleton-db-output", cl::value_desc("file"),
+    cl::desc("Output file that identifies this translation unit in the report database "
+             "(default: the compiler's -o)"));
+
+static cl::opt<ReportFormat> ReportFormatOpt(
+    "skeleton-format", cl::desc("Format of the module report"),
+    cl::init(ReportFormat::Text),
+    cl::values(clEnumValN(ReportFormat::Text, "text", "Human-readable report"),
+               clEnumValN(ReportFormat::NDJSON, "ndjson",
+                          "One JSON record per line (schema in README.md)")));
+
+static cl::opt<std::string> ReportFile(
+    "skeleton-report-file", cl::value_desc("path"),
+    cl::desc("Write the module report to <path> instead of stderr ('-' for stdout)"));
+
+static cl::opt<double> SampleRate(
+    "skeleton-sample-rate", cl::init(1.0),
+    cl::desc("Fraction of functions or blocks whose instructions are detailed"));
+
+static cl::opt<DetailSampler::Unit> SampleUnit(
+    "skeleton-sample-unit", cl::desc("Unit sampled by -skeleton-sample-rate"),
+    cl::init(DetailSampler::Unit::Block),
+    cl::values(clEnumValN(DetailSampler::Unit::Function, "function", "Whole functions"),
+               clEnumValN(DetailSampler::Unit::Block, "block", "Individual basic blocks")));
+
+static cl::opt<uint64_t> SampleSeed(
+    "skeleton-sample-seed", cl::init(0),
+    cl::desc("Seed for -skeleton-sample-rate; the same seed selects the same units"));
+
+static cl::opt<unsigned> SampleMaxPerCategory(
+    "skeleton-sample-max-per-category", cl::init(0),
+    cl::desc("Detail at most this many instructions of each category per module (0 = no limit)"));
+
+static cl::opt<uint64_t> MaxReportBytes(
+    "skeleton-max-report-bytes", cl::init(0),
+    cl::desc("Stop detailed output once the module report exceeds this many bytes (0 = no limit)"));
+
+static cl::opt<unsigned> MaxReportMs(
+    "skeleton-max-report-ms", cl::init(0),
+    cl::desc("Stop detailed output after this many milliseconds per module (0 = no limit)"));
+
+static cl::opt<unsigned> CacheLineSize(
+    "skeleton-cache-line-size", cl::init(64),
+    cl::desc("Cache line size in bytes assumed by the layout analyses"));
+
+static cl::opt<bool> ShowStructLayouts(
+    "skeleton-struct-layout", cl::init(true),
+    cl::desc("Report size, padding and cache-line straddling of used struct types"));
+
+static cl::opt<bool> ShowFieldHeatMap(
+    "skeleton-field-heat", cl::init(true),
+    cl::desc("Report per-field access counts of struct types"));
+
+static cl::opt<bool> ShowFieldCoAccess(
+    "skeleton-field-coaccess", cl::init(true),
+    cl::desc("Recommend struct field orders from fields accessed together"));
+
+static cl::opt<bool> ShowSoACandidates(
+    "skeleton-soa", cl::init(true),
+    cl::desc("Rank loops over struct arrays that would benefit from a struct-of-arrays layout"));
+
+static cl::opt<bool> ShowAtomics(
+    "skeleton-atomics", cl::init(true),
+    cl::desc("Report atomic instructions with their ordering and scope"));
+
+static cl::opt<bool> InstrumentAtomics(
+    "skeleton-instrument-atomics", cl::init(false),
+    cl::desc("Count executions of atomics and cmpxchg failures at run time"));
+
+static cl::opt<bool> ShowLocks(
+    "skeleton-locks", cl::init(true),
+    cl::desc("Report call sites of mutex, rwlock, spinlock and condition-variable primitives"));
+
+static cl::opt<bool> InstrumentLocks(
+    "skeleton-instrument-locks", cl::init(false),
+    cl::desc("Time every lock acquisition at run time with per-thread counters"));
+
+static cl::opt<bool> ShowGlobals(
+    "skeleton-globals", cl::init(true),
+    cl::desc("Report every global variable with its per-function loads and stores"));
+
+static cl::opt<bool> ShowFalseSharing(
+    "skeleton-false-sharing", cl::init(true),
+    cl::desc("Report cache lines shared by globals that different functions or atomics write"));
+
+static cl::opt<bool> AlignFalseSharing(
+    "skeleton-align-false-sharing", cl::init(false),
+    cl::desc("Align the globals on cache lines at risk of false sharing to a line boundary"));
+
+static cl::opt<bool> ShowSwitches(
+    "skeleton-switches", cl::init(true),
+    cl::desc("Report switch density and whether the target lowers it to a jump table"));
+
+static cl::opt<bool> InstrumentSwitches(
+    "skeleton-instrument-switches", cl::init(false),
+    cl::desc("Count the hits of every switch case at run time"));
+
+static cl::opt<bool> ShowFloatingPoint(
+    "skeleton-fp", cl::init(true),
+    cl::desc("Report floating-point ops per function and loop with their fast-math flags"));
+
+static cl::opt<bool> ShowSimd(
+    "skeleton-simd", cl::init(true),
+    cl::desc("Report vector widths, lane types and shuffle density per function"));
+
+static cl::opt<bool> SimdLate(
+    "skeleton-simd-late", cl::init(false),
+    cl::desc("Also report SIMD utilization at the end of the optimization pipeline"));
+
+static cl::opt<bool> ShowCosts(
+    "skeleton-costs", cl::init(true),
+    cl::desc("Estimate throughput and latency cost per block, function and loop with the "
+             "target's cost model"));
+
+static cl::opt<unsigned> CostTop(
+    "skeleton-cost-top", cl::init(20),
+    cl::desc("Functions listed in the static cost section (0 for all)"));
+
+static cl::opt<bool> ShowInlining(
+    "skeleton-inlining", cl::init(true),
+    cl::desc("Report the inline cost of every direct call site against the threshold of "
+             "the pipeline's optimization level"));
+
+static cl::opt<unsigned> InlineTop(
+    "skeleton-inline-top", cl::init(20),
+    cl::desc("Call sites listed in the inlining section (0 for all)"));
+
+static cl::opt<bool> ShowRedundantLoads(
+    "skeleton-redundant-loads", cl::init(true),
+    cl::desc("Report loads of a location already loaded with no write in between, or "
+             "only writes that may alias"));
+
+static cl::opt<bool> RedundantLoadsLate(
+    "skeleton-redundant-loads-late", cl::init(false),
+    cl::desc("Also report redundant loads at the end of the optimization pipeline"));
+
+static cl::opt<unsigned> RedundantLoadTop(
+    "skeleton-redundant-load-top", cl::init(20),
+    cl::desc("Loads listed in the redundant loads section (0 for all)"));
+
+static cl::opt<bool> ShowNoAlias(
+    "skeleton-noalias", cl::init(true),
+    cl::desc("Report loops that noalias on pointer arguments would open to LICM or "
+             "vectorization"));
+
+static cl::opt<bool> AddNoAlias(
+    "skeleton-add-noalias", cl::init(false),
+    cl::desc("Mark pointer arguments of internal functions noalias where every call site "
+             "proves it safe"));
+
+static cl::list<std::string> CompareCPUs(
+    "skeleton-compare-cpus", cl::CommaSeparated,
+    cl::desc("Compare each function's cost on these CPUs of the module's target, the "
+             "first being the baseline (e.g. x86-64,x86-64-v2,x86-64-v3,x86-64-v4)"));
+
+static cl::opt<double> CompareMinGain(
+    "skeleton-compare-min-gain", cl::init(0.2),
+    cl::desc("Cost reduction against the baseline CPU that makes a function a "
+             "multiversioning candidate"));
+
+static cl::list<std::string> Multiversion(
+    "skeleton-multiversion", cl::CommaSeparated,
+    cl::desc("Functions to clone per x86-64 level behind an ifunc, or 'auto' for the "
+             "target comparison's candidates (transform)"));
+
+static cl::list<std::string> MultiversionCPUs(
+    "skeleton-multiversion-cpus", cl::CommaSeparated,
+    cl::desc("x86-64 levels to clone for (default: x86-64-v3,x86-64-v4)"));
+
+static cl::opt<bool> PeelSwitches(
+    "skeleton-peel-switches", cl::init(false),
+    cl::desc("Move the dominant cases of skewed switches into compares ahead of the switch"));
+
+static cl::opt<std::string> SwitchProfile(
+    "skeleton-switch-profile", cl::value_desc("file"),
+    cl::desc("Case hit counts from a -skeleton-instrument-switches run; switches it does not "
+             "cover use their !prof weights"));
+
+static cl::opt<double> PeelMinShare(
+    "skeleton-peel-min-share", cl::init(0.5),
+    cl::desc("Share of the hits reaching a switch a case needs to be peeled"));
+
+static cl::opt<unsigned> PeelMaxCases(
+    "skeleton-peel-max-cases", cl::init(2),
+    cl::desc("Most cases peeled from one switch"));
+
+static cl::opt<bool> SplitStructs(
+    "skeleton-split-structs", cl::init(false),
+    cl::desc("Move cold fields of module-internal struct types into a side struct"));
+
+static cl::opt<double> SplitColdRatio(
+    "skeleton-split-cold-ratio", cl::init(0.05),
+    cl::desc("A field is cold when accessed at most this fraction as often as its "
+             "struct's hottest field"));
 
 namespace {
 
+// Prints a value the way it appears as an operand in the IR, e.g. "i32 %x".
+std::string operandString(const Value *V) {
+    std::string S;
+    raw_string_ostream OS(S);
+    V->printAsOperand(OS, /*PrintType=*/true);
+    return OS.str();
+}
+
+void printInstructionDetail(raw_ostream &OS, Instruction &I, const DataLayout &DL) {
+    // Check for different instruction types with detailed analysis
+    if (auto *binOp = dyn_cast<BinaryOperator>(&I)) {
+        OS << "   │      🔧 Binary Operation: " << binOp->getOpcodeName() << "\n";
+        OS << "   │         Operand 1: " << *binOp->getOperand(0) << "\n";
+        OS << "   │         Operand 2: " << *binOp->getOperand(1) << "\n";
+        if (auto *VT = dyn_cast<VectorType>(binOp->getType()))
+            OS << "   │         Vector: " << VT->getElementCount() << " × "
+               << *VT->getElementType() << " ("
+               << DL.getTypeSizeInBits(VT).getKnownMinValue() << " bits)\n";
+        if (isa<FPMathOperator>(binOp)) {
+            OS << "   │         Fast-math: ";
+            if (binOp->isFast()) {
+                OS << "fast";
+            } else if (!binOp->getFastMathFlags().any()) {
+                OS << "none (strict IEEE)";
+            } else {
+                ListSeparator LS(" ");
+                for (StringRef Flag : skeleton::fastMathFlagNames(binOp->getFastMathFlags()))
+                    OS << LS << Flag;
+            }
+            OS << "\n";
+            if (skeleton::isExpensiveFPOperation(binOp->getOpcodeName()))
+                OS << "   │         ⚠️  Expensive: many times the latency of fadd/fmul\n";
+        }
+
+    } else if (auto *alloca = dyn_cast<AllocaInst>(&I)) {
+        OS << "   │      📦 Stack Allocation (alloca)\n";
+        OS << "   │         Type: " << *alloca->getAllocatedType() << "\n";
+        OS << "   │         Size: " << alloca->getAllocationSize(DL) << " bytes\n";
+        OS << "   │         Alignment: " << alloca->getAlign().value() << " bytes\n";
+
+    } else if (auto *load = dyn_cast<LoadInst>(&I)) {
+        OS << "   │      📥 Load from Memory\n";
+        OS << "   │         Source: " << *load->getPointerOperand() << "\n";
+        OS << "   │         Type: " << *load->getType() << "\n";
+        OS << "   │         Alignment: " << load->getAlign().value() << " bytes\n";
+        if (load->isAtomic())
+            OS << "   │         Ordering: " << toIRString(load->getOrdering()) << " ("
+               << skeleton::syncScopeName(I.getContext(), load->getSyncScopeID()) << ")\n";
+
+    } else if (auto *store = dyn_cast<StoreInst>(&I)) {
+        OS << "   │      📤 Store to Memory\n";
+        OS << "   │         Value: " << *store->getValueOperand() << "\n";
+        OS << "   │         Destination: " << *store->getPointerOperand() << "\n";
+        OS << "   │         Alignment: " << store->getAlign().value() << " bytes\n";
+        if (store->isAtomic())
+            OS << "   │         Ordering: " << toIRString(store->getOrdering()) << " ("
+               << skeleton::syncScopeName(I.getContext(), store->getSyncScopeID()) << ")\n";
+
+    } else if (auto *call = dyn_cast<CallInst>(&I)) {
+        if (call->getCalledFunction()) {
+            OS << "   │      📞 Function Call: " << call->getCalledFunction()->getName() << "()\n";
+            if (skeleton::LockPrimitive Lock =
+                    skeleton::classifyLockFunction(*call->getCalledFunction()))
+                OS << "   │         🔒 Lock: " << skeleton::lockKindName(Lock.Kind) << " ("
+                   << Lock.Name << ")\n";
+            OS << "   │         Arguments: " << call->arg_size() << "\n";
+
+            unsigned argNum = 0;
+            for (auto &arg : call->args()) {
+                argNum++;
+                OS << "   │         Arg " << argNum << ": " << *arg << "\n";
+            }
+
+            // Show function signature
+            OS << "   │         Target Function Signature:\n";
+            for (auto &param : call->getCalledFunction()->args()) {
+                OS << "   │           • " << (param.hasName() ? param.getName() : "unnamed") 
+                       << " : " << *param.getType() << "\n";
+            }
+        } else {
+            OS << "   │      📞 Indirect Function Call\n";
+            OS << "   │         Target: " << *call->getCalledOperand() << "\n";
+        }
+
+    } else if (auto *br = dyn_cast<BranchInst>(&I)) {
+        if (br->isConditional()) {
+            OS << "   │      🔀 Conditional Branch\n";
+            OS << "   │         Condition: " << *br->getCondition() << "\n";
+            OS << "   │         True Block: " << br->getSuccessor(0)->getName() << "\n";
+            OS << "   │         False Block: " << br->getSuccessor(1)->getName() << "\n";
+        } else {
+            OS << "   │      ➡️  Unconditional Branch\n";
+            OS << "   │         Target: " << br->getSuccessor(0)->getName() << "\n";
+        }
+
+    } else if (auto *ret = dyn_cast<ReturnInst>(&I)) {
+        if (ret->getReturnValue()) {
+            Value *retVal = ret->getReturnValue();
+            OS << "   │      🔙 Return Statement\n";
+            OS << "   │         Type: " << *retVal->getType() << "\n";
+
+            if (retVal->hasName()) {
+                OS << "   │         Value: " << retVal->getName() << "\n";
+            } else {
+                OS << "   │         Value: (unnamed temporary)\n";
+                if (auto *inst = dyn_cast<Instruction>(retVal)) {
+                    OS << "   │         Source: " << *inst << "\n";
+                } else if (auto *constant = dyn_cast<ConstantInt>(retVal)) {
+                    OS << "   │         Constant: " << constant->getSExtValue() << "\n";
+                }
+            }
+        } else {
+            OS << "   │      🔙 Return Statement (void)\n";
+        }
+
+    } else if (auto *cmp = dyn_cast<CmpInst>(&I)) {
+        OS << "   │      ⚖️  Comparison Instruction\n";
+        if (auto *icmp = dyn_cast<ICmpInst>(&I)) {
+            OS << "   │         Type: Integer Comparison\n";
+            OS << "   │         Predicate: ";
+            switch (icmp->getPredicate()) {
+                case CmpInst::ICMP_EQ:  OS << "Equal (==)"; break;
+                case CmpInst::ICMP_NE:  OS << "Not Equal (!=)"; break;
+                case CmpInst::ICMP_SGT: OS << "Signed Greater Than (>)"; break;
+                case CmpInst::ICMP_SGE: OS << "Signed Greater or Equal (>=)"; break;
+                case CmpInst::ICMP_SLT: OS << "Signed Less Than (<)"; break;
+                case CmpInst::ICMP_SLE: OS << "Signed Less or Equal (<=)"; break;
+                default: OS << "Other"; break;
+            }
+            OS << "\n";
+        }
+        OS << "   │         Left Operand: " << *cmp->getOperand(0) << "\n";
+        OS << "   │         Right Operand: " << *cmp->getOperand(1) << "\n";
+
+    } else if (auto *cast = dyn_cast<CastInst>(&I)) {
+        OS << "   │      🔄 Cast Operation: " << cast->getOpcodeName() << "\n";
+        OS << "   │         From: " << *cast->getSrcTy() << "\n";
+        OS << "   │         To: " << *cast->getDestTy() << "\n";
+        OS << "   │         Source: " << *cast->getOperand(0) << "\n";
+
+    } else if (auto *gep = dyn_cast<GetElementPtrInst>(&I)) {
+        OS << "   │      🧭 Address Computation (getelementptr)\n";
+        OS << "   │         Base: " << *gep->getPointerOperand() << "\n";
+        OS << "   │         Source Type: " << skeleton::typeName(gep->getSourceElementType()) << "\n";
+        SmallVector<skeleton::FieldRef, 4> Fields;
+        skeleton::decodeStructFields(*llvm::cast<GEPOperator>(gep), Fields);
+        for (const skeleton::FieldRef &FR : Fields) {
+            OS << "   │         Field: " << skeleton::typeName(FR.Struct) << " #" << FR.Field;
+            if (FR.Struct->isSized())
+                OS << " (offset " << DL.getStructLayout(FR.Struct)->getElementOffset(FR.Field)
+                   << ")";
+            OS << "\n";
+        }
+
+    } else if (auto *rmw = dyn_cast<AtomicRMWInst>(&I)) {
+        OS << "   │      ⚛️  Atomic Read-Modify-Write: "
+           << AtomicRMWInst::getOperationName(rmw->getOperation()) << "\n";
+        OS << "   │         Pointer: " << *rmw->getPointerOperand() << "\n";
+        OS << "   │         Value: " << *rmw->getValOperand() << "\n";
+        OS << "   │         Ordering: " << toIRString(rmw->getOrdering()) << "\n";
+        OS << "   │         Scope: " << skeleton::syncScopeName(I.getContext(), rmw->getSyncScopeID())
+           << "\n";
+
+    } else if (auto *cmpxchg = dyn_cast<AtomicCmpXchgInst>(&I)) {
+        OS << "   │      ⚛️  Atomic Compare-and-Swap" << (cmpxchg->isWeak() ? " (weak)" : "") << "\n";
+        OS << "   │         Pointer: " << *cmpxchg->getPointerOperand() << "\n";
+        OS << "   │         Expected: " << *cmpxchg->getCompareOperand() << "\n";
+        OS << "   │         New Value: " << *cmpxchg->getNewValOperand() << "\n";
+        OS << "   │         Ordering: " << toIRString(cmpxchg->getSuccessOrdering())
+           << " on success, " << toIRString(cmpxchg->getFailureOrdering()) << " on failure\n";
+        OS << "   │         Scope: "
+           << skeleton::syncScopeName(I.getContext(), cmpxchg->getSyncScopeID()) << "\n";
+
+    } else if (auto *fence = dyn_cast<FenceInst>(&I)) {
+        OS << "   │      🚧 Memory Fence\n";
+        OS << "   │         Ordering: " << toIRString(fence->getOrdering()) << "\n";
+        OS << "   │         Scope: " << skeleton::syncScopeName(I.getContext(), fence->getSyncScopeID())
+           << "\n";
+
+    } else if (auto *sw = dyn_cast<SwitchInst>(&I)) {
+        skeleton::SwitchShape Shape = skeleton::describeSwitch(*sw);
+        OS << "   │      🔀 Switch: " << Shape.NumCases << " cases, " << Shape.Destinations
+           << " destinations\n";
+        OS << "   │         Condition: " << *sw->getCondition() << "\n";
+        if (Shape.NumCases)
+            OS << "   │         Values: [" << toString(Shape.Min, 10, true) << ", "
+               << toString(Shape.Max, 10, true) << "], " << format("%.0f", Shape.Density * 100)
+               << "% dense\n";
+        OS << "   │         Default: " << sw->getDefaultDest()->getName() << "\n";
+
+    } else if (auto *ee = dyn_cast<ExtractElementInst>(&I)) {
+        OS << "   │      🧩 Lane Extract from " << *ee->getVectorOperandType() << "\n";
+        OS << "   │         Vector: " << *ee->getVectorOperand() << "\n";
+        OS << "   │         Lane: " << *ee->getIndexOperand() << "\n";
+
+    } else if (auto *ie = dyn_cast<InsertElementInst>(&I)) {
+        OS << "   │      🧩 Lane Insert into " << *ie->getType() << "\n";
+        OS << "   │         Vector: " << *ie->getOperand(0) << "\n";
+        OS << "   │         Value: " << *ie->getOperand(1) << "\n";
+        OS << "   │         Lane: " << *ie->getOperand(2) << "\n";
+
+    } else if (auto *sv = dyn_cast<ShuffleVectorInst>(&I)) {
+        OS << "   │      🧩 Shuffle (" << skeleton::shuffleKind(*sv) << "): "
+           << *sv->getOperand(0)->getType() << " → " << *sv->getType() << "\n";
+        OS << "   │         Operand 1: " << *sv->getOperand(0) << "\n";
+        OS << "   │         Operand 2: " << *sv->getOperand(1) << "\n";
+        OS << "   │         Mask: <";
+        ListSeparator LS(", ");
+        for (int Lane : sv->getShuffleMask())
+            OS << LS << (Lane < 0 ? std::string("poison") : std::to_string(Lane));
+        OS << ">\n";
+
+    } else if (auto *op = dyn_cast<Operator>(&I)) {
+        OS << "   │      ⚙️  Other Operator: " << I.getOpcodeName() << "\n";
+        OS << "   │         Operands: " << I.getNumOperands() << "\n";
+        for (unsigned i = 0; i < I.getNumOperands(); ++i) {
+            OS << "   │         Op[" << i << "]: " << *I.getOperand(i) << "\n";
+        }
+
+    } else {
+        OS << "   │      ❓ Unknown Instruction Type\n";
+        OS << "   │         Opcode: " << I.getOpcodeName() << "\n";
+    }
+}
+
+// Instruction categories, in the dispatch order of printInstructionDetail.
+enum Category {
+    CatBinary, CatAlloca, CatLoad, CatStore, CatCall, CatBranch,
+    CatReturn, CatCompare, CatCast, CatGEP, CatAtomic, CatSwitch, CatVector, CatOther,
+    CatUnknown,
+    NumCategories
+};
+
+const char *const CategoryNames[NumCategories] = {
+    "binary", "alloca", "load", "store", "call", "branch",
+    "return", "compare", "cast", "gep", "atomic", "switch", "vector", "other",
+    "unknown",
+};
+
+Category classify(Instruction &I) {
+    if (isa<BinaryOperator>(I)) return CatBinary;
+    if (isa<AllocaInst>(I)) return CatAlloca;
+    if (isa<LoadInst>(I)) return CatLoad;
+    if (isa<StoreInst>(I)) return CatStore;
+    if (isa<CallInst>(I)) return CatCall;
+    if (isa<BranchInst>(I)) return CatBranch;
+    if (isa<ReturnInst>(I)) return CatReturn;
+    if (isa<CmpInst>(I)) return CatCompare;
+    if (isa<CastInst>(I)) return CatCast;
+    if (isa<GetElementPtrInst>(I)) return CatGEP;
+    if (isa<AtomicRMWInst>(I) || isa<AtomicCmpXchgInst>(I) || isa<FenceInst>(I)) return CatAtomic;
+    if (isa<SwitchInst>(I)) return CatSwitch;
+    if (isa<ExtractElementInst>(I) || isa<InsertElementInst>(I) || isa<ShuffleVectorInst>(I))
+        return CatVector;
+    if (isa<Operator>(I)) return CatOther;
+    return CatUnknown;
+}
+
+// NDJSON counterpart of printInstructionDetail: the category-specific fields
+// of an "instruction" record.
+void emitInstructionDetail(json::OStream &J, Instruction &I, const DataLayout &DL) {
+    auto Operands = [&](const char *Key, User &U) {
+        J.attributeArray(Key, [&] {
+            for (Value *Op : U.operands())
+                J.value(operandString(Op));
+        });
+    };
+
+    J.attribute("category", CategoryNames[classify(I)]);
+    if (auto *binOp = dyn_cast<BinaryOperator>(&I)) {
+        Operands("operands", *binOp);
+        if (auto *VT = dyn_cast<VectorType>(binOp->getType())) {
+            J.attribute("lanes", VT->getElementCount().getKnownMinValue());
+            J.attribute("scalable", VT->getElementCount().isScalable());
+            J.attribute("bits",
+                        static_cast<int64_t>(DL.getTypeSizeInBits(VT).getKnownMinValue()));
+        }
+        if (isa<FPMathOperator>(binOp))
+            J.attributeArray("fast_math", [&] {
+                for (StringRef Flag : skeleton::fastMathFlagNames(binOp->getFastMathFlags()))
+                    J.value(Flag);
+            });
+    } else if (auto *alloca = dyn_cast<AllocaInst>(&I)) {
+        J.attribute("allocated_type", skeleton::typeName(alloca->getAllocatedType()));
+        if (auto Size = alloca->getAllocationSize(DL))
+            J.attribute("size", static_cast<int64_t>(Size->getKnownMinValue()));
+        J.attribute("align", static_cast<int64_t>(alloca->getAlign().value()));
+    } else if (auto *load = dyn_cast<LoadInst>(&I)) {
+        J.attribute("pointer", operandString(load->getPointerOperand()));
+        J.attribute("value_type", skeleton::typeName(load->getType()));
+        J.attribute("align", static_cast<int64_t>(load->getAlign().value()));
+        if (load->isAtomic()) {
+            J.attribute("ordering", toIRString(load->getOrdering()));
+            J.attribute("scope", skeleton::syncScopeName(I.getContext(), load->getSyncScopeID()));
+        }
+    } else if (auto *store = dyn_cast<StoreInst>(&I)) {
+        J.attribute("value", operandString(store->getValueOperand()));
+        J.attribute("pointer", operandString(store->getPointerOperand()));
+        J.attribute("align", static_cast<int64_t>(store->getAlign().value()));
+        if (store->isAtomic()) {
+            J.attribute("ordering", toIRString(store->getOrdering()));
+            J.attribute("scope", skeleton::syncScopeName(I.getContext(), store->getSyncScopeID()));
+        }
+    } else if (auto *call = dyn_cast<CallInst>(&I)) {
+        if (Function *Callee = call->getCalledFunction()) {
+            J.attribute("callee", Callee->getName());
+            if (skeleton::LockPrimitive Lock = skeleton::classifyLockFunction(*Callee))
+                J.attribute("lock", skeleton::lockKindName(Lock.Kind));
+        } else
+            J.attribute("callee", nullptr);
+        J.attribute("target", operandString(call->getCalledOperand()));
+        J.attributeArray("args", [&] {
+            for (auto &arg : call->args())
+                J.value(operandString(arg));
+        });
+    } else if (auto *br = dyn_cast<BranchInst>(&I)) {
+        J.attribute("conditional", br->isConditional());
+        if (br->isConditional())
+            J.attribute("condition", operandString(br->getCondition()));
+        J.attributeArray("successors", [&] {
+            for (BasicBlock *Succ : successors(br))
+                J.value(Succ->getName());
+        });
+    } else if (auto *ret = dyn_cast<ReturnInst>(&I)) {
+        if (Value *retVal = ret->getReturnValue())
+            J.attribute("value", operandString(retVal));
+        else
+            J.attribute("value", nullptr);
+    } else if (auto *cmp = dyn_cast<CmpInst>(&I)) {
+        J.attribute("predicate", CmpInst::getPredicateName(cmp->getPredicate()));
+        Operands("operands", *cmp);
+    } else if (auto *cast = dyn_cast<CastInst>(&I)) {
+        J.attribute("from", skeleton::typeName(cast->getSrcTy()));
+        J.attribute("to", skeleton::typeName(cast->getDestTy()));
+        J.attribute("source", operandString(cast->getOperand(0)));
+    } else if (auto *gep = dyn_cast<GetElementPtrInst>(&I)) {
+        J.attribute("base", operandString(gep->getPointerOperand()));
+        J.attribute("source_type", skeleton::typeName(gep->getSourceElementType()));
+        J.attributeArray("indices", [&] {
+            for (Value *Idx : gep->indices())
+                J.value(operandString(Idx));
+        });
+        SmallVector<skeleton::FieldRef, 4> Fields;
+        skeleton::decodeStructFields(*llvm::cast<GEPOperator>(gep), Fields);
+        J.attributeArray("fields", [&] {
+            for (const skeleton::FieldRef &FR : Fields)
+                J.object([&] {
+                    J.attribute("struct", skeleton::typeName(FR.Struct));
+                    J.attribute("field", FR.Field);
+                    if (FR.Struct->isSized())
+                        J.attribute("offset", static_cast<int64_t>(
+                            DL.getStructLayout(FR.Struct)->getElementOffset(FR.Field)));
+                });
+        });
+    } else if (auto *rmw = dyn_cast<AtomicRMWInst>(&I)) {
+        J.attribute("operation", AtomicRMWInst::getOperationName(rmw->getOperation()));
+        J.attribute("pointer", operandString(rmw->getPointerOperand()));
+        J.attribute("value", operandString(rmw->getValOperand()));
+        J.attribute("ordering", toIRString(rmw->getOrdering()));
+        J.attribute("scope", skeleton::syncScopeName(I.getContext(), rmw->getSyncScopeID()));
+        J.attribute("volatile", rmw->isVolatile());
+    } else if (auto *cmpxchg = dyn_cast<AtomicCmpXchgInst>(&I)) {
+        J.attribute("pointer", operandString(cmpxchg->getPointerOperand()));
+        J.attribute("expected", operandString(cmpxchg->getCompareOperand()));
+        J.attribute("new_value", operandString(cmpxchg->getNewValOperand()));
+        J.attribute("ordering", toIRString(cmpxchg->getSuccessOrdering()));
+        J.attribute("failure_ordering", toIRString(cmpxchg->getFailureOrdering()));
+        J.attribute("scope", skeleton::syncScopeName(I.getContext(), cmpxchg->getSyncScopeID()));
+        J.attribute("weak", cmpxchg->isWeak());
+        J.attribute("volatile", cmpxchg->isVolatile());
+    } else if (auto *fence = dyn_cast<FenceInst>(&I)) {
+        J.attribute("ordering", toIRString(fence->getOrdering()));
+        J.attribute("scope", skeleton::syncScopeName(I.getContext(), fence->getSyncScopeID()));
+    } else if (auto *sw = dyn_cast<SwitchInst>(&I)) {
+        skeleton::SwitchShape Shape = skeleton::describeSwitch(*sw);
+        J.attribute("condition", operandString(sw->getCondition()));
+        J.attribute("default", sw->getDefaultDest()->getName());
+        J.attributeArray("cases", [&] {
+            for (auto Case : sw->cases())
+                J.object([&] {
+                    J.attribute("value", toString(Case.getCaseValue()->getValue(), 10, true));
+                    J.attribute("dest", Case.getCaseSuccessor()->getName());
+                });
+        });
+        if (Shape.NumCases) {
+            J.attribute("range", static_cast<int64_t>(Shape.Range));
+            J.attribute("density", Shape.Density);
+        }
+    } else if (auto *ee = dyn_cast<ExtractElementInst>(&I)) {
+        J.attribute("vector", operandString(ee->getVectorOperand()));
+        J.attribute("lane", operandString(ee->getIndexOperand()));
+    } else if (auto *ie = dyn_cast<InsertElementInst>(&I)) {
+        J.attribute("vector", operandString(ie->getOperand(0)));
+        J.attribute("value", operandString(ie->getOperand(1)));
+        J.attribute("lane", operandString(ie->getOperand(2)));
+    } else if (auto *sv = dyn_cast<ShuffleVectorInst>(&I)) {
+        Operands("operands", *sv);
+        J.attribute("kind", skeleton::shuffleKind(*sv));
+        J.attributeArray("mask", [&] {
+            for (int Lane : sv->getShuffleMask())
+                J.value(Lane);
+        });
+    } else if (isa<Operator>(&I)) {
+        Operands("operands", I);
+    }
+}
+
+void emitArguments(json::OStream &J, Function &F) {
+    J.attributeArray("params", [&] {
+        for (auto &arg : F.args())
+            J.object([&] {
+                J.attribute("name", arg.getName());
+                J.attribute("type", skeleton::typeName(arg.getType()));
+            });
+    });
+}
+
+std::string absolutePath(StringRef Path) {
+    if (Path.empty() || Path == "-")
+        return Path.str();
+    SmallString<256> Abs(Path);
+    sys::fs::make_absolute(Abs);
+    sys::path::remove_dots(Abs, /*remove_dot_dot=*/true);
+    return std::string(Abs);
+}
+
+// The file this compilation writes, which tells apart translation units
+// built from one source with different flags. Clang runs cc1 inside the
+// driver process by default, so on Linux its -o is in /proc/self/cmdline.
+std::string compilerOutputFile() {
+    if (!ReportDBOutput.empty())
+        return ReportDBOutput;
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buf =
+        MemoryBuffer::getFileAsStream("/proc/self/cmdline");
+    if (!Buf)
+        return std::string();
+    SmallVector<StringRef, 64> Args;
+    (*Buf)->getBuffer().split(Args, '\0');
+    std::string Output;
+    for (size_t i = 0; i + 1 < Args.size(); ++i)
+        if (Args[i] == "-o")
+            Output = Args[i + 1].str();
+    return Output;
+}
+
+// The -skeleton-report-file stream, or null for stderr. Append is for passes
+// writing after the main report.
+std::unique_ptr<raw_fd_ostream> openReportFile(bool Append) {
+    if (ReportFile.empty())
+        return nullptr;
+    std::error_code EC;
+    auto File = std::make_unique<raw_fd_ostream>(
+        ReportFile, EC, Append ? sys::fs::OF_Append | sys::fs::OF_Text : sys::fs::OF_Text);
+    if (EC) {
+        WithColor::warning() << "skeleton: cannot open '" << ReportFile
+                             << "': " << EC.message() << "; using stderr\n";
+        return nullptr;
+    }
+    return File;
+}
+
 struct SkeletonPass : public PassInfoMixin<SkeletonPass> {
-    
+    // The level of the pipeline the pass runs in, for the inline threshold.
+    OptimizationLevel Level;
+
+    explicit SkeletonPass(OptimizationLevel Level) : Level(Level) {}
+
     PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
-        errs() << "\n";
-        errs() << "╔══════════════════════════════════════════════════════════════════════════════╗\n";
-        errs() << "║                           🔍 LLVM MODULE ANALYSIS                            ║\n";
-        errs() << "╚══════════════════════════════════════════════════════════════════════════════╝\n";
-        errs() << "📁 Module: " << M.getName() << "\n";
-        errs() << "══════════════════════════════════════════════════════════════════════════════\n\n";
+        std::unique_ptr<raw_fd_ostream> File = openReportFile(/*Append=*/false);
+        Report R(File ? *File : errs(), ReportFormatOpt);
+        R.setBudget(MaxReportBytes, std::chrono::milliseconds(MaxReportMs));
+        raw_ostream &OS = R.stream();
+        const DataLayout &DL = M.getDataLayout();
+        FunctionAnalysisManager &FAM =
+            AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+        ProfileSummaryInfo &PSI = AM.getResult<ProfileSummaryAnalysis>(M);
+
+        if (R.isText()) {
+            OS << "\n";
+            OS << "╔══════════════════════════════════════════════════════════════════════════════╗\n";
+            OS << "║                           🔍 LLVM MODULE ANALYSIS                            ║\n";
+            OS << "╚══════════════════════════════════════════════════════════════════════════════╝\n";
+            OS << "📁 Module: " << M.getName() << "\n";
+            OS << "══════════════════════════════════════════════════════════════════════════════\n\n";
+        } else {
+            R.record("module", [&](json::OStream &J) {
+                J.attribute("schema", skeleton::ReportSchemaVersion);
+                J.attribute("module", M.getModuleIdentifier());
+                J.attribute("source", M.getSourceFileName());
+                J.attribute("triple", M.getTargetTriple());
+            });
+        }
+
+        skeleton::ModuleRecord MR;
+        MR.ModuleID = M.getModuleIdentifier();
+        MR.SourceFile = absolutePath(M.getSourceFileName());
+        if (!ReportDBDir.empty())
+            MR.OutputFile = absolutePath(compilerOutputFile());
+
+        // Sampling only thins out the per-instruction details; these counts
+        // and the database records always cover every instruction.
+        DetailSampler Sampler(SampleRate, SampleSeed, SampleUnit, SampleMaxPerCategory,
+                              NumCategories);
+        uint64_t CategoryTotal[NumCategories] = {};
+        uint64_t CategoryShown[NumCategories] = {};
+
+        // Capped examples are chosen among all sampled instructions, so offer
+        // them all before the walk below prints any.
+        if (Sampler.isCapped())
+            for (Function &F : M) {
+                if (F.isDeclaration() || !Sampler.sampleFunction(F.getName()))
+                    continue;
+                unsigned BlockIndex = 0;
+                for (BasicBlock &BB : F) {
+                    ++BlockIndex;
+                    if (!Sampler.sampleBlock(F.getName(), BlockIndex))
+                        continue;
+                    unsigned InstIndex = 0;
+                    for (Instruction &I : BB)
+                        Sampler.addCandidate(classify(I), F.getName(), BlockIndex, ++InstIndex);
+                }
+            }
 
         for (Function &F : M) {
             // Skip function declarations (external functions)
             if (F.isDeclaration()) {
-                errs() << "📋 External Function Declaration: " << F.getName() << "()\n";
-                errs() << "   ↳ Return Type: " << *F.getReturnType() << "\n";
-                errs() << "   ↳ Parameters: " << F.arg_size() << "\n";
+                if (!R.withinBudget())
+                    continue;
+                if (!R.isText()) {
+                    R.record("function", [&](json::OStream &J) {
+                        J.attribute("name", F.getName());
+                        J.attribute("declaration", true);
+                        J.attribute("return_type", skeleton::typeName(F.getReturnType()));
+                        emitArguments(J, F);
+                    });
+                    continue;
+                }
+                OS << "📋 External Function Declaration: " << F.getName() << "()\n";
+                OS << "   ↳ Return Type: " << *F.getReturnType() << "\n";
+                OS << "   ↳ Parameters: " << F.arg_size() << "\n";
                 if (F.arg_size() > 0) {
                     for (auto &arg : F.args()) {
-                        errs() << "     • " << (arg.hasName() ? arg.getName() : "unnamed") 
-                               << " : " << *arg.getType() << "\n";
+                        OS << "     • " << (arg.hasName() ? arg.getName() : "unnamed") 
+                           << " : " << *arg.getType() << "\n";
                     }
                 }
-                errs() << "\n";
+                OS << "\n";
                 continue;
             }
 
-            errs() << "🔧 Function Definition: " << F.getName() << "()\n";
-            errs() << "   ↳ Return Type: " << *F.getReturnType() << "\n";
-            errs() << "   ↳ Parameters: " << F.arg_size() << "\n";
-            errs() << "   ↳ Basic Blocks: " << F.size() << "\n";
-            
-            if (F.arg_size() > 0) {
-                errs() << "   ↳ Function Arguments:\n";
-                for (auto &arg : F.args()) {
-                    errs() << "     • " << (arg.hasName() ? arg.getName() : "unnamed") 
+            skeleton::FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+
+            // Once the budget is spent the walk continues silently so that the
+            // summaries and database records remain complete.
+            bool FnShown = R.withinBudget();
+            bool FnSampled = FnShown && Sampler.sampleFunction(F.getName());
+            if (!FnShown) {
+                // Summary only.
+            } else if (R.isText()) {
+                OS << "🔧 Function Definition: " << F.getName() << "()\n";
+                OS << "   ↳ Return Type: " << *F.getReturnType() << "\n";
+                OS << "   ↳ Parameters: " << F.arg_size() << "\n";
+                OS << "   ↳ Basic Blocks: " << F.size() << "\n";
+                OS << "   ↳ Hotness: " << hotnessName(Prof.hotness());
+                if (Prof.hasProfile())
+                    OS << " (entry count " << Prof.entryCount() << ")";
+                OS << "\n";
+                
+                if (F.arg_size() > 0) {
+                    OS << "   ↳ Function Arguments:\n";
+                    for (auto &arg : F.args()) {
+                        OS << "     • " << (arg.hasName() ? arg.getName() : "unnamed") 
                            << " : " << *arg.getType() << "\n";
+                    }
                 }
+                if (!FnSampled)
+                    OS << "   ↳ Instruction details sampled out\n";
+                OS << "\n";
+            } else {
+                R.record("function", [&](json::OStream &J) {
+                    J.attribute("name", F.getName());
+                    J.attribute("declaration", false);
+                    J.attribute("return_type", skeleton::typeName(F.getReturnType()));
+                    emitArguments(J, F);
+                    J.attribute("blocks", static_cast<int64_t>(F.size()));
+                    J.attribute("sampled", FnSampled);
+                    J.attribute("hotness", hotnessName(Prof.hotness()));
+                    if (Prof.hasProfile())
+                        J.attribute("entry_count", static_cast<int64_t>(Prof.entryCount()));
+                });
             }
-            errs() << "\n";
+
+            const TargetTransformInfo *TTI =
+                ShowCosts ? &FAM.getResult<TargetIRAnalysis>(F) : nullptr;
+            skeleton::BlockCost FnCost;
+
+            skeleton::FunctionRecord FR;
+            FR.Name = F.getName().str();
+            FR.Blocks = F.size();
+            FR.Hotness = hotnessName(Prof.hotness()).str();
 
             unsigned bbCount = 0;
             for (BasicBlock &BB : F) {
                 bbCount++;
-                errs() << "   ┌─ Basic Block #" << bbCount << ": " 
+                double BlockCount = Prof.blockCount(BB);
+                skeleton::BlockCost Cost;
+                if (TTI) {
+                    Cost = skeleton::blockCost(BB, *TTI);
+                    FnCost += Cost.scaled(BlockCount);
+                }
+                bool BlockShown = FnSampled && R.withinBudget();
+                bool BlockSampled = BlockShown && Sampler.sampleBlock(F.getName(), bbCount);
+                if (!BlockShown) {
+                    // Still walked below so the aggregate counts stay exact.
+                } else if (R.isText()) {
+                    OS << "   ┌─ Basic Block #" << bbCount << ": " 
                        << (BB.hasName() ? BB.getName() : "unnamed") << "\n";
-                errs() << "   │  Instructions: " << BB.size() << "\n";
-                errs() << "   │\n";
+                    OS << "   │  Instructions: " << BB.size() << "\n";
+                    OS << "   │  Est. Executions: " << format("%.2f", BlockCount) << " ["
+                       << hotnessName(Prof.blockHotness(BB)) << "]\n";
+                    if (TTI)
+                        OS << "   │  Est. Cost: " << format("%.0f", Cost.Throughput)
+                           << " throughput, " << format("%.0f", Cost.Latency)
+                           << " latency per execution → "
+                           << format("%.1f", Cost.Throughput * BlockCount) << " / "
+                           << format("%.1f", Cost.Latency * BlockCount) << " weighted\n";
+                    if (!BlockSampled)
+                        OS << "   │  Details sampled out\n";
+                    OS << "   │\n";
+                } else {
+                    R.record("block", [&](json::OStream &J) {
+                        J.attribute("function", F.getName());
+                        J.attribute("index", bbCount);
+                        J.attribute("name", BB.getName());
+                        J.attribute("instructions", static_cast<int64_t>(BB.size()));
+                        J.attribute("sampled", BlockSampled);
+                        J.attribute("executions", BlockCount);
+                        J.attribute("hotness", hotnessName(Prof.blockHotness(BB)));
+                        if (TTI) {
+                            J.attribute("cost_throughput", Cost.Throughput);
+                            J.attribute("cost_latency", Cost.Latency);
+                        }
+                    });
+                }
 
                 unsigned instCount = 0;
                 for (Instruction &I : BB) {
                     instCount++;
-                    errs() << "   │  [" << instCount << "] " << I << "\n";
-
-                    // Check for different instruction types with detailed analysis
-                    if (auto *binOp = dyn_cast<BinaryOperator>(&I)) {
-                        errs() << "   │      🔧 Binary Operation: " << binOp->getOpcodeName() << "\n";
-                        errs() << "   │         Operand 1: " << *binOp->getOperand(0) << "\n";
-                        errs() << "   │         Operand 2: " << *binOp->getOperand(1) << "\n";
-                        
-                    } else if (auto *alloca = dyn_cast<AllocaInst>(&I)) {
-                        errs() << "   │      📦 Stack Allocation (alloca)\n";
-                        errs() << "   │         Type: " << *alloca->getAllocatedType() << "\n";
-                        errs() << "   │         Size: " << alloca->getAllocationSize(M.getDataLayout()) << " bytes\n";
-                        errs() << "   │         Alignment: " << alloca->getAlign().value() << " bytes\n";
-                        
-                    } else if (auto *load = dyn_cast<LoadInst>(&I)) {
-                        errs() << "   │      📥 Load from Memory\n";
-                        errs() << "   │         Source: " << *load->getPointerOperand() << "\n";
-                        errs() << "   │         Type: " << *load->getType() << "\n";
-                        errs() << "   │         Alignment: " << load->getAlign().value() << " bytes\n";
-                        
-                    } else if (auto *store = dyn_cast<StoreInst>(&I)) {
-                        errs() << "   │      📤 Store to Memory\n";
-                        errs() << "   │         Value: " << *store->getValueOperand() << "\n";
-                        errs() << "   │         Destination: " << *store->getPointerOperand() << "\n";
-                        errs() << "   │         Alignment: " << store->getAlign().value() << " bytes\n";
-                        
-                    } else if (auto *call = dyn_cast<CallInst>(&I)) {
-                        if (call->getCalledFunction()) {
-                            errs() << "   │      📞 Function Call: " << call->getCalledFunction()->getName() << "()\n";
-                            errs() << "   │         Arguments: " << call->arg_size() << "\n";
-                            
-                            unsigned argNum = 0;
-                            for (auto &arg : call->args()) {
-                                argNum++;
-                                errs() << "   │         Arg " << argNum << ": " << *arg << "\n";
-                            }
-                            
-                            // Show function signature
-                            errs() << "   │         Target Function Signature:\n";
-                            for (auto &param : call->getCalledFunction()->args()) {
-                                errs() << "   │           • " << (param.hasName() ? param.getName() : "unnamed") 
-                                       << " : " << *param.getType() << "\n";
-                            }
-                        } else {
-                            errs() << "   │      📞 Indirect Function Call\n";
-                            errs() << "   │         Target: " << *call->getCalledOperand() << "\n";
-                        }
-                        
-                    } else if (auto *br = dyn_cast<BranchInst>(&I)) {
-                        if (br->isConditional()) {
-                            errs() << "   │      🔀 Conditional Branch\n";
-                            errs() << "   │         Condition: " << *br->getCondition() << "\n";
-                            errs() << "   │         True Block: " << br->getSuccessor(0)->getName() << "\n";
-                            errs() << "   │         False Block: " << br->getSuccessor(1)->getName() << "\n";
-                        } else {
-                            errs() << "   │      ➡️  Unconditional Branch\n";
-                            errs() << "   │         Target: " << br->getSuccessor(0)->getName() << "\n";
-                        }
-                        
-                    } else if (auto *ret = dyn_cast<ReturnInst>(&I)) {
-                        if (ret->getReturnValue()) {
-                            Value *retVal = ret->getReturnValue();
-                            errs() << "   │      🔙 Return Statement\n";
-                            errs() << "   │         Type: " << *retVal->getType() << "\n";
-                            
-                            if (retVal->hasName()) {
-                                errs() << "   │         Value: " << retVal->getName() << "\n";
+                    // Tally the summary recorded in the report database.
+                    FR.Instructions++;
+                    FR.DynInstructions += BlockCount;
+                    if (isa<LoadInst>(I)) {
+                        FR.Loads++;
+                        FR.DynLoads += BlockCount;
+                    } else if (isa<StoreInst>(I)) {
+                        FR.Stores++;
+                        FR.DynStores += BlockCount;
+                    } else if (auto *CB = dyn_cast<CallBase>(&I)) {
+                        Function *Callee = CB->getCalledFunction();
+                        if (!Callee || !Callee->isIntrinsic()) {
+                            skeleton::CallSiteRecord CS;
+                            CS.Caller = FR.Name;
+                            CS.Block = BB.getName().str();
+                            CS.Index = instCount;
+                            raw_string_ostream(CS.CalleeType) << *CB->getFunctionType();
+                            FR.DynCalls += BlockCount;
+                            if (Callee) {
+                                FR.Calls++;
+                                CS.Callee = Callee->getName().str();
                             } else {
-                                errs() << "   │         Value: (unnamed temporary)\n";
-                                if (auto *inst = dyn_cast<Instruction>(retVal)) {
-                                    errs() << "   │         Source: " << *inst << "\n";
-                                } else if (auto *constant = dyn_cast<ConstantInt>(retVal)) {
-                                    errs() << "   │         Constant: " << constant->getSExtValue() << "\n";
-                                }
+                                FR.IndirectCalls++;
                             }
-                        } else {
-                            errs() << "   │      🔙 Return Statement (void)\n";
+                            MR.CallSites.push_back(std::move(CS));
                         }
-                        
-                    } else if (auto *cmp = dyn_cast<CmpInst>(&I)) {
-                        errs() << "   │      ⚖️  Comparison Instruction\n";
-                        if (auto *icmp = dyn_cast<ICmpInst>(&I)) {
-                            errs() << "   │         Type: Integer Comparison\n";
-                            errs() << "   │         Predicate: ";
-                            switch (icmp->getPredicate()) {
-                                case CmpInst::ICMP_EQ:  errs() << "Equal (==)"; break;
-                                case CmpInst::ICMP_NE:  errs() << "Not Equal (!=)"; break;
-                                case CmpInst::ICMP_SGT: errs() << "Signed Greater Than (>)"; break;
-                                case CmpInst::ICMP_SGE: errs() << "Signed Greater or Equal (>=)"; break;
-                                case CmpInst::ICMP_SLT: errs() << "Signed Less Than (<)"; break;
-                                case CmpInst::ICMP_SLE: errs() << "Signed Less or Equal (<=)"; break;
-                                default: errs() << "Other"; break;
-                            }
-                            errs() << "\n";
-                        }
-                        errs() << "   │         Left Operand: " << *cmp->getOperand(0) << "\n";
-                        errs() << "   │         Right Operand: " << *cmp->getOperand(1) << "\n";
-                        
-                    } else if (auto *cast = dyn_cast<CastInst>(&I)) {
-                        errs() << "   │      🔄 Cast Operation: " << cast->getOpcodeName() << "\n";
-                        errs() << "   │         From: " << *cast->getSrcTy() << "\n";
-                        errs() << "   │         To: " << *cast->getDestTy() << "\n";
-                        errs() << "   │         Source: " << *cast->getOperand(0) << "\n";
-                        
-                    } else if (auto *op = dyn_cast<Operator>(&I)) {
-                        errs() << "   │      ⚙️  Other Operator: " << I.getOpcodeName() << "\n";
-                        errs() << "   │         Operands: " << I.getNumOperands() << "\n";
-                        for (unsigned i = 0; i < I.getNumOperands(); ++i) {
-                            errs() << "   │         Op[" << i << "]: " << *I.getOperand(i) << "\n";
-                        }
-                        
+                    }
+
+                    Category Cat = classify(I);
+                    CategoryTotal[Cat]++;
+                    if (!BlockSampled || !R.withinBudget() || !Sampler.takeExample(Cat, F.getName(), bbCount, instCount))
+                        continue;
+                    CategoryShown[Cat]++;
+
+                    if (R.isText()) {
+                        OS << "   │  [" << instCount << "] " << I << "\n";
+                        printInstructionDetail(OS, I, DL);
+                        OS << "   │\n";
                     } else {
-                        errs() << "   │      ❓ Unknown Instruction Type\n";
-                        errs() << "   │         Opcode: " << I.getOpcodeName() << "\n";
+                        R.record("instruction", [&](json::OStream &J) {
+                            J.attribute("function", F.getName());
+                            J.attribute("block", bbCount);
+                            J.attribute("index", instCount);
+                            J.attribute("opcode", I.getOpcodeName());
+                            J.attribute("ir", StringRef(to_string(I)).ltrim());
+                            emitInstructionDetail(J, I, DL);
+                        });
                     }
-                    errs() << "   │\n";
                 }
                 
                 // Check if this is not the last basic block
-                if (&BB != &F.back()) {
-                    errs() << "   ├─────────────────────────────────────────────────────\n";
+                if (!R.isText() || !BlockShown) {
+                    continue;
+                } else if (&BB != &F.back()) {
+                    OS << "   ├─────────────────────────────────────────────────────\n";
                 } else {
-                    errs() << "   └─────────────────────────────────────────────────────\n";
+                    OS << "   └─────────────────────────────────────────────────────\n";
                 }
             }
             
-            errs() << "\n══════════════════════════════════════════════════════════════════════════════\n\n";
+            if (FnShown && R.isText()) {
+                OS << "   📈 Estimated Executions" << (Prof.hasProfile() ? "" : " (per call)")
+                   << ": " << format("%.1f", FR.DynInstructions) << " instructions, "
+                   << format("%.1f", FR.DynLoads) << " loads, "
+                   << format("%.1f", FR.DynStores) << " stores, "
+                   << format("%.1f", FR.DynCalls) << " calls\n";
+                if (TTI)
+                    OS << "   ⏱️  Estimated Cost" << (Prof.hasProfile() ? "" : " (per call)")
+                       << ": " << format("%.1f", FnCost.Throughput) << " throughput, "
+                       << format("%.1f", FnCost.Latency) << " latency\n";
+            } else if (FnShown) {
+                R.record("function_profile", [&](json::OStream &J) {
+                    J.attribute("function", F.getName());
+                    J.attribute("per_call", !Prof.hasProfile());
+                    J.attribute("dyn_instructions", FR.DynInstructions);
+                    J.attribute("dyn_loads", FR.DynLoads);
+                    J.attribute("dyn_stores", FR.DynStores);
+                    J.attribute("dyn_calls", FR.DynCalls);
+                    if (TTI) {
+                        J.attribute("dyn_cost_throughput", FnCost.Throughput);
+                        J.attribute("dyn_cost_latency", FnCost.Latency);
+                    }
+                });
+            }
+            if (R.isText() && FnShown)
+                OS << "\n══════════════════════════════════════════════════════════════════════════════\n\n";
+            MR.Functions.push_back(std::move(FR));
+        }
+
+        if (!ReportDBDir.empty()) {
+            if (Error E = skeleton::appendModuleRecord(ReportDBDir, MR))
+                WithColor::warning() << "skeleton: cannot update report database: "
+                                     << toString(std::move(E)) << "\n";
         }
 
-        errs() << "✅ Analysis Complete!\n";
-        errs() << "═══════════════════════════════════════════════════════════════════════════════\n\n";
+        if (ShowStructLayouts)
+            skeleton::reportStructLayouts(M, R, std::max(1u, unsigned(CacheLineSize)));
+        if (ShowFieldHeatMap)
+            skeleton::reportFieldHeatMap(M, FAM, PSI, R);
+        if (ShowFieldCoAccess)
+            skeleton::reportFieldCoAccess(M, FAM, PSI, R, std::max(1u, unsigned(CacheLineSize)));
+        if (ShowSoACandidates)
+            skeleton::reportSoACandidates(M, FAM, PSI, R, std::max(1u, unsigned(CacheLineSize)));
+        if (ShowAtomics)
+            skeleton::reportAtomics(M, FAM, PSI, R);
+        if (ShowLocks)
+            skeleton::reportLockSites(M, FAM, PSI, R);
+        if (ShowSwitches)
+            skeleton::reportSwitches(M, FAM, PSI, R);
+        if (ShowFloatingPoint)
+            skeleton::reportFloatingPoint(M, FAM, PSI, R);
+        if (ShowSimd)
+            skeleton::reportSimdUtilization(M, FAM, PSI, R, "pipeline_start");
+        if (ShowCosts)
+            skeleton::reportStaticCost(M, FAM, PSI, R, CostTop);
+        skeleton::reportTargetComparison(M, FAM, PSI, R, CompareCPUs, CompareMinGain);
+        if (ShowInlining)
+            skeleton::reportInlining(M, FAM, PSI, R,
+                                     getInlineParams(Level.getSpeedupLevel(), Level.getSizeLevel()),
+                                     InlineTop);
+        if (ShowRedundantLoads)
+            skeleton::reportRedundantLoads(M, FAM, PSI, R, "pipeline_start", RedundantLoadTop);
+        if (ShowNoAlias)
+            skeleton::reportNoAliasCandidates(M, FAM, PSI, R);
+        if (ShowGlobals)
+            skeleton::reportGlobals(M, FAM, PSI, R);
+        if (ShowFalseSharing)
+            skeleton::reportFalseSharing(M, R, std::max(1u, unsigned(CacheLineSize)));
+
+        // Transforms run last so that every section above describes the
+        // module as it came in.
+        bool Changed = false;
+        if (SplitStructs) {
+            // At 1 or more every field is cold and the hot part is only the link.
+            if (SplitColdRatio < 0 || SplitColdRatio >= 1)
+                WithColor::warning() << "skeleton: -skeleton-split-cold-ratio must be in [0, 1); "
+                                        "not splitting structs\n";
+            else
+                Changed |= skeleton::splitColdStructFields(M, FAM, PSI, R, SplitColdRatio);
+        }
+        if (AlignFalseSharing)
+            Changed |= skeleton::alignFalseSharingGlobals(M, R, std::max(1u, unsigned(CacheLineSize)));
+        if (AddNoAlias)
+            Changed |= skeleton::addNoAliasArguments(M, FAM, PSI, R);
+        if (!Multiversion.empty()) {
+            std::vector<std::string> CPUs(MultiversionCPUs.begin(), MultiversionCPUs.end());
+            if (CPUs.empty())
+                CPUs = {"x86-64-v3", "x86-64-v4"};
+            Changed |= skeleton::multiversionFunctions(M, FAM, PSI, R, Multiversion, CPUs,
+                                                       CompareMinGain);
+        }
+        if (PeelSwitches) {
+            skeleton::SiteProfile Profile;
+            if (!SwitchProfile.empty()) {
+                if (Expected<skeleton::SiteProfile> P = skeleton::readSiteProfile(
+                        SwitchProfile, "switch", M.getSourceFileName()))
+                    Profile = std::move(*P);
+                else
+                    WithColor::warning() << "skeleton: cannot read switch profile: "
+                                         << toString(P.takeError()) << "\n";
+            }
+            Changed |= skeleton::peelSwitchCases(M, R, Profile, PeelMinShare, PeelMaxCases);
+        }
+        // Switches are instrumented before the other sites so that their
+        // names match those peelSwitchCases() computes in a later build.
+        if (InstrumentSwitches)
+            Changed |= skeleton::instrumentSwitches(M, R);
+        if (InstrumentAtomics)
+            Changed |= skeleton::instrumentAtomics(M, R);
+        if (InstrumentLocks)
+            Changed |= skeleton::instrumentLocks(M, R);
+
+        // Per-call estimates of different functions are not comparable, so
+        // the ranking needs real profile counts.
+        if (R.isText() && PSI.hasProfileSummary()) {
+            std::vector<const skeleton::FunctionRecord *> Hottest;
+            for (const skeleton::FunctionRecord &FR : MR.Functions)
+                Hottest.push_back(&FR);
+            llvm::sort(Hottest, [](auto *A, auto *B) {
+                return A->DynInstructions > B->DynInstructions;
+            });
+            Hottest.resize(std::min<size_t>(Hottest.size(), 10));
+            OS << "🔥 Hottest Functions (executed instructions / loads / stores / calls)\n";
+            for (const skeleton::FunctionRecord *FR : Hottest)
+                OS << "   • " << FR->Name << " [" << FR->Hotness << "]: "
+                   << format("%.0f / %.0f / %.0f / %.0f", FR->DynInstructions, FR->DynLoads,
+                             FR->DynStores, FR->DynCalls)
+                   << "\n";
+            OS << "\n";
+        }
+
+        if (R.isText() && (!Sampler.isExhaustive() || R.isTruncated())) {
+            OS << "📊 Instruction Categories (detailed / total)\n";
+            for (unsigned C = 0; C < NumCategories; ++C)
+                if (CategoryTotal[C])
+                    OS << "   • " << CategoryNames[C] << ": " << CategoryShown[C]
+                       << " / " << CategoryTotal[C] << "\n";
+            OS << "\n";
+        } else if (!R.isText()) {
+            R.record("category_summary", [&](json::OStream &J) {
+                for (unsigned C = 0; C < NumCategories; ++C)
+                    J.attributeObject(CategoryNames[C], [&] {
+                        J.attribute("total", static_cast<int64_t>(CategoryTotal[C]));
+                        J.attribute("detailed", static_cast<int64_t>(CategoryShown[C]));
+                    });
+            });
+        }
+
+        if (R.isText()) {
+            OS << "✅ Analysis Complete!\n";
+            OS << "═══════════════════════════════════════════════════════════════════════════════\n\n";
+        } else {
+            R.record("module_end", [&](json::OStream &J) {
+                J.attribute("functions", static_cast<int64_t>(MR.Functions.size()));
+                J.attribute("truncated", R.isTruncated());
+            });
+        }
         
-        return PreservedAnalyses::all();
+        return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
     };
 };
 
+// Redundant loads again once the optimizer is done: those still there are the
+// ones GVN could not remove, mostly for lack of alias information. Appends
+// to the main report.
+struct LateRedundantLoadsPass : public PassInfoMixin<LateRedundantLoadsPass> {
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+        std::unique_ptr<raw_fd_ostream> File = openReportFile(/*Append=*/true);
+        Report R(File ? *File : errs(), ReportFormatOpt);
+        R.setBudget(MaxReportBytes, std::chrono::milliseconds(MaxReportMs));
+        FunctionAnalysisManager &FAM =
+            AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+        skeleton::reportRedundantLoads(M, FAM, AM.getResult<ProfileSummaryAnalysis>(M), R,
+                                       "optimizer_last", RedundantLoadTop);
+        return PreservedAnalyses::all();
+    }
+};
+
+// SIMD utilization again after the loop and SLP vectorizers, which only run
+// late in the pipeline: at pipeline start the section shows the vectors the
+// source wrote itself. Appends to the main report.
+struct LateSimdPass : public PassInfoMixin<LateSimdPass> {
+    PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
+        std::unique_ptr<raw_fd_ostream> File = openReportFile(/*Append=*/true);
+        Report R(File ? *File : errs(), ReportFormatOpt);
+        R.setBudget(MaxReportBytes, std::chrono::milliseconds(MaxReportMs));
+        FunctionAnalysisManager &FAM =
+            AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+        skeleton::reportSimdUtilization(M, FAM, AM.getResult<ProfileSummaryAnalysis>(M), R,
+                                        "optimizer_last");
+        return PreservedAnalyses::all();
+    }
+};
+
 }
 
 extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
@@ -208,7 +1151,14 @@ llvmGetPassPluginInfo() {
         .RegisterPassBuilderCallbacks = [](PassBuilder &PB) {
             PB.registerPipelineStartEPCallback(
                 [](ModulePassManager &MPM, OptimizationLevel Level) {
-                    MPM.addPass(SkeletonPass());
+                    MPM.addPass(SkeletonPass(Level));
+                });
+            PB.registerOptimizerLastEPCallback(
+                [](ModulePassManager &MPM, OptimizationLevel) {
+                    if (RedundantLoadsLate)
+                        MPM.addPass(LateRedundantLoadsPass());
+                    if (ShowSimd && SimdLate)
+                        MPM.addPass(LateSimdPass());
                 });
         }
     };
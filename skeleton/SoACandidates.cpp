@@ -0,0 +1,291 @@
+#include "Analyses.h"
+#include "Profile.h"
+#include "Report.h"
+#include "StructInfo.h"
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+
+#include <set>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// Elements bigger than this are not tracked byte by byte.
+constexpr uint64_t MaxElementSize = 4096;
+
+// One loop striding over an array of one struct type.
+struct SoACandidate {
+    StructType *Struct = nullptr;
+    std::string Where;      // function:loop header
+    uint64_t Stride = 0;    // bytes per iteration, the struct's alloc size
+    BitVector Bytes;        // bytes of an element read or written
+    BitVector Fields;       // top-level fields touched
+    unsigned Loads = 0;
+    unsigned Stores = 0;
+    double Iterations = 0;  // executions of the loop header
+    uint64_t Useful = 0;
+    uint64_t Fetched = 0;   // bytes brought into the cache per iteration
+
+    double wastedFraction() const { return Fetched ? 1.0 - double(Useful) / Fetched : 0; }
+    double wastedBytes() const { return Iterations * double(Fetched - Useful); }
+};
+
+// Marks the bytes of one ST element that a GEP stepping into ST addresses,
+// and returns the top-level field. A variable array index inside the element
+// marks the whole top-level field.
+bool markElementBytes(const GEPOperator &GEP, StructType *ST, uint64_t AccessSize,
+                      const DataLayout &DL, BitVector &Bytes, unsigned &TopField) {
+    const StructLayout *SL = DL.getStructLayout(ST);
+    bool Inside = false, Exact = true;
+    uint64_t Offset = 0;
+    for (gep_type_iterator GTI = gep_type_begin(GEP), E = gep_type_end(GEP); GTI != E; ++GTI) {
+        if (StructType *S = GTI.getStructTypeOrNull()) {
+            unsigned Field = cast<ConstantInt>(GTI.getOperand())->getZExtValue();
+            if (!Inside && S == ST) {
+                Inside = true;
+                TopField = Field;
+            }
+            if (Inside)
+                Offset += DL.getStructLayout(S)->getElementOffset(Field);
+        } else if (Inside) {
+            auto *C = dyn_cast<ConstantInt>(GTI.getOperand());
+            if (!C) {
+                Exact = false;
+                break;
+            }
+            uint64_t ElemSize = DL.getTypeAllocSize(GTI.getIndexedType()).getFixedValue();
+            Offset += C->getSExtValue() * ElemSize;
+        }
+    }
+    if (!Inside)
+        return false;
+
+    uint64_t Begin = Offset, End = Offset + AccessSize;
+    if (!Exact) {
+        Begin = SL->getElementOffset(TopField);
+        End = Begin + DL.getTypeAllocSize(ST->getElementType(TopField)).getFixedValue();
+    }
+    End = std::min<uint64_t>(End, Bytes.size());
+    if (Begin < End)
+        Bytes.set(Begin, End);
+    return true;
+}
+
+// Bytes an iteration pulls into the cache. Elements smaller than a line share
+// lines with their neighbours, so the whole array streams through; larger
+// ones only bring in the lines holding touched bytes (for line-aligned data).
+uint64_t fetchedBytes(const BitVector &Bytes, uint64_t Stride, unsigned CacheLine) {
+    if (Stride <= CacheLine)
+        return Stride;
+    std::set<uint64_t> Lines;
+    for (unsigned b : Bytes.set_bits())
+        Lines.insert(b / CacheLine);
+    return std::min<uint64_t>(Stride, Lines.size() * CacheLine);
+}
+
+class SoAFinder {
+public:
+    SoAFinder(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI)
+        : DL(M.getDataLayout()), FAM(FAM), PSI(PSI) {}
+
+    void visit(Function &F);
+
+    MapVector<std::pair<BasicBlock *, StructType *>, SoACandidate> Candidates;
+
+private:
+    void scan(Function &G, ScalarEvolution &SE, LoopInfo &LI, FunctionProfile &Prof,
+              function_ref<BasicBlock *(BasicBlock *)> Original, StringRef Name);
+
+    const DataLayout &DL;
+    FunctionAnalysisManager &FAM;
+    ProfileSummaryInfo &PSI;
+};
+
+void SoAFinder::visit(Function &F) {
+    if (FAM.getResult<LoopAnalysis>(F).empty())
+        return;
+    FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+
+    SmallVector<AllocaInst *, 16> Promotable;
+    for (Instruction &I : F.getEntryBlock())
+        if (auto *AI = dyn_cast<AllocaInst>(&I); AI && isAllocaPromotable(AI))
+            Promotable.push_back(AI);
+    if (Promotable.empty()) {
+        scan(F, FAM.getResult<ScalarEvolutionAnalysis>(F), FAM.getResult<LoopAnalysis>(F), Prof,
+             [](BasicBlock *BB) { return BB; }, F.getName());
+        return;
+    }
+
+    // Unoptimized code keeps induction variables in stack slots, where SCEV
+    // cannot follow them. Analyze a copy with the slots promoted instead; it
+    // has the same blocks, so weights and names map back one to one.
+    ValueToValueMapTy VMap;
+    Function *Copy = CloneFunction(&F, VMap);
+    DenseMap<BasicBlock *, BasicBlock *> Original;
+    for (BasicBlock &BB : F)
+        Original[cast<BasicBlock>(VMap[&BB])] = &BB;
+    SmallVector<AllocaInst *, 16> CopySlots;
+    for (AllocaInst *AI : Promotable)
+        CopySlots.push_back(cast<AllocaInst>(VMap[AI]));
+    {
+        DominatorTree DT(*Copy);
+        PromoteMemToReg(CopySlots, DT);
+        LoopInfo LI(DT);
+        AssumptionCache AC(*Copy);
+        ScalarEvolution SE(*Copy, FAM.getResult<TargetLibraryAnalysis>(F), AC, DT, LI);
+        scan(*Copy, SE, LI, Prof, [&](BasicBlock *BB) { return Original.lookup(BB); }, F.getName());
+    }
+    Copy->eraseFromParent();
+}
+
+void SoAFinder::scan(Function &G, ScalarEvolution &SE, LoopInfo &LI, FunctionProfile &Prof,
+                     function_ref<BasicBlock *(BasicBlock *)> Original, StringRef Name) {
+    SmallVector<FieldRef, 4> Fields;
+    for (BasicBlock &BB : G) {
+        if (!LI.getLoopFor(&BB))
+            continue;
+        for (Instruction &I : BB) {
+            Value *Ptr = getLoadStorePointerOperand(&I);
+            const GEPOperator *GEP = Ptr ? getAddressGEP(Ptr) : nullptr;
+            if (!GEP)
+                continue;
+            auto *AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(Ptr));
+            if (!AR || !AR->isAffine())
+                continue;
+            auto *Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+            if (!Step)
+                continue;
+            uint64_t Stride = Step->getAPInt().abs().getLimitedValue();
+
+            // The struct whose elements the loop steps over: the outermost
+            // one on the GEP path whose size equals the stride.
+            Fields.clear();
+            decodeStructFields(*GEP, Fields);
+            auto It = llvm::find_if(Fields, [&](const FieldRef &FR) {
+                return FR.Struct->isSized() &&
+                       DL.getTypeAllocSize(FR.Struct).getKnownMinValue() == Stride;
+            });
+            if (It == Fields.end() || Stride > MaxElementSize)
+                continue;
+            StructType *ST = It->Struct;
+            uint64_t AccessSize = DL.getTypeStoreSize(getLoadStoreType(&I)).getFixedValue();
+            if (AccessSize >= Stride)
+                continue;
+
+            BasicBlock *Header = Original(AR->getLoop()->getHeader());
+            SoACandidate &C = Candidates[{Header, ST}];
+            if (!C.Struct) {
+                C.Struct = ST;
+                C.Stride = Stride;
+                C.Bytes.resize(Stride);
+                C.Fields.resize(ST->getNumElements());
+                C.Iterations = Prof.blockCount(*Header);
+                C.Where = Name.str() + ":" +
+                          (Header->hasName() ? Header->getName().str() : std::string("loop"));
+            }
+            unsigned TopField;
+            if (!markElementBytes(*GEP, ST, AccessSize, DL, C.Bytes, TopField))
+                continue;
+            C.Fields.set(TopField);
+            (isa<StoreInst>(I) ? C.Stores : C.Loads)++;
+        }
+    }
+}
+
+} // namespace
+
+void reportSoACandidates(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                         Report &R, unsigned CacheLine) {
+    // Collected up front: the finder temporarily adds functions to M.
+    std::vector<Function *> Functions;
+    for (Function &F : M)
+        if (!F.isDeclaration())
+            Functions.push_back(&F);
+    SoAFinder Finder(M, FAM, PSI);
+    for (Function *F : Functions)
+        Finder.visit(*F);
+
+    std::vector<SoACandidate *> Ranked;
+    for (auto &[Key, C] : Finder.Candidates) {
+        C.Useful = C.Bytes.count();
+        C.Fetched = fetchedBytes(C.Bytes, C.Stride, CacheLine);
+        if (C.Useful && C.Useful < C.Fetched)
+            Ranked.push_back(&C);
+    }
+    if (Ranked.empty())
+        return;
+    llvm::stable_sort(Ranked, [](auto *A, auto *B) { return A->wastedBytes() > B->wastedBytes(); });
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🧮 AoS → SoA Candidates (loops striding over struct arrays, by wasted bytes"
+                   << (PerCall ? " per call" : "") << ")\n";
+
+    for (unsigned Rank = 1; Rank <= Ranked.size(); ++Rank) {
+        if (!R.withinBudget())
+            return;
+        const SoACandidate &C = *Ranked[Rank - 1];
+        if (!R.isText()) {
+            R.record("soa_candidate", [&](json::OStream &J) {
+                J.attribute("rank", Rank);
+                J.attribute("struct", typeName(C.Struct));
+                J.attribute("loop", C.Where);
+                J.attribute("stride", static_cast<int64_t>(C.Stride));
+                J.attributeArray("fields", [&] {
+                    for (unsigned f : C.Fields.set_bits())
+                        J.value(f);
+                });
+                J.attribute("loads", C.Loads);
+                J.attribute("stores", C.Stores);
+                J.attribute("useful_bytes", static_cast<int64_t>(C.Useful));
+                J.attribute("fetched_bytes", static_cast<int64_t>(C.Fetched));
+                J.attribute("wasted_fraction", C.wastedFraction());
+                J.attribute("iterations", C.Iterations);
+                J.attribute("wasted_bytes", C.wastedBytes());
+                J.attribute("per_call", PerCall);
+            });
+            continue;
+        }
+        if (Rank > 20) {
+            R.stream() << "   ... " << Ranked.size() - 20 << " more candidates\n";
+            break;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   ┌─ #" << Rank << " " << typeName(C.Struct) << " in " << C.Where << " (stride "
+           << C.Stride << " bytes, " << format("%.1f", C.Iterations) << " iterations)\n";
+        OS << "   │  Fields used: {";
+        ListSeparator LS(",");
+        for (unsigned f : C.Fields.set_bits())
+            OS << LS << f;
+        OS << "} of " << C.Struct->getNumElements() << ", " << C.Loads << " loads / " << C.Stores
+           << " stores in the loop\n";
+        OS << "   │  " << C.Useful << " of " << C.Fetched << " fetched bytes used, "
+           << format("%.0f%%", 100 * C.wastedFraction()) << " wasted ("
+           << format("%.0f", C.wastedBytes()) << " bytes)\n";
+        OS << "   └─────────────────────────────────────────────────────\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
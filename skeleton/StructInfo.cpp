@@ -0,0 +1,168 @@
+#include "StructInfo.h"
+#include "Profile.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <numeric>
+
+using namespace llvm;
+
+namespace skeleton {
+
+void decodeStructFields(const GEPOperator &GEP, SmallVectorImpl<FieldRef> &Fields) {
+    for (gep_type_iterator GTI = gep_type_begin(GEP), E = gep_type_end(GEP); GTI != E; ++GTI) {
+        // Struct indices are always constants: an integer, or a splat of one
+        // in a vector GEP.
+        if (StructType *ST = GTI.getStructTypeOrNull())
+            Fields.push_back({ST, static_cast<unsigned>(cast<Constant>(GTI.getOperand())
+                                                            ->getUniqueInteger()
+                                                            .getZExtValue())});
+    }
+}
+
+const GEPOperator *getAddressGEP(const Value *Ptr) {
+    while (auto *Cast = dyn_cast<Operator>(Ptr)) {
+        if (Cast->getOpcode() != Instruction::BitCast &&
+            Cast->getOpcode() != Instruction::AddrSpaceCast)
+            break;
+        Ptr = Cast->getOperand(0);
+    }
+    return dyn_cast<GEPOperator>(Ptr);
+}
+
+bool getAccessedField(const Value *Ptr, FieldRef &Field) {
+    const GEPOperator *GEP = getAddressGEP(Ptr);
+    if (!GEP)
+        return false;
+    SmallVector<FieldRef, 4> Fields;
+    decodeStructFields(*GEP, Fields);
+    if (Fields.empty())
+        return false;
+    Field = Fields.back();
+    return true;
+}
+
+StructLayoutInfo computeLayoutInfo(StructType *ST, const DataLayout &DL, unsigned CacheLine) {
+    const StructLayout *SL = DL.getStructLayout(ST);
+    StructLayoutInfo Info;
+    Info.Size = DL.getTypeAllocSize(ST).getFixedValue();
+    Info.Align = DL.getABITypeAlign(ST).value();
+
+    uint64_t End = 0;
+    for (unsigned i = 0, e = ST->getNumElements(); i != e; ++i) {
+        Type *Ty = ST->getElementType(i);
+        uint64_t Offset = SL->getElementOffset(i);
+        uint64_t Size = DL.getTypeAllocSize(Ty).getFixedValue();
+        if (Offset > End)
+            Info.Holes.push_back({End, Offset - End, i - 1});
+        if (Size && Offset / CacheLine != (Offset + Size - 1) / CacheLine)
+            Info.Straddling.push_back(i);
+        Info.Fields.push_back({Offset, Size, Ty});
+        End = std::max(End, Offset + Size);
+    }
+    Info.TailPadding = Info.Size > End ? Info.Size - End : 0;
+    Info.Padding = Info.TailPadding;
+    for (const PaddingHole &H : Info.Holes)
+        Info.Padding += H.Size;
+    Info.CacheLines = divideCeil(Info.Size, CacheLine);
+
+    // Laying fields out by decreasing alignment is the classic way to remove
+    // interior padding; its size is a lower bound worth reporting.
+    if (ST->isPacked()) {
+        Info.MinSize = Info.Size;
+        return Info;
+    }
+    std::vector<unsigned> Order(ST->getNumElements());
+    std::iota(Order.begin(), Order.end(), 0);
+    llvm::stable_sort(Order, [&](unsigned A, unsigned B) {
+        return DL.getABITypeAlign(ST->getElementType(A)) > DL.getABITypeAlign(ST->getElementType(B));
+    });
+    SmallVector<uint64_t, 16> Offsets;
+    Info.MinSize = layoutInOrder(ST, Order, DL, Offsets);
+    return Info;
+}
+
+uint64_t layoutInOrder(StructType *ST, ArrayRef<unsigned> Order, const DataLayout &DL,
+                       SmallVectorImpl<uint64_t> &Offsets) {
+    Offsets.assign(ST->getNumElements(), 0);
+    uint64_t Offset = 0;
+    Align MaxAlign(1);
+    for (unsigned i : Order) {
+        Type *Ty = ST->getElementType(i);
+        Align A = ST->isPacked() ? Align(1) : DL.getABITypeAlign(Ty);
+        MaxAlign = std::max(MaxAlign, A);
+        Offset = alignTo(Offset, A);
+        Offsets[i] = Offset;
+        Offset += DL.getTypeAllocSize(Ty).getFixedValue();
+    }
+    return alignTo(Offset, MaxAlign);
+}
+
+double StructAccessStats::weighted() const {
+    double Sum = 0;
+    for (const FieldAccessStats &FS : Fields)
+        Sum += FS.Weighted;
+    return Sum;
+}
+
+FieldAccessMap collectFieldAccesses(Module &M, FunctionAnalysisManager &FAM,
+                                    ProfileSummaryInfo &PSI) {
+    FieldAccessMap Map;
+    auto FieldStats = [&](StructType *ST, unsigned Field) -> FieldAccessStats & {
+        StructAccessStats &SS = Map[ST];
+        if (SS.Fields.empty())
+            SS.Fields.resize(ST->getNumElements());
+        return SS.Fields[Field];
+    };
+
+    SmallVector<FieldRef, 4> Fields;
+    auto Access = [&](Value *Ptr, Type *ValueTy, bool IsStore, double Weight) {
+        auto Count = [&](FieldAccessStats &FS) {
+            (IsStore ? FS.Stores : FS.Loads)++;
+            FS.Weighted += Weight;
+        };
+        Fields.clear();
+        if (const GEPOperator *GEP = getAddressGEP(Ptr))
+            decodeStructFields(*GEP, Fields);
+        for (const FieldRef &FR : Fields)
+            Count(FieldStats(FR.Struct, FR.Field));
+        if (auto *ST = dyn_cast<StructType>(ValueTy))
+            for (unsigned i = 0, e = ST->getNumElements(); i != e; ++i)
+                Count(FieldStats(ST, i));
+    };
+
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+        for (BasicBlock &BB : F) {
+            double Weight = Prof.blockCount(BB);
+            for (Instruction &I : BB) {
+                if (auto *GEP = dyn_cast<GEPOperator>(&I)) {
+                    Fields.clear();
+                    decodeStructFields(*GEP, Fields);
+                    for (const FieldRef &FR : Fields) {
+                        FieldStats(FR.Struct, FR.Field);
+                        Map[FR.Struct].GEPs++;
+                    }
+                } else if (auto *LI = dyn_cast<LoadInst>(&I)) {
+                    Access(LI->getPointerOperand(), LI->getType(), /*IsStore=*/false, Weight);
+                } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
+                    Access(SI->getPointerOperand(), SI->getValueOperand()->getType(),
+                           /*IsStore=*/true, Weight);
+                }
+            }
+        }
+    }
+    return Map;
+}
+
+} // namespace skeleton
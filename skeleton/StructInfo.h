@@ -0,0 +1,113 @@
+#ifndef SKELETON_STRUCTINFO_H
+#define SKELETON_STRUCTINFO_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/PassManager.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class DataLayout;
+class GEPOperator;
+class Module;
+class ProfileSummaryInfo;
+} // namespace llvm
+
+namespace skeleton {
+
+// A field of a struct type, as selected by one struct index of a GEP.
+struct FieldRef {
+    llvm::StructType *Struct;
+    unsigned Field;
+};
+
+// Appends every struct field the GEP steps into, outermost first. A GEP such
+// as `gep %Outer, ptr %p, i64 0, i32 2, i32 1` yields {Outer, 2}, {Inner, 1}.
+void decodeStructFields(const llvm::GEPOperator &GEP, llvm::SmallVectorImpl<FieldRef> &Fields);
+
+// The GEP computing Ptr, looking through pointer casts. Unlike
+// Value::stripPointerCasts() this keeps all-zero GEPs, which select field 0.
+const llvm::GEPOperator *getAddressGEP(const llvm::Value *Ptr);
+
+// The field a load or store through Ptr touches, i.e. the innermost struct
+// field of the GEP that computes Ptr. False if Ptr is not a struct GEP.
+bool getAccessedField(const llvm::Value *Ptr, FieldRef &Field);
+
+// Calls F for every struct type contained in T, looking through arrays and
+// struct members.
+template <typename Fn> void forEachContainedStruct(llvm::Type *T, Fn F) {
+    if (auto *ST = llvm::dyn_cast<llvm::StructType>(T)) {
+        F(ST);
+        for (llvm::Type *Elem : ST->elements())
+            forEachContainedStruct(Elem, F);
+    } else if (auto *AT = llvm::dyn_cast<llvm::ArrayType>(T)) {
+        forEachContainedStruct(AT->getElementType(), F);
+    }
+}
+
+struct FieldLayout {
+    uint64_t Offset;
+    uint64_t Size;
+    llvm::Type *Ty;
+};
+
+struct PaddingHole {
+    uint64_t Offset;
+    uint64_t Size;
+    unsigned AfterField;
+};
+
+// DataLayout view of a sized struct type, measured against a cache line.
+struct StructLayoutInfo {
+    uint64_t Size = 0;
+    uint64_t Align = 0;
+    std::vector<FieldLayout> Fields;
+    std::vector<PaddingHole> Holes;
+    uint64_t TailPadding = 0;
+    uint64_t Padding = 0;            // interior holes plus tail padding
+    uint64_t CacheLines = 0;         // lines spanned by one cache-aligned object
+    std::vector<unsigned> Straddling; // fields crossing a cache line boundary
+    uint64_t MinSize = 0;            // size with fields sorted by alignment
+};
+
+StructLayoutInfo computeLayoutInfo(llvm::StructType *ST, const llvm::DataLayout &DL,
+                                   unsigned CacheLine);
+
+// Lays ST's fields out in Order with their natural alignment, as the frontend
+// would for a struct declared that way. Fills Offsets (indexed by original
+// field number) and returns the padded size.
+uint64_t layoutInOrder(llvm::StructType *ST, llvm::ArrayRef<unsigned> Order,
+                       const llvm::DataLayout &DL, llvm::SmallVectorImpl<uint64_t> &Offsets);
+
+struct FieldAccessStats {
+    uint64_t Loads = 0;
+    uint64_t Stores = 0;
+    double Weighted = 0; // loads and stores weighted by estimated block executions
+
+    uint64_t accesses() const { return Loads + Stores; }
+};
+
+struct StructAccessStats {
+    std::vector<FieldAccessStats> Fields; // indexed by field number
+    uint64_t GEPs = 0;
+
+    double weighted() const;
+};
+
+using FieldAccessMap = llvm::MapVector<llvm::StructType *, StructAccessStats>;
+
+// Per-field load and store counts of every struct type in the module, static
+// and weighted by FunctionProfile::blockCount(). An access through a nested
+// field counts for every enclosing struct too, and a load or store of a whole
+// struct value counts once for each of its fields.
+FieldAccessMap collectFieldAccesses(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                                    llvm::ProfileSummaryInfo &PSI);
+
+} // namespace skeleton
+
+#endif // SKELETON_STRUCTINFO_H
@@ -0,0 +1,146 @@
+#include "Analyses.h"
+#include "Report.h"
+#include "StructInfo.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+struct StructUse {
+    uint64_t Allocas = 0;
+    uint64_t GEPs = 0;
+    uint64_t Loads = 0;
+    uint64_t Stores = 0;
+
+    uint64_t total() const { return Allocas + GEPs + Loads + Stores; }
+};
+
+MapVector<StructType *, StructUse> collectStructUses(Module &M) {
+    MapVector<StructType *, StructUse> Uses;
+    SmallVector<FieldRef, 4> Fields;
+    for (Function &F : M) {
+        for (Instruction &I : instructions(F)) {
+            if (auto *AI = dyn_cast<AllocaInst>(&I)) {
+                forEachContainedStruct(AI->getAllocatedType(),
+                                       [&](StructType *ST) { Uses[ST].Allocas++; });
+            } else if (auto *GEP = dyn_cast<GEPOperator>(&I)) {
+                Fields.clear();
+                decodeStructFields(*GEP, Fields);
+                for (const FieldRef &FR : Fields)
+                    Uses[FR.Struct].GEPs++;
+            } else if (auto *LI = dyn_cast<LoadInst>(&I)) {
+                FieldRef FR;
+                if (getAccessedField(LI->getPointerOperand(), FR))
+                    Uses[FR.Struct].Loads++;
+                if (auto *ST = dyn_cast<StructType>(LI->getType()))
+                    Uses[ST].Loads++;
+            } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
+                FieldRef FR;
+                if (getAccessedField(SI->getPointerOperand(), FR))
+                    Uses[FR.Struct].Stores++;
+                if (auto *ST = dyn_cast<StructType>(SI->getValueOperand()->getType()))
+                    Uses[ST].Stores++;
+            }
+        }
+    }
+    return Uses;
+}
+
+void printLayout(raw_ostream &OS, StructType *ST, const StructLayoutInfo &L,
+                 const StructUse &U, unsigned CacheLine) {
+    OS << "   ┌─ " << typeName(ST) << ": " << L.Size << " bytes, align " << L.Align << ", "
+       << L.Fields.size() << " fields, " << L.CacheLines << " cache line(s)\n";
+    OS << "   │  Accesses: " << U.Loads << " loads, " << U.Stores << " stores, " << U.GEPs
+       << " GEPs, " << U.Allocas << " allocas\n";
+    OS << "   │  Padding: " << L.Padding << " bytes";
+    if (!L.Holes.empty()) {
+        OS << " (holes:";
+        for (const PaddingHole &H : L.Holes)
+            OS << " " << H.Size << " @ " << H.Offset << " after field " << H.AfterField << ";";
+        OS << " tail: " << L.TailPadding << ")";
+    }
+    OS << "\n";
+    for (unsigned i : L.Straddling)
+        OS << "   │  ⚠️  Field " << i << " (offset " << L.Fields[i].Offset << ", "
+           << L.Fields[i].Size << " bytes) straddles a " << CacheLine << "-byte cache line\n";
+    if (L.MinSize < L.Size)
+        OS << "   │  Reordering fields by alignment would shrink it to " << L.MinSize
+           << " bytes\n";
+    OS << "   └─────────────────────────────────────────────────────\n";
+}
+
+void emitLayout(Report &R, StructType *ST, const StructLayoutInfo &L, const StructUse &U) {
+    R.record("struct_layout", [&](json::OStream &J) {
+        J.attribute("name", typeName(ST));
+        J.attribute("size", static_cast<int64_t>(L.Size));
+        J.attribute("align", static_cast<int64_t>(L.Align));
+        J.attributeArray("fields", [&] {
+            for (const FieldLayout &FL : L.Fields)
+                J.object([&] {
+                    J.attribute("offset", static_cast<int64_t>(FL.Offset));
+                    J.attribute("size", static_cast<int64_t>(FL.Size));
+                    J.attribute("type", typeName(FL.Ty));
+                });
+        });
+        J.attributeArray("holes", [&] {
+            for (const PaddingHole &H : L.Holes)
+                J.object([&] {
+                    J.attribute("offset", static_cast<int64_t>(H.Offset));
+                    J.attribute("size", static_cast<int64_t>(H.Size));
+                    J.attribute("after_field", H.AfterField);
+                });
+        });
+        J.attribute("tail_padding", static_cast<int64_t>(L.TailPadding));
+        J.attribute("padding", static_cast<int64_t>(L.Padding));
+        J.attribute("cache_lines", static_cast<int64_t>(L.CacheLines));
+        J.attributeArray("straddling", [&] {
+            for (unsigned i : L.Straddling)
+                J.value(i);
+        });
+        J.attribute("min_size", static_cast<int64_t>(L.MinSize));
+        J.attribute("allocas", static_cast<int64_t>(U.Allocas));
+        J.attribute("geps", static_cast<int64_t>(U.GEPs));
+        J.attribute("loads", static_cast<int64_t>(U.Loads));
+        J.attribute("stores", static_cast<int64_t>(U.Stores));
+    });
+}
+
+} // namespace
+
+void reportStructLayouts(Module &M, Report &R, unsigned CacheLine) {
+    const DataLayout &DL = M.getDataLayout();
+    auto Uses = collectStructUses(M);
+
+    std::vector<std::pair<StructType *, StructUse>> Sorted;
+    for (auto &[ST, U] : Uses)
+        if (ST->isSized() && !DL.getTypeAllocSize(ST).isScalable())
+            Sorted.emplace_back(ST, U);
+    if (Sorted.empty())
+        return;
+    // Most used first: these are the layouts worth fixing.
+    llvm::stable_sort(Sorted, [](auto &A, auto &B) { return A.second.total() > B.second.total(); });
+
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🧱 Struct Layouts (types reached by allocas, GEPs, loads and stores)\n";
+    for (auto &[ST, U] : Sorted) {
+        if (!R.withinBudget())
+            return;
+        StructLayoutInfo L = computeLayoutInfo(ST, DL, CacheLine);
+        if (R.isText())
+            printLayout(R.stream(), ST, L, U, CacheLine);
+        else
+            emitLayout(R, ST, L, U);
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
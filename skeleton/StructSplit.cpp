@@ -0,0 +1,754 @@
+#include "Report.h"
+#include "StructInfo.h"
+#include "Transforms.h"
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ReplaceConstant.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+bool containsStruct(Type *T, StructType *ST) {
+    bool Found = false;
+    forEachContainedStruct(T, [&](StructType *S) { Found |= S == ST; });
+    return Found;
+}
+
+// True for ST itself and for (nested) arrays of ST.
+bool isArrayOf(Type *T, StructType *ST) {
+    while (auto *AT = dyn_cast<ArrayType>(T))
+        T = AT->getElementType();
+    return T == ST;
+}
+
+// T with its ST elements replaced by To, for any T accepted by isArrayOf().
+Type *replaceElement(Type *T, StructType *ST, Type *To) {
+    if (T == ST)
+        return To;
+    auto *AT = cast<ArrayType>(T);
+    return ArrayType::get(replaceElement(AT->getElementType(), ST, To), AT->getNumElements());
+}
+
+uint64_t elementCount(Type *T) {
+    uint64_t N = 1;
+    for (; auto *AT = dyn_cast<ArrayType>(T); T = AT->getElementType())
+        N *= AT->getNumElements();
+    return N;
+}
+
+// False when a constant index from position FirstInner on is past the end of
+// the array it indexes. Variable indices are trusted to stay in bounds.
+bool indicesInRange(GetElementPtrInst &GEP, unsigned FirstInner) {
+    unsigned Pos = 0;
+    Type *Indexed = nullptr; // the aggregate the current index selects from
+    for (gep_type_iterator GTI = gep_type_begin(GEP), E = gep_type_end(GEP); GTI != E;
+         ++GTI, ++Pos) {
+        auto *AT = dyn_cast_or_null<ArrayType>(Indexed);
+        auto *Idx = dyn_cast<ConstantInt>(GTI.getOperand());
+        if (Pos >= FirstInner && AT && Idx && Idx->getValue().uge(AT->getNumElements()))
+            return false;
+        Indexed = GTI.getIndexedType();
+    }
+    return true;
+}
+
+// Globals are linked to their cold part in the initializer, one pointer per
+// element; bigger arrays are left alone.
+constexpr uint64_t MaxGlobalElements = 1 << 16;
+
+std::string functionOf(const Value *V) {
+    if (auto *I = dyn_cast<Instruction>(V))
+        return "@" + I->getFunction()->getName().str();
+    if (auto *A = dyn_cast<Argument>(V))
+        return "@" + A->getParent()->getName().str();
+    return "a constant";
+}
+
+// Proves that every object of ST is a static alloca or an internal global and
+// that every pointer to one is only used to address its fields, so that the
+// objects can be laid out differently without any code noticing.
+//
+// Object pointers are followed through GEPs that stay on an element, phis,
+// selects, arguments of internal functions whose callers all pass object
+// pointers, and stack slots (allocas of type ptr) that only ever hold them,
+// which is how unoptimized code keeps pointer variables. Field addresses may
+// be loaded from, stored to, offset and passed to memory intrinsics, as long
+// as every access stays inside the field: after the split the next field is
+// no longer next in memory. Anything else is treated as an escape.
+class SplitLegality {
+public:
+    SplitLegality(Module &M, StructType *ST) : M(M), ST(ST) {}
+
+    bool check();
+    const std::string &reason() const { return Reason; }
+    // Set when check() rewrote constant expressions, even if it then failed.
+    bool modifiedIR() const { return ModifiedIR; }
+
+    SmallVector<AllocaInst *, 8> Allocas;
+    SmallVector<GlobalVariable *, 4> Globals;
+    SmallVector<GetElementPtrInst *, 32> GEPs; // source type ST or an array of it
+    SmallVector<Instruction *, 8> DirectAccesses; // field 0 accessed through an object pointer
+    SmallVector<IntrinsicInst *, 8> Lifetimes;
+    DenseMap<Value *, Type *> Pointee; // object pointers; null when the type varies
+
+private:
+    bool reject(const Twine &Why) {
+        Reason = Why.str();
+        return false;
+    }
+    void track(Value *V, Type *Ty);
+    bool visitObjectPointer(Value *V);
+    bool visitSlot(AllocaInst *Slot);
+    bool visitFieldAddress(Value *V, Type *T);
+    bool fitsIn(Type *Access, Type *T) const {
+        const DataLayout &DL = M.getDataLayout();
+        return DL.getTypeStoreSize(Access).getFixedValue() <=
+               DL.getTypeAllocSize(T).getFixedValue();
+    }
+    bool isObjectPointer(Value *V) const {
+        return Pointee.count(V) || isa<ConstantPointerNull>(V) || isa<UndefValue>(V);
+    }
+    bool checkTypes();
+    bool checkInitializer(Constant *C, Type *T);
+
+    Module &M;
+    StructType *ST;
+    std::string Reason;
+    bool ModifiedIR = false;
+    SmallVector<Value *, 32> Worklist;
+    SmallPtrSet<GetElementPtrInst *, 32> Visited;
+    DenseMap<Value *, Type *> FieldAddresses; // the type each one points to
+    SmallPtrSet<AllocaInst *, 8> Slots;
+    SmallVector<Value *, 8> SlotStores; // values stored to slots
+    SmallVector<Instruction *, 8> Merges; // tracked phis and selects
+    SetVector<std::pair<Function *, unsigned>> Params;
+    SmallVector<GetElementPtrInst *, 32> AllGEPs;
+};
+
+void SplitLegality::track(Value *V, Type *Ty) {
+    auto [It, New] = Pointee.try_emplace(V, Ty);
+    if (New)
+        Worklist.push_back(V);
+    else if (It->second != Ty)
+        It->second = nullptr;
+}
+
+bool SplitLegality::checkInitializer(Constant *C, Type *T) {
+    auto *AT = dyn_cast<ArrayType>(T);
+    uint64_t N = AT ? AT->getNumElements() : ST->getNumElements();
+    for (uint64_t i = 0; i != N; ++i) {
+        Constant *Elem = C->getAggregateElement(i);
+        if (!Elem || (AT && !checkInitializer(Elem, AT->getElementType())))
+            return false;
+    }
+    return true;
+}
+
+// Finds every object of ST and rejects any other appearance of the type.
+bool SplitLegality::checkTypes() {
+    for (StructType *Other : M.getIdentifiedStructTypes())
+        if (Other != ST && containsStruct(Other, ST))
+            return reject("embedded in " + typeName(Other));
+
+    for (GlobalVariable &GV : M.globals()) {
+        Type *T = GV.getValueType();
+        if (!containsStruct(T, ST))
+            continue;
+        if (!isArrayOf(T, ST))
+            return reject("embedded in global @" + GV.getName());
+        if (!GV.hasLocalLinkage() || !GV.hasDefinitiveInitializer())
+            return reject("global @" + GV.getName() + " is visible outside the module");
+        if (GV.getAddressSpace() != 0)
+            return reject("global @" + GV.getName() + " is not in address space 0");
+        // Each hot element gets its own pointer in the initializer.
+        if (elementCount(T) > MaxGlobalElements)
+            return reject("global @" + GV.getName() + " has too many elements");
+        if (!checkInitializer(GV.getInitializer(), T))
+            return reject("unsupported initializer of @" + GV.getName());
+        Globals.push_back(&GV);
+    }
+
+    static const Attribute::AttrKind TypeAttrs[] = {
+        Attribute::ByVal, Attribute::StructRet, Attribute::ByRef,
+        Attribute::InAlloca, Attribute::Preallocated, Attribute::ElementType};
+    auto HasTypeAttr = [&](auto GetAttr, unsigned NumArgs) {
+        for (unsigned i = 0; i != NumArgs; ++i)
+            for (Attribute::AttrKind Kind : TypeAttrs) {
+                Attribute A = GetAttr(i, Kind);
+                if (A.isValid() && A.getValueAsType() && containsStruct(A.getValueAsType(), ST))
+                    return true;
+            }
+        return false;
+    };
+
+    for (Function &F : M) {
+        FunctionType *FT = F.getFunctionType();
+        if (containsStruct(FT->getReturnType(), ST) ||
+            llvm::any_of(FT->params(), [&](Type *P) { return containsStruct(P, ST); }) ||
+            HasTypeAttr([&](unsigned i, Attribute::AttrKind K) { return F.getParamAttribute(i, K); },
+                        F.arg_size()))
+            return reject("passed by value to @" + F.getName());
+
+        for (Instruction &I : instructions(F)) {
+            if (auto *AI = dyn_cast<AllocaInst>(&I)) {
+                Type *T = AI->getAllocatedType();
+                if (!containsStruct(T, ST))
+                    continue;
+                if (!isArrayOf(T, ST))
+                    return reject("embedded in a local of @" + F.getName());
+                if (!AI->isStaticAlloca() || AI->isArrayAllocation() || AI->getAddressSpace() != 0)
+                    return reject("dynamic alloca in @" + F.getName());
+                Allocas.push_back(AI);
+                continue;
+            }
+            if (isa<GetElementPtrInst>(&I))
+                continue;
+            if (containsStruct(I.getType(), ST) ||
+                llvm::any_of(I.operands(), [&](Value *Op) { return containsStruct(Op->getType(), ST); }))
+                return reject("used as a value in @" + F.getName());
+            if (auto *CB = dyn_cast<CallBase>(&I))
+                if (HasTypeAttr([&](unsigned i, Attribute::AttrKind K) { return CB->getParamAttr(i, K); },
+                                CB->arg_size()))
+                    return reject("passed by value in @" + F.getName());
+        }
+    }
+    if (Allocas.empty() && Globals.empty())
+        return reject("no statically allocated objects");
+    return true;
+}
+
+bool SplitLegality::visitObjectPointer(Value *V) {
+    for (Use &U : V->uses()) {
+        User *Usr = U.getUser();
+        if (auto *GEP = dyn_cast<GetElementPtrInst>(Usr)) {
+            if (U.getOperandNo() != GEP->getPointerOperandIndex() ||
+                !isArrayOf(GEP->getSourceElementType(), ST) || GEP->getType()->isVectorTy())
+                return reject("pointer arithmetic in " + functionOf(GEP));
+            Visited.insert(GEP);
+            GEPs.push_back(GEP);
+            Type *Result = GEP->getResultElementType();
+            if (isArrayOf(Result, ST))
+                track(GEP, Result);
+            else if (!indicesInRange(*GEP, /*FirstInner=*/1))
+                return reject("index past the end of a field in " + functionOf(GEP));
+            else if (!visitFieldAddress(GEP, Result))
+                return false;
+        } else if (auto *LI = dyn_cast<LoadInst>(Usr)) {
+            if (!fitsIn(LI->getType(), ST->getElementType(0)))
+                return reject("load wider than the first field in " + functionOf(LI));
+            DirectAccesses.push_back(LI);
+        } else if (auto *SI = dyn_cast<StoreInst>(Usr)) {
+            if (U.getOperandNo() == SI->getPointerOperandIndex()) {
+                if (!fitsIn(SI->getValueOperand()->getType(), ST->getElementType(0)))
+                    return reject("store wider than the first field in " + functionOf(SI));
+                DirectAccesses.push_back(SI);
+                continue;
+            }
+            auto *Slot = dyn_cast<AllocaInst>(SI->getPointerOperand());
+            if (!Slot || !Slot->getAllocatedType()->isPointerTy() || !Slot->isStaticAlloca())
+                return reject("pointer stored to memory in " + functionOf(SI));
+            if (!visitSlot(Slot))
+                return false;
+        } else if (isa<PHINode>(Usr) || isa<SelectInst>(Usr)) {
+            Merges.push_back(cast<Instruction>(Usr));
+            track(Usr, Pointee.lookup(V));
+        } else if (isa<ICmpInst>(Usr)) {
+            continue;
+        } else if (auto *II = dyn_cast<IntrinsicInst>(Usr); II && II->isLifetimeStartOrEnd()) {
+            Lifetimes.push_back(II);
+        } else if (auto *CB = dyn_cast<CallBase>(Usr)) {
+            Function *Callee = CB->getCalledFunction();
+            if (!Callee || Callee->isDeclaration() || !Callee->hasLocalLinkage() ||
+                !CB->isArgOperand(&U) || CB->getArgOperandNo(&U) >= Callee->arg_size())
+                return reject("escapes into a call in " + functionOf(CB));
+            unsigned No = CB->getArgOperandNo(&U);
+            if (CB->isPassPointeeByValueArgument(No) || CB->paramHasAttr(No, Attribute::ByRef) ||
+                CB->paramHasAttr(No, Attribute::StructRet))
+                return reject("passed by value in " + functionOf(CB));
+            Params.insert({Callee, No});
+            track(Callee->getArg(No), nullptr);
+        } else if (auto *I = dyn_cast<Instruction>(Usr)) {
+            return reject(Twine(I->getOpcodeName()) + " of an object pointer in " + functionOf(I));
+        } else {
+            return reject("address taken in a constant");
+        }
+    }
+    return true;
+}
+
+// A stack slot holding object pointers: its loads yield object pointers, and
+// after the walk every value stored to it must be one.
+bool SplitLegality::visitSlot(AllocaInst *Slot) {
+    if (!Slots.insert(Slot).second)
+        return true;
+    for (Use &U : Slot->uses()) {
+        User *Usr = U.getUser();
+        if (auto *LI = dyn_cast<LoadInst>(Usr)) {
+            if (!LI->getType()->isPointerTy())
+                return reject("pointer slot reinterpreted in " + functionOf(LI));
+            track(LI, nullptr);
+        } else if (auto *SI = dyn_cast<StoreInst>(Usr);
+                   SI && U.getOperandNo() == SI->getPointerOperandIndex()) {
+            SlotStores.push_back(SI->getValueOperand());
+        } else if (auto *II = dyn_cast<IntrinsicInst>(Usr); II && II->isLifetimeStartOrEnd()) {
+            continue;
+        } else {
+            return reject("pointer slot escapes in " + functionOf(Slot));
+        }
+    }
+    return true;
+}
+
+// V points to a T inside a field. Accesses through it must not leave T.
+bool SplitLegality::visitFieldAddress(Value *V, Type *T) {
+    auto [It, New] = FieldAddresses.try_emplace(V, T);
+    if (!New) {
+        if (It->second != T)
+            return reject("addresses in different parts of a field merged in " + functionOf(V));
+        return true;
+    }
+    for (Use &U : V->uses()) {
+        User *Usr = U.getUser();
+        if (isa<ICmpInst>(Usr))
+            continue;
+        if (auto *LI = dyn_cast<LoadInst>(Usr)) {
+            if (!fitsIn(LI->getType(), T))
+                return reject("load past the end of a field in " + functionOf(LI));
+            continue;
+        }
+        if (auto *MI = dyn_cast<MemIntrinsic>(Usr)) {
+            auto *Len = dyn_cast<ConstantInt>(MI->getLength());
+            if (!Len || Len->getValue().ugt(M.getDataLayout().getTypeAllocSize(T).getFixedValue()))
+                return reject(Twine(Len ? "" : "variable-length ") + MI->getCalledFunction()->getName() +
+                              " may run past the end of a field in " + functionOf(MI));
+            continue;
+        }
+        if (auto *SI = dyn_cast<StoreInst>(Usr)) {
+            if (U.getOperandNo() != SI->getPointerOperandIndex())
+                return reject("field address stored to memory in " + functionOf(SI));
+            if (!fitsIn(SI->getValueOperand()->getType(), T))
+                return reject("store past the end of a field in " + functionOf(SI));
+            continue;
+        }
+        if (auto *RMW = dyn_cast<AtomicRMWInst>(Usr)) {
+            if (U.getOperandNo() != RMW->getPointerOperandIndex())
+                return reject("field address stored to memory in " + functionOf(RMW));
+            if (!fitsIn(RMW->getValOperand()->getType(), T))
+                return reject("atomicrmw past the end of a field in " + functionOf(RMW));
+            continue;
+        }
+        if (auto *CX = dyn_cast<AtomicCmpXchgInst>(Usr)) {
+            if (U.getOperandNo() != CX->getPointerOperandIndex())
+                return reject("field address stored to memory in " + functionOf(CX));
+            if (!fitsIn(CX->getNewValOperand()->getType(), T))
+                return reject("cmpxchg past the end of a field in " + functionOf(CX));
+            continue;
+        }
+        if (auto *GEP = dyn_cast<GetElementPtrInst>(Usr)) {
+            if (U.getOperandNo() != GEP->getPointerOperandIndex())
+                return reject("field address used as an index in " + functionOf(GEP));
+            // Only indexing into T itself provably stays inside the field; a
+            // byte offset or a container_of step could reach another field.
+            auto *First = dyn_cast<ConstantInt>(GEP->getOperand(1));
+            if (GEP->getSourceElementType() != T || !First || !First->isZero() ||
+                GEP->getType()->isVectorTy() || !indicesInRange(*GEP, /*FirstInner=*/1))
+                return reject("pointer arithmetic on a field address in " + functionOf(GEP));
+            if (!visitFieldAddress(GEP, GEP->getResultElementType()))
+                return false;
+            continue;
+        }
+        if (isa<PHINode>(Usr) || isa<SelectInst>(Usr)) {
+            if (!visitFieldAddress(Usr, T))
+                return false;
+            continue;
+        }
+        return reject("field address escapes in " + functionOf(Usr));
+    }
+    return true;
+}
+
+bool SplitLegality::check() {
+    if (!checkTypes())
+        return false;
+
+    // Constant expressions over the globals become instructions so that the
+    // walk below sees, and the rewrite can change, every address computation.
+    SmallVector<Constant *, 4> GVs(Globals.begin(), Globals.end());
+    ModifiedIR = convertUsersOfConstantsToInstructions(GVs);
+
+    for (Function &F : M)
+        for (Instruction &I : instructions(F)) {
+            if (auto *GEP = dyn_cast<GetElementPtrInst>(&I);
+                GEP && containsStruct(GEP->getSourceElementType(), ST)) {
+                if (!isArrayOf(GEP->getSourceElementType(), ST))
+                    return reject("addressed through " + typeName(GEP->getSourceElementType()) +
+                                  " in @" + F.getName());
+                AllGEPs.push_back(GEP);
+            }
+            for (Value *Op : I.operands())
+                if (auto *CE = dyn_cast<GEPOperator>(Op);
+                    CE && !isa<Instruction>(CE) && containsStruct(CE->getSourceElementType(), ST))
+                    return reject("addressed by a constant expression in @" + F.getName());
+        }
+
+    for (AllocaInst *AI : Allocas)
+        track(AI, AI->getAllocatedType());
+    for (GlobalVariable *GV : Globals)
+        track(GV, GV->getValueType());
+    while (!Worklist.empty())
+        if (!visitObjectPointer(Worklist.pop_back_val()))
+            return false;
+
+    for (auto [F, No] : Params)
+        for (Use &U : F->uses()) {
+            auto *CB = dyn_cast<CallBase>(U.getUser());
+            if (!CB || !CB->isCallee(&U))
+                return reject("address of @" + F->getName() + " taken");
+            if (!isObjectPointer(CB->getArgOperand(No)))
+                return reject("@" + F->getName() + " also called with other pointers");
+        }
+    for (Instruction *I : Merges)
+        for (Value *Op : I->operands())
+            if (Op->getType()->isPointerTy() && !isObjectPointer(Op))
+                return reject("merged with other pointers in " + functionOf(I));
+    for (Value *V : SlotStores)
+        if (!isObjectPointer(V))
+            return reject("pointer slot also holds other pointers in " + functionOf(V));
+    for (GetElementPtrInst *GEP : AllGEPs)
+        if (!Visited.count(GEP))
+            return reject("object of unknown origin addressed in " + functionOf(GEP));
+    for (Instruction *I : DirectAccesses) {
+        Value *Ptr = getLoadStorePointerOperand(I);
+        Type *Ty = Pointee.lookup(Ptr);
+        if (!Ty || getLoadStoreType(I) != ST->getElementType(0))
+            return reject("object accessed without a GEP in " + functionOf(I));
+    }
+    return true;
+}
+
+// The split layout: hot fields keep their relative order and are followed by
+// a pointer to the cold part.
+struct SplitTypes {
+    StructType *Hot = nullptr;
+    StructType *Cold = nullptr;
+    std::vector<bool> IsCold;
+    std::vector<unsigned> NewIndex; // index in Hot or Cold, per original field
+    unsigned ColdPtr = 0;
+};
+
+void makeElements(StructType *ST, const std::vector<bool> &IsCold, SmallVectorImpl<Type *> &Hot,
+                  SmallVectorImpl<Type *> &Cold) {
+    for (unsigned i = 0, e = ST->getNumElements(); i != e; ++i)
+        (IsCold[i] ? Cold : Hot).push_back(ST->getElementType(i));
+    Hot.push_back(PointerType::get(ST->getContext(), 0));
+}
+
+Value *createGEP(IRBuilder<> &B, Type *Ty, Value *Ptr, ArrayRef<Value *> Idx, bool InBounds,
+                 const Twine &Name = "") {
+    return InBounds ? B.CreateInBoundsGEP(Ty, Ptr, Idx, Name) : B.CreateGEP(Ty, Ptr, Idx, Name);
+}
+
+class StructSplitter {
+public:
+    StructSplitter(Module &M, StructType *ST, SplitTypes &T)
+        : M(M), DL(M.getDataLayout()), ST(ST), T(T) {}
+
+    void run(SplitLegality &L) {
+        for (Instruction *I : L.DirectAccesses)
+            rewriteDirectAccess(I, L.Pointee.lookup(getLoadStorePointerOperand(I)));
+        for (GetElementPtrInst *GEP : L.GEPs) {
+            Value *New = rewriteGEP(GEP);
+            New->takeName(GEP);
+            GEP->replaceAllUsesWith(New);
+            GEP->eraseFromParent();
+        }
+        for (IntrinsicInst *II : L.Lifetimes)
+            II->eraseFromParent();
+        for (AllocaInst *AI : L.Allocas)
+            splitAlloca(AI);
+        for (GlobalVariable *GV : L.Globals)
+            splitGlobal(GV);
+    }
+
+private:
+    Value *rewriteGEP(GetElementPtrInst *GEP) {
+        IRBuilder<> B(GEP);
+        Type *Src = GEP->getSourceElementType();
+        SmallVector<Value *, 8> Idx(GEP->indices());
+        Value *Base = GEP->getPointerOperand();
+        bool InBounds = GEP->isInBounds();
+
+        // Skip the pointer index and any array indices to reach ST.
+        unsigned K = 1;
+        for (Type *Cur = Src; Cur != ST; Cur = cast<ArrayType>(Cur)->getElementType())
+            ++K;
+        Type *NewSrc = replaceElement(Src, ST, T.Hot);
+        if (K >= Idx.size())
+            return createGEP(B, NewSrc, Base, Idx, InBounds);
+
+        unsigned Field = cast<ConstantInt>(Idx[K])->getZExtValue();
+        SmallVector<Value *, 8> NewIdx(Idx.begin(), Idx.begin() + K);
+        ArrayRef<Value *> Rest = ArrayRef<Value *>(Idx).drop_front(K + 1);
+        if (!T.IsCold[Field]) {
+            NewIdx.push_back(B.getInt32(T.NewIndex[Field]));
+            NewIdx.append(Rest.begin(), Rest.end());
+            return createGEP(B, NewSrc, Base, NewIdx, InBounds);
+        }
+        NewIdx.push_back(B.getInt32(T.ColdPtr));
+        Value *Link = createGEP(B, NewSrc, Base, NewIdx, InBounds);
+        Type *PtrTy = T.Hot->getElementType(T.ColdPtr);
+        Value *Cold = B.CreateAlignedLoad(PtrTy, Link, DL.getABITypeAlign(PtrTy), "cold");
+        SmallVector<Value *, 8> ColdIdx = {B.getInt64(0), B.getInt32(T.NewIndex[Field])};
+        ColdIdx.append(Rest.begin(), Rest.end());
+        return B.CreateInBoundsGEP(T.Cold, Cold, ColdIdx);
+    }
+
+    // Field 0 loaded or stored through an object pointer, with no GEP.
+    void rewriteDirectAccess(Instruction *I, Type *Ty) {
+        Value *Ptr = getLoadStorePointerOperand(I);
+        SmallVector<Value *, 4> Idx(1, ConstantInt::get(Type::getInt64Ty(M.getContext()), 0));
+        for (Type *Cur = Ty; Cur != ST; Cur = cast<ArrayType>(Cur)->getElementType())
+            Idx.push_back(Idx.front());
+        Idx.push_back(ConstantInt::get(Type::getInt32Ty(M.getContext()), 0));
+        auto *GEP = GetElementPtrInst::CreateInBounds(Ty, Ptr, Idx, "", I);
+        Value *New = rewriteGEP(GEP);
+        GEP->eraseFromParent();
+        I->setOperand(isa<StoreInst>(I) ? 1 : 0, New);
+    }
+
+    // Stores the address of each object's cold part into its hot part.
+    void linkColdParts(Value *Hot, Value *Cold, uint64_t Count, Instruction *InsertBefore) {
+        Type *PtrTy = T.Hot->getElementType(T.ColdPtr);
+        Align PtrAlign = DL.getABITypeAlign(PtrTy);
+        if (Count == 1) {
+            IRBuilder<> B(InsertBefore);
+            Value *Link = B.CreateInBoundsGEP(T.Hot, Hot, {B.getInt64(0), B.getInt32(T.ColdPtr)});
+            B.CreateAlignedStore(Cold, Link, PtrAlign);
+            return;
+        }
+        BasicBlock *Pre = InsertBefore->getParent();
+        BasicBlock *Exit = SplitBlock(Pre, InsertBefore);
+        BasicBlock *Body = BasicBlock::Create(M.getContext(), "split.link", Pre->getParent(), Exit);
+        Pre->getTerminator()->setSuccessor(0, Body);
+        IRBuilder<> B(Body);
+        PHINode *Idx = B.CreatePHI(B.getInt64Ty(), 2, "split.i");
+        Idx->addIncoming(B.getInt64(0), Pre);
+        Value *Part = B.CreateInBoundsGEP(T.Cold, Cold, Idx);
+        B.CreateAlignedStore(Part, B.CreateInBoundsGEP(T.Hot, Hot, {Idx, B.getInt32(T.ColdPtr)}),
+                             PtrAlign);
+        Value *Next = B.CreateNUWAdd(Idx, B.getInt64(1));
+        Idx->addIncoming(Next, Body);
+        B.CreateCondBr(B.CreateICmpULT(Next, B.getInt64(Count)), Body, Exit);
+    }
+
+    void splitAlloca(AllocaInst *AI) {
+        // New allocas go before the first non-alloca of the entry block so the
+        // linking code, which may split the block, can follow them.
+        BasicBlock &Entry = AI->getFunction()->getEntryBlock();
+        Instruction *IP = &*Entry.getFirstInsertionPt();
+        while (isa<AllocaInst>(IP))
+            IP = IP->getNextNode();
+
+        Type *Ty = AI->getAllocatedType();
+        Type *HotTy = replaceElement(Ty, ST, T.Hot);
+        Type *ColdTy = replaceElement(Ty, ST, T.Cold);
+        auto *Hot = new AllocaInst(HotTy, 0, nullptr,
+                                   std::max(AI->getAlign(), DL.getPrefTypeAlign(HotTy)), "", IP);
+        auto *Cold = new AllocaInst(ColdTy, 0, nullptr, DL.getPrefTypeAlign(ColdTy),
+                                    AI->getName() + ".cold", IP);
+        Hot->takeName(AI);
+        Hot->setDebugLoc(AI->getDebugLoc());
+        AI->replaceAllUsesWith(Hot);
+        AI->eraseFromParent();
+        linkColdParts(Hot, Cold, elementCount(Ty), IP);
+    }
+
+    Constant *splitInitializer(Constant *C, Type *Ty, GlobalVariable *ColdGV,
+                               SmallVectorImpl<Constant *> &Path, Constant *&ColdInit) {
+        if (Ty == ST) {
+            SmallVector<Constant *, 16> Hot, Cold;
+            for (unsigned i = 0, e = ST->getNumElements(); i != e; ++i)
+                (T.IsCold[i] ? Cold : Hot).push_back(C->getAggregateElement(i));
+            Hot.push_back(ConstantExpr::getInBoundsGetElementPtr(ColdGV->getValueType(), ColdGV, Path));
+            ColdInit = ConstantStruct::get(T.Cold, Cold);
+            return ConstantStruct::get(T.Hot, Hot);
+        }
+        auto *AT = cast<ArrayType>(Ty);
+        SmallVector<Constant *, 16> Hot, Cold;
+        for (uint64_t i = 0, e = AT->getNumElements(); i != e; ++i) {
+            Path.push_back(ConstantInt::get(Type::getInt64Ty(M.getContext()), i));
+            Constant *ColdElem = nullptr;
+            Hot.push_back(splitInitializer(C->getAggregateElement(i), AT->getElementType(), ColdGV,
+                                           Path, ColdElem));
+            Cold.push_back(ColdElem);
+            Path.pop_back();
+        }
+        ColdInit = ConstantArray::get(cast<ArrayType>(replaceElement(AT, ST, T.Cold)), Cold);
+        return ConstantArray::get(cast<ArrayType>(replaceElement(AT, ST, T.Hot)), Hot);
+    }
+
+    void splitGlobal(GlobalVariable *GV) {
+        Type *Ty = GV->getValueType();
+        auto *ColdGV = new GlobalVariable(M, replaceElement(Ty, ST, T.Cold), GV->isConstant(),
+                                          GV->getLinkage(), nullptr, GV->getName() + ".cold", GV);
+        auto *HotGV = new GlobalVariable(M, replaceElement(Ty, ST, T.Hot), GV->isConstant(),
+                                         GV->getLinkage(), nullptr, "", GV);
+        ColdGV->copyAttributesFrom(GV);
+        HotGV->copyAttributesFrom(GV);
+        // The pointer to the cold part may need more alignment than ST did.
+        HotGV->setAlignment(
+            std::max(GV->getAlign().valueOrOne(), DL.getPrefTypeAlign(HotGV->getValueType())));
+
+        SmallVector<Constant *, 4> Path(1, ConstantInt::get(Type::getInt64Ty(M.getContext()), 0));
+        Constant *ColdInit = nullptr;
+        HotGV->setInitializer(splitInitializer(GV->getInitializer(), Ty, ColdGV, Path, ColdInit));
+        ColdGV->setInitializer(ColdInit);
+
+        HotGV->takeName(GV);
+        GV->replaceAllUsesWith(HotGV);
+        GV->eraseFromParent();
+    }
+
+    Module &M;
+    const DataLayout &DL;
+    StructType *ST;
+    SplitTypes &T;
+};
+
+} // namespace
+
+bool splitColdStructFields(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                           Report &R, double ColdRatio) {
+    const DataLayout &DL = M.getDataLayout();
+    FieldAccessMap Map = collectFieldAccesses(M, FAM, PSI);
+    bool Changed = false;
+    bool HeaderDone = false;
+    // Functions whose cached analyses the rewrite leaves stale.
+    SmallPtrSet<Function *, 16> Touched;
+    auto Touch = [&](auto &Insts) {
+        for (auto *I : Insts)
+            Touched.insert(I->getFunction());
+    };
+
+    for (auto &[ST, SS] : Map) {
+        if (ST->isLiteral() || !ST->isSized() || DL.getTypeAllocSize(ST).isScalable() ||
+            ST->getNumElements() < 2)
+            continue;
+        double Max = 0;
+        for (const FieldAccessStats &FS : SS.Fields)
+            Max = std::max(Max, FS.Weighted);
+        if (Max <= 0)
+            continue;
+
+        SplitTypes T;
+        T.IsCold.resize(ST->getNumElements());
+        for (unsigned i = 0, e = ST->getNumElements(); i != e; ++i)
+            T.IsCold[i] = SS.Fields[i].Weighted <= ColdRatio * Max;
+        if (llvm::none_of(T.IsCold, [](bool C) { return C; }))
+            continue;
+
+        SmallVector<Type *, 16> HotElems, ColdElems;
+        makeElements(ST, T.IsCold, HotElems, ColdElems);
+        uint64_t Size = DL.getTypeAllocSize(ST).getFixedValue();
+        auto SizeOf = [&](ArrayRef<Type *> Elems) {
+            return DL.getTypeAllocSize(StructType::get(M.getContext(), Elems, ST->isPacked()))
+                .getFixedValue();
+        };
+        uint64_t HotSize = SizeOf(HotElems), ColdSize = SizeOf(ColdElems);
+
+        std::string Reason;
+        SplitLegality L(M, ST);
+        if (HotSize >= Size)
+            Reason = "hot part would not be smaller";
+        else if (!L.check())
+            Reason = L.reason();
+        if (L.modifiedIR()) {
+            Changed = true;
+            // The constant expressions turned into instructions now use the
+            // globals directly.
+            for (GlobalVariable *GV : L.Globals)
+                for (User *U : GV->users())
+                    if (auto *I = dyn_cast<Instruction>(U))
+                        Touched.insert(I->getFunction());
+        }
+
+        if (Reason.empty()) {
+            T.Hot = StructType::create(M.getContext(), HotElems, (ST->getName() + ".hot").str(),
+                                       ST->isPacked());
+            T.Cold = StructType::create(M.getContext(), ColdElems, (ST->getName() + ".cold").str(),
+                                        ST->isPacked());
+            T.ColdPtr = HotElems.size() - 1;
+            unsigned NumHot = 0, NumCold = 0;
+            for (bool C : T.IsCold)
+                T.NewIndex.push_back(C ? NumCold++ : NumHot++);
+            Touch(L.Allocas);
+            Touch(L.GEPs);
+            Touch(L.DirectAccesses);
+            Touch(L.Lifetimes);
+            StructSplitter(M, ST, T).run(L);
+            Changed = true;
+        }
+
+        if (!R.withinBudget())
+            continue;
+        if (!R.isText()) {
+            R.record("struct_split", [&](json::OStream &J) {
+                J.attribute("struct", typeName(ST));
+                J.attribute("split", Reason.empty());
+                if (!Reason.empty())
+                    J.attribute("reason", Reason);
+                J.attributeArray("cold_fields", [&] {
+                    for (unsigned i = 0, e = T.IsCold.size(); i != e; ++i)
+                        if (T.IsCold[i])
+                            J.value(i);
+                });
+                J.attribute("size", static_cast<int64_t>(Size));
+                J.attribute("hot_size", static_cast<int64_t>(HotSize));
+                J.attribute("cold_size", static_cast<int64_t>(ColdSize));
+                if (Reason.empty()) {
+                    J.attribute("objects", static_cast<int64_t>(L.Allocas.size() + L.Globals.size()));
+                    J.attribute("geps", static_cast<int64_t>(L.GEPs.size()));
+                }
+            });
+            continue;
+        }
+
+        raw_ostream &OS = R.stream();
+        if (!HeaderDone) {
+            OS << "✂️  Struct Splitting (cold fields moved to a side struct)\n";
+            HeaderDone = true;
+        }
+        OS << "   • " << typeName(ST) << ": cold fields {";
+        ListSeparator LS(",");
+        for (unsigned i = 0, e = T.IsCold.size(); i != e; ++i)
+            if (T.IsCold[i])
+                OS << LS << i;
+        OS << "}, " << Size << " → " << HotSize << " + " << ColdSize << " bytes";
+        if (Reason.empty())
+            OS << "; split " << L.Allocas.size() + L.Globals.size() << " objects, rewrote "
+               << L.GEPs.size() << " GEPs\n";
+        else
+            OS << "; kept: " << Reason << "\n";
+    }
+    if (HeaderDone)
+        R.stream() << "\n";
+    // Later transforms in the same run query these functions again.
+    for (Function *F : Touched)
+        FAM.invalidate(*F, PreservedAnalyses::none());
+    return Changed;
+}
+
+} // namespace skeleton
@@ -0,0 +1,370 @@
+#include "Switches.h"
+#include "Analyses.h"
+#include "Instrumentation.h"
+#include "Profile.h"
+#include "Report.h"
+#include "Transforms.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+#include <optional>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// Branch weights of a switch, one per successor (default first), if it
+// carries !prof branch_weights.
+bool getSwitchWeights(const SwitchInst &SI, SmallVectorImpl<uint64_t> &Weights) {
+    MDNode *MD = SI.getMetadata(LLVMContext::MD_prof);
+    if (!MD || MD->getNumOperands() != SI.getNumSuccessors() + 1)
+        return false;
+    auto *Name = dyn_cast<MDString>(MD->getOperand(0));
+    if (!Name || Name->getString() != "branch_weights")
+        return false;
+    for (unsigned i = 1; i < MD->getNumOperands(); ++i) {
+        auto *W = mdconst::dyn_extract<ConstantInt>(MD->getOperand(i));
+        if (!W)
+            return false;
+        Weights.push_back(W->getZExtValue());
+    }
+    return true;
+}
+
+// "default" for successor 0, "case V" for the others.
+std::string successorLabel(const SwitchInst &SI, unsigned Succ) {
+    if (Succ == 0)
+        return "default";
+    const ConstantInt *V = nullptr;
+    for (auto Case : SI.cases())
+        if (Case.getSuccessorIndex() == Succ)
+            V = Case.getCaseValue();
+    return "case " + toString(V->getValue(), 10, /*Signed=*/true);
+}
+
+// Hit counts scaled down to the 32-bit weights that !prof holds.
+SmallVector<uint32_t, 8> branchWeights(ArrayRef<uint64_t> Counts) {
+    uint64_t Max = Counts.empty() ? 0 : *std::max_element(Counts.begin(), Counts.end());
+    uint64_t Scale = Max / UINT32_MAX + 1;
+    SmallVector<uint32_t, 8> Weights;
+    for (uint64_t C : Counts)
+        Weights.push_back(uint32_t(C / Scale));
+    return Weights;
+}
+
+// Moves case V of SI into a compare-and-branch at the end of the switch's
+// block, which falls through to the switch in a new block. Hits is the count
+// of the case and Reaching that of everything reaching the switch.
+void peelCase(SwitchInst *SI, ConstantInt *V, uint64_t Hits, uint64_t Reaching) {
+    BasicBlock *BB = SI->getParent();
+    BasicBlock *Dest = SI->findCaseValue(V)->getCaseSuccessor();
+    BasicBlock *Rest = BB->splitBasicBlock(SI, "sw.rest");
+
+    Instruction *Br = BB->getTerminator();
+    IRBuilder<> B(Br);
+    Value *Is = B.CreateICmpEQ(SI->getCondition(), V, "sw.peel");
+    SmallVector<uint32_t, 8> W = branchWeights({Hits, Reaching - Hits});
+    B.CreateCondBr(Is, Dest, Rest, MDBuilder(BB->getContext()).createBranchWeights(W[0], W[1]));
+    Br->eraseFromParent();
+
+    // The new edge carries what the case edge did; Rest keeps its entries
+    // for any other cases that share Dest.
+    for (PHINode &Phi : Dest->phis())
+        Phi.addIncoming(Phi.getIncomingValueForBlock(Rest), BB);
+    Dest->removePredecessor(Rest, /*KeepOneInputPHIs=*/true);
+    SI->removeCase(SI->findCaseValue(V));
+}
+
+} // namespace
+
+SwitchShape describeSwitch(const SwitchInst &SI) {
+    SwitchShape S;
+    S.NumCases = SI.getNumCases();
+    SmallPtrSet<const BasicBlock *, 8> Dests;
+    for (unsigned i = 0; i < SI.getNumSuccessors(); ++i)
+        Dests.insert(SI.getSuccessor(i));
+    S.Destinations = Dests.size();
+    if (!S.NumCases)
+        return S;
+    for (auto Case : SI.cases()) {
+        const APInt &V = Case.getCaseValue()->getValue();
+        if (!S.Min.getBitWidth() || V.slt(S.Min))
+            S.Min = V;
+        if (!S.Max.getBitWidth() || V.sgt(S.Max))
+            S.Max = V;
+    }
+    uint64_t Span = (S.Max - S.Min).getLimitedValue(UINT64_MAX - 1);
+    S.Range = Span + 1;
+    S.Density = double(S.NumCases) / double(S.Range);
+    return S;
+}
+
+void reportSwitches(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI, Report &R) {
+    struct Site {
+        SwitchInst *SI;
+        SwitchShape Shape;
+        unsigned Clusters;
+        unsigned JumpTableSize;
+        double Executions;
+    };
+    std::vector<Site> Sites;
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        std::optional<FunctionProfile> Prof;
+        for (BasicBlock &BB : F) {
+            auto *SI = dyn_cast<SwitchInst>(BB.getTerminator());
+            if (!SI)
+                continue;
+            auto &BFI = FAM.getResult<BlockFrequencyAnalysis>(F);
+            if (!Prof)
+                Prof.emplace(F, PSI, BFI);
+            Site S{SI, describeSwitch(*SI)};
+            S.JumpTableSize = 0;
+            S.Clusters = FAM.getResult<TargetIRAnalysis>(F).getEstimatedNumberOfCaseClusters(
+                *SI, S.JumpTableSize, &PSI, &BFI);
+            S.Executions = Prof->blockCount(BB);
+            Sites.push_back(std::move(S));
+        }
+    }
+    if (Sites.empty())
+        return;
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🔀 Switches (" << Sites.size()
+                   << " switches; lowering estimated by the target, executions"
+                   << (PerCall ? " per call" : "") << ")\n";
+
+    for (const Site &S : Sites) {
+        if (!R.withinBudget())
+            return;
+        const SwitchShape &Sh = S.Shape;
+        // One cluster without a jump table is a range check, or a bit test
+        // when several case values fit in a machine word.
+        bool BitTest = Sh.NumCases > 1 && Sh.Range <= M.getDataLayout().getPointerSizeInBits();
+        const char *Lowering = !Sh.NumCases       ? "branch"
+                               : S.JumpTableSize  ? "jump_table"
+                               : S.Clusters > 1   ? "binary_search"
+                               : BitTest          ? "bit_test"
+                                                  : "compare";
+        SmallVector<uint64_t, 8> Weights;
+        bool HasWeights = getSwitchWeights(*S.SI, Weights);
+        unsigned Hottest = 0;
+        uint64_t TotalWeight = 0;
+        for (unsigned i = 0; i < Weights.size(); ++i) {
+            TotalWeight += Weights[i];
+            if (Weights[i] > Weights[Hottest])
+                Hottest = i;
+        }
+
+        if (!R.isText()) {
+            R.record("switch", [&](json::OStream &J) {
+                J.attribute("site", siteName(*S.SI));
+                J.attribute("type", typeName(S.SI->getCondition()->getType()));
+                J.attribute("cases", Sh.NumCases);
+                if (Sh.NumCases) {
+                    J.attribute("min", toString(Sh.Min, 10, /*Signed=*/true));
+                    J.attribute("max", toString(Sh.Max, 10, /*Signed=*/true));
+                    J.attribute("range", static_cast<int64_t>(Sh.Range));
+                    J.attribute("density", Sh.Density);
+                }
+                J.attribute("destinations", Sh.Destinations);
+                J.attribute("lowering", Lowering);
+                J.attribute("clusters", S.Clusters);
+                J.attribute("jump_table_size", S.JumpTableSize);
+                J.attribute("executions", S.Executions);
+                if (HasWeights)
+                    J.attributeArray("weights", [&] {
+                        for (uint64_t W : Weights)
+                            J.value(static_cast<int64_t>(W));
+                    });
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   • " << siteName(*S.SI) << "  " << *S.SI->getCondition()->getType() << ", "
+           << Sh.NumCases << " cases";
+        if (Sh.NumCases)
+            OS << " in [" << toString(Sh.Min, 10, true) << ", " << toString(Sh.Max, 10, true)
+               << "] (" << format("%.0f", Sh.Density * 100) << "% dense)";
+        OS << ", " << Sh.Destinations << " destinations → ";
+        if (S.JumpTableSize)
+            OS << "jump table (" << S.JumpTableSize << " entries)";
+        else if (S.Clusters > 1)
+            OS << S.Clusters << " clusters, binary search";
+        else if (BitTest)
+            OS << "bit test";
+        else
+            OS << Lowering;
+        OS << "  [" << format("%.1f", S.Executions) << " executions]";
+        if (HasWeights && TotalWeight)
+            OS << "  hottest: " << successorLabel(*S.SI, Hottest) << " ("
+               << format("%.0f", 100.0 * Weights[Hottest] / TotalWeight) << "%)";
+        OS << "\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+bool instrumentSwitches(Module &M, Report &R) {
+    // Names first: the counting blocks below renumber unnamed blocks.
+    std::vector<std::pair<SwitchInst *, std::string>> Switches;
+    for (Function &F : M)
+        for (BasicBlock &BB : F)
+            if (auto *SI = dyn_cast<SwitchInst>(BB.getTerminator()))
+                Switches.emplace_back(SI, siteName(*SI));
+
+    // One site per successor edge: "<switch> default", "<switch> case V".
+    SiteCounters Counters(M, "switch", {"hits"}, /*PerThread=*/true);
+    LLVMContext &Ctx = M.getContext();
+    for (auto &[SI, Name] : Switches) {
+        BasicBlock *BB = SI->getParent();
+        for (unsigned Succ = 0; Succ < SI->getNumSuccessors(); ++Succ) {
+            unsigned Site = Counters.addSite(Name + " " + successorLabel(*SI, Succ));
+            BasicBlock *Dest = SI->getSuccessor(Succ);
+            BasicBlock *Count = BasicBlock::Create(Ctx, "sw.count", BB->getParent(), Dest);
+            IRBuilder<> B(Count);
+            Counters.add(B, Counters.threadCounters(B), Site, 0, B.getInt64(1));
+            B.CreateBr(Dest);
+            SI->setSuccessor(Succ, Count);
+            // Several cases may share Dest; each moves one of BB's entries.
+            for (PHINode &Phi : Dest->phis())
+                Phi.setIncomingBlock(Phi.getBasicBlockIndex(BB), Count);
+        }
+    }
+    Counters.finish();
+    reportInstrumentation(R, "switch", Counters.size());
+    return !Switches.empty();
+}
+
+bool peelSwitchCases(Module &M, Report &R, const SiteProfile &Profile, double MinShare,
+                     unsigned MaxCases) {
+    // Names first: peeling splits blocks and renumbers unnamed ones.
+    std::vector<std::pair<SwitchInst *, std::string>> Switches;
+    for (Function &F : M)
+        for (BasicBlock &BB : F)
+            if (auto *SI = dyn_cast<SwitchInst>(BB.getTerminator()))
+                Switches.emplace_back(SI, siteName(*SI));
+
+    bool Changed = false;
+    bool HeaderDone = false;
+    for (auto &[SI, Name] : Switches) {
+        // Hits per successor, default first: from the run-time counts of
+        // instrumentSwitches() when the profile has them, else from !prof.
+        SmallVector<uint64_t, 8> Hits(SI->getNumSuccessors(), 0);
+        bool FromProfile = false;
+        for (unsigned Succ = 0; Succ < SI->getNumSuccessors(); ++Succ) {
+            auto It = Profile.find(Name + " " + successorLabel(*SI, Succ));
+            if (It == Profile.end())
+                continue;
+            Hits[Succ] = It->second.lookup("hits");
+            FromProfile = true;
+        }
+        if (!FromProfile) {
+            SmallVector<uint64_t, 8> Weights;
+            if (!getSwitchWeights(*SI, Weights))
+                continue;
+            Hits.assign(Weights.begin(), Weights.end());
+        }
+        uint64_t Total = 0;
+        for (uint64_t H : Hits)
+            Total += H;
+
+        DenseMap<ConstantInt *, uint64_t> CaseHits;
+        std::vector<std::pair<ConstantInt *, uint64_t>> Candidates;
+        for (auto Case : SI->cases()) {
+            CaseHits[Case.getCaseValue()] = Hits[Case.getSuccessorIndex()];
+            Candidates.emplace_back(Case.getCaseValue(), Hits[Case.getSuccessorIndex()]);
+        }
+        std::stable_sort(Candidates.begin(), Candidates.end(),
+                         [](const auto &A, const auto &B) { return A.second > B.second; });
+
+        // Hottest first, while each compare would be taken at least MinShare
+        // of the times it runs.
+        std::vector<std::pair<ConstantInt *, uint64_t>> Peeled;
+        uint64_t Reaching = Total;
+        std::string Reason;
+        if (!Total)
+            Reason = "never executed";
+        else if (SI->getNumCases() < 2)
+            Reason = "fewer than two cases";
+        for (auto &[V, H] : Candidates) {
+            if (!Reason.empty() || Peeled.size() >= MaxCases || !H ||
+                double(H) < MinShare * double(Reaching))
+                break;
+            peelCase(SI, V, H, Reaching);
+            Peeled.emplace_back(V, H);
+            CaseHits.erase(V);
+            Reaching -= H;
+        }
+        if (Reason.empty() && Peeled.empty())
+            Reason = "no dominant case";
+
+        if (!Peeled.empty()) {
+            // The switch now sees only what the compares let through.
+            SmallVector<uint64_t, 8> Left(SI->getNumSuccessors(), 0);
+            Left[0] = Hits[0];
+            for (auto Case : SI->cases())
+                Left[Case.getSuccessorIndex()] = CaseHits.lookup(Case.getCaseValue());
+            SI->setMetadata(LLVMContext::MD_prof,
+                            MDBuilder(M.getContext()).createBranchWeights(branchWeights(Left)));
+            Changed = true;
+        }
+
+        if (!R.withinBudget())
+            continue;
+        if (!R.isText()) {
+            R.record("switch_peel", [&](json::OStream &J) {
+                J.attribute("site", Name);
+                J.attribute("source", FromProfile ? "profile" : "weights");
+                J.attribute("hits", static_cast<int64_t>(Total));
+                J.attribute("peeled", !Peeled.empty());
+                if (!Reason.empty())
+                    J.attribute("reason", Reason);
+                J.attributeArray("cases", [&] {
+                    for (auto &[V, H] : Peeled)
+                        J.object([&] {
+                            J.attribute("value", toString(V->getValue(), 10, /*Signed=*/true));
+                            J.attribute("hits", static_cast<int64_t>(H));
+                        });
+                });
+                J.attribute("remaining_cases", SI->getNumCases());
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        if (!HeaderDone) {
+            OS << "🪓 Switch Case Peeling (dominant cases tested ahead of the switch)\n";
+            HeaderDone = true;
+        }
+        OS << "   • " << Name << "  " << Total << (FromProfile ? " hits" : " weight");
+        if (!Reason.empty()) {
+            OS << "; kept: " << Reason << "\n";
+            continue;
+        }
+        OS << "; peeled ";
+        ListSeparator LS(", ");
+        for (auto &[V, H] : Peeled)
+            OS << LS << "case " << toString(V->getValue(), 10, /*Signed=*/true) << " ("
+               << format("%.0f", 100.0 * H / Total) << "%)";
+        OS << ", " << SI->getNumCases() << " cases left in the switch\n";
+    }
+    if (HeaderDone)
+        R.stream() << "\n";
+    return Changed;
+}
+
+} // namespace skeleton
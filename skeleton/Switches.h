@@ -0,0 +1,27 @@
+#ifndef SKELETON_SWITCHES_H
+#define SKELETON_SWITCHES_H
+
+#include "llvm/ADT/APInt.h"
+
+#include <cstdint>
+
+namespace llvm {
+class SwitchInst;
+} // namespace llvm
+
+namespace skeleton {
+
+// The case values of a switch, as the lowering sees them.
+struct SwitchShape {
+    unsigned NumCases = 0;
+    llvm::APInt Min, Max; // signed extremes of the case values; unset without cases
+    uint64_t Range = 0;   // Max - Min + 1, saturated
+    double Density = 0;   // NumCases / Range
+    unsigned Destinations = 0; // distinct successors, default included
+};
+
+SwitchShape describeSwitch(const llvm::SwitchInst &SI);
+
+} // namespace skeleton
+
+#endif // SKELETON_SWITCHES_H
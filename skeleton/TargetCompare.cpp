@@ -0,0 +1,299 @@
+#include "TargetCompare.h"
+#include "Analyses.h"
+#include "Cost.h"
+#include "Profile.h"
+#include "Report.h"
+
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Analysis/VectorUtils.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <algorithm>
+#include <optional>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+// Compiles F for another CPU while alive: the CPU replaces F's target-cpu and
+// tune-cpu, and F's target-features are dropped so the CPU's own apply.
+class TargetOverride {
+public:
+    TargetOverride(Function &F, StringRef CPU) : F(F) {
+        for (StringRef Kind : {"target-cpu", "tune-cpu", "target-features"}) {
+            Saved.emplace_back(Kind, F.getFnAttribute(Kind));
+            F.removeFnAttr(Kind);
+        }
+        F.addFnAttr("target-cpu", CPU);
+    }
+    ~TargetOverride() {
+        for (const auto &[Kind, A] : Saved) {
+            F.removeFnAttr(Kind);
+            if (A.isValid())
+                F.addFnAttr(A);
+        }
+    }
+
+private:
+    Function &F;
+    SmallVector<std::pair<StringRef, Attribute>, 3> Saved;
+};
+
+bool isElementType(Type *Ty) { return Ty->isIntegerTy() || Ty->isFloatingPointTy(); }
+
+Type *widen(Type *Ty, unsigned VF) { return FixedVectorType::get(Ty, VF); }
+
+// Cost of VF copies of I as one vector instruction, or nullopt if I has no
+// vector form the vectorizer would use. Address arithmetic folds into the
+// memory operations, and branches stay scalar.
+std::optional<double> vectorCost(const Instruction &I, unsigned VF,
+                                 const TargetTransformInfo &TTI) {
+    constexpr auto Kind = TargetTransformInfo::TCK_RecipThroughput;
+    InstructionCost C;
+    if (isa<PHINode>(I) || isa<GetElementPtrInst>(I) || isa<DbgInfoIntrinsic>(I))
+        return 0.0;
+    if (isa<BranchInst>(I))
+        C = TTI.getInstructionCost(&I, Kind);
+    else if (isa<BinaryOperator>(I) || isa<UnaryOperator>(I)) {
+        if (!isElementType(I.getType()))
+            return std::nullopt;
+        C = TTI.getArithmeticInstrCost(I.getOpcode(), widen(I.getType(), VF), Kind);
+    } else if (auto *Cast = dyn_cast<CastInst>(&I)) {
+        if (!isElementType(Cast->getSrcTy()) || !isElementType(Cast->getDestTy()))
+            return std::nullopt;
+        C = TTI.getCastInstrCost(I.getOpcode(), widen(Cast->getDestTy(), VF),
+                                 widen(Cast->getSrcTy(), VF),
+                                 TargetTransformInfo::CastContextHint::None, Kind);
+    } else if (isa<CmpInst>(I) || isa<SelectInst>(I)) {
+        Type *ValTy = I.getOperand(isa<SelectInst>(I) ? 1 : 0)->getType();
+        if (!isElementType(ValTy))
+            return std::nullopt;
+        auto *Cmp = dyn_cast<CmpInst>(&I);
+        C = TTI.getCmpSelInstrCost(I.getOpcode(), widen(ValTy, VF),
+                                   widen(Type::getInt1Ty(I.getContext()), VF),
+                                   Cmp ? Cmp->getPredicate() : CmpInst::BAD_ICMP_PREDICATE,
+                                   Kind);
+    } else if (auto *Load = dyn_cast<LoadInst>(&I)) {
+        if (!Load->isSimple() || !isElementType(Load->getType()))
+            return std::nullopt;
+        C = TTI.getMemoryOpCost(Instruction::Load, widen(Load->getType(), VF),
+                                Load->getAlign(), Load->getPointerAddressSpace(), Kind);
+    } else if (auto *Store = dyn_cast<StoreInst>(&I)) {
+        Type *ValTy = Store->getValueOperand()->getType();
+        if (!Store->isSimple() || !isElementType(ValTy))
+            return std::nullopt;
+        C = TTI.getMemoryOpCost(Instruction::Store, widen(ValTy, VF), Store->getAlign(),
+                                Store->getPointerAddressSpace(), Kind);
+    } else if (auto *II = dyn_cast<IntrinsicInst>(&I)) {
+        if (!isTriviallyVectorizable(II->getIntrinsicID()) || !isElementType(II->getType()))
+            return std::nullopt;
+        SmallVector<Type *, 4> Args;
+        for (const Value *Arg : II->args()) {
+            if (!isElementType(Arg->getType()))
+                return std::nullopt;
+            Args.push_back(widen(Arg->getType(), VF));
+        }
+        C = TTI.getIntrinsicInstrCost(
+            IntrinsicCostAttributes(II->getIntrinsicID(), widen(II->getType(), VF), Args),
+            Kind);
+    } else {
+        return std::nullopt;
+    }
+    if (!C.isValid())
+        return std::nullopt;
+    return double(*C.getValue());
+}
+
+// The lanes an innermost loop could use: as many of its widest element type
+// as fit in VectorBits.
+unsigned vectorFactor(const Loop &L, unsigned VectorBits, const DataLayout &DL) {
+    unsigned WidestBits = 8;
+    for (const BasicBlock *BB : L.blocks())
+        for (const Instruction &I : *BB) {
+            Type *Ty = I.getType();
+            if (auto *Store = dyn_cast<StoreInst>(&I))
+                Ty = Store->getValueOperand()->getType();
+            if (isElementType(Ty))
+                WidestBits = std::max<unsigned>(WidestBits, DL.getTypeSizeInBits(Ty));
+        }
+    return VectorBits / WidestBits;
+}
+
+// A function's cost on each compared CPU.
+struct Comparison {
+    Function *F;
+    std::vector<TargetCost> Costs; // one per CPU
+    unsigned Best = 0;             // index of the cheapest CPU
+    double gain() const {
+        return Costs[0].Throughput > 0 ? 1 - Costs[Best].Throughput / Costs[0].Throughput : 0;
+    }
+};
+
+} // namespace
+
+Expected<std::vector<std::unique_ptr<TargetMachine>>>
+createTargetMachines(const Module &M, ArrayRef<std::string> CPUs) {
+    std::string Error;
+    const Target *T = TargetRegistry::lookupTarget(M.getTargetTriple(), Error);
+    if (!T)
+        return createStringError(inconvertibleErrorCode(), Error);
+    std::vector<std::unique_ptr<TargetMachine>> Machines;
+    for (const std::string &CPU : CPUs) {
+        std::unique_ptr<TargetMachine> TM(
+            T->createTargetMachine(M.getTargetTriple(), CPU, "", TargetOptions(), std::nullopt));
+        if (!TM || !TM->getMCSubtargetInfo()->isCPUStringValid(CPU))
+            return createStringError(inconvertibleErrorCode(), "unknown CPU '" + CPU +
+                                                                   "' for " +
+                                                                   M.getTargetTriple());
+        Machines.push_back(std::move(TM));
+    }
+    return Machines;
+}
+
+TargetCost estimateTargetCost(Function &F, const TargetMachine &TM, const FunctionProfile &Prof,
+                              const LoopInfo &LI) {
+    TargetOverride Override(F, TM.getTargetCPU());
+    TargetTransformInfo TTI = TM.getTargetTransformInfo(F);
+    const DataLayout &DL = F.getParent()->getDataLayout();
+
+    TargetCost TC;
+    TC.VectorBits =
+        TTI.getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector).getFixedValue();
+    uint64_t Preferred = 0;
+    Attribute PreferAttr = F.getFnAttribute("prefer-vector-width");
+    if (PreferAttr.isValid() && !PreferAttr.getValueAsString().getAsInteger(10, Preferred) &&
+        Preferred)
+        TC.VectorBits = std::min<uint64_t>(TC.VectorBits, Preferred);
+
+    SmallPtrSet<const BasicBlock *, 32> Vectorized;
+    for (const Loop *L : LI.getLoopsInPreorder()) {
+        if (!L->isInnermost())
+            continue;
+        unsigned VF = vectorFactor(*L, TC.VectorBits, DL);
+        if (VF < 2)
+            continue;
+        // Cost each block per scalar iteration: a vector iteration covers VF.
+        double Scalar = 0, Vector = 0;
+        bool Vectorizable = true;
+        for (const BasicBlock *BB : L->blocks()) {
+            double Executions = Prof.blockCount(*BB);
+            Scalar += blockCost(*BB, TTI).Throughput * Executions;
+            for (const Instruction &I : *BB) {
+                std::optional<double> C = vectorCost(I, VF, TTI);
+                if (!C) {
+                    Vectorizable = false;
+                    break;
+                }
+                Vector += *C / VF * Executions;
+            }
+            if (!Vectorizable)
+                break;
+        }
+        if (!Vectorizable || Vector >= Scalar)
+            continue;
+        TC.Throughput += Vector;
+        ++TC.VectorizedLoops;
+        Vectorized.insert(L->block_begin(), L->block_end());
+    }
+    for (const BasicBlock &BB : F)
+        if (!Vectorized.count(&BB))
+            TC.Throughput += blockCost(BB, TTI).Throughput * Prof.blockCount(BB);
+    return TC;
+}
+
+void reportTargetComparison(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                            Report &R, ArrayRef<std::string> CPUs, double MinGain) {
+    if (CPUs.size() < 2)
+        return;
+    auto Machines = createTargetMachines(M, CPUs);
+    if (!Machines) {
+        WithColor::warning() << "skeleton: cannot compare targets: "
+                             << toString(Machines.takeError()) << "\n";
+        return;
+    }
+
+    std::vector<Comparison> Functions;
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+        const LoopInfo &LI = FAM.getResult<LoopAnalysis>(F);
+        Comparison C{&F};
+        for (const auto &TM : *Machines) {
+            C.Costs.push_back(estimateTargetCost(F, *TM, Prof, LI));
+            if (C.Costs.back().Throughput < C.Costs[C.Best].Throughput)
+                C.Best = C.Costs.size() - 1;
+        }
+        Functions.push_back(std::move(C));
+    }
+    llvm::stable_sort(Functions, [](const Comparison &A, const Comparison &B) {
+        return A.gain() > B.gain();
+    });
+    unsigned Candidates = llvm::count_if(
+        Functions, [&](const Comparison &C) { return C.gain() >= MinGain; });
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🎯 Target Comparison (throughput cost per CPU" << (PerCall ? " per call" : "")
+                   << ", relative to " << CPUs.front() << "; " << Candidates << " of "
+                   << Functions.size() << " functions gain at least "
+                   << format("%.0f", MinGain * 100) << "%)\n";
+
+    for (const Comparison &C : Functions) {
+        if (!R.withinBudget())
+            return;
+        bool Candidate = C.gain() >= MinGain;
+        if (!R.isText()) {
+            R.record("target_cost", [&](json::OStream &J) {
+                J.attribute("function", C.F->getName());
+                J.attribute("per_call", PerCall);
+                J.attributeArray("costs", [&] {
+                    for (size_t I = 0; I < CPUs.size(); ++I)
+                        J.object([&] {
+                            J.attribute("cpu", CPUs[I]);
+                            J.attribute("throughput", C.Costs[I].Throughput);
+                            J.attribute("vector_bits", C.Costs[I].VectorBits);
+                            J.attribute("vectorized_loops", C.Costs[I].VectorizedLoops);
+                        });
+                });
+                J.attribute("best_cpu", CPUs[C.Best]);
+                J.attribute("gain", C.gain());
+                J.attribute("candidate", Candidate);
+            });
+            continue;
+        }
+        if (!Candidate)
+            continue;
+        raw_ostream &OS = R.stream();
+        OS << "   • " << C.F->getName() << "  ⬆️  " << format("%.0f", C.gain() * 100)
+           << "% cheaper on " << CPUs[C.Best] << "\n      ";
+        for (size_t I = 0; I < CPUs.size(); ++I) {
+            const TargetCost &TC = C.Costs[I];
+            OS << (I ? " │ " : "") << CPUs[I] << " " << format("%.1f", TC.Throughput);
+            if (I && C.Costs[0].Throughput > 0)
+                OS << " (" << format("%+.0f", (TC.Throughput / C.Costs[0].Throughput - 1) * 100)
+                   << "%)";
+            if (TC.VectorizedLoops)
+                OS << " [" << TC.VectorizedLoops << " loop" << (TC.VectorizedLoops == 1 ? "" : "s")
+                   << " at " << TC.VectorBits << " bits]";
+        }
+        OS << "\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
@@ -0,0 +1,44 @@
+#ifndef SKELETON_TARGETCOMPARE_H
+#define SKELETON_TARGETCOMPARE_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Function;
+class LoopInfo;
+class Module;
+class TargetMachine;
+} // namespace llvm
+
+namespace skeleton {
+
+class FunctionProfile;
+
+// A function's estimated cost on one CPU of the module's target.
+struct TargetCost {
+    double Throughput = 0;       // weighted by estimated block executions
+    unsigned VectorBits = 0;     // usable vector width: registers, capped by preference
+    unsigned VectorizedLoops = 0; // innermost loops assumed to vectorize
+};
+
+// One target machine per CPU name, for the module's triple. Fails on a triple
+// no registered target handles or a CPU the target does not know.
+llvm::Expected<std::vector<std::unique_ptr<llvm::TargetMachine>>>
+createTargetMachines(const llvm::Module &M, llvm::ArrayRef<std::string> CPUs);
+
+// F's throughput cost as compiled for TM's CPU, in place of the CPU and
+// features F carries. Innermost loops whose instructions all have a vector
+// form are costed as if vectorized at the widest width their element types
+// allow, so the estimate shows what wider registers would buy before the
+// vectorizer has run. F's attributes are swapped for the estimate and restored.
+TargetCost estimateTargetCost(llvm::Function &F, const llvm::TargetMachine &TM,
+                              const FunctionProfile &Prof, const llvm::LoopInfo &LI);
+
+} // namespace skeleton
+
+#endif // SKELETON_TARGETCOMPARE_H
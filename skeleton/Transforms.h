@@ -0,0 +1,74 @@
+#ifndef SKELETON_TRANSFORMS_H
+#define SKELETON_TRANSFORMS_H
+
+#include "Instrumentation.h"
+
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class Module;
+class ProfileSummaryInfo;
+} // namespace llvm
+
+namespace skeleton {
+
+class Report;
+
+// Opt-in IR transforms. Each one runs after the report sections, writes what
+// it changed (or why it left a candidate alone) to the report, and returns
+// true if it modified the module.
+
+// Moves the cold fields of struct types whose objects are all visible in the
+// module into a side struct reached through a pointer appended to the hot
+// part. A field is cold when its weighted access count is at most ColdRatio
+// times that of the hottest field of its struct.
+bool splitColdStructFields(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                           llvm::ProfileSummaryInfo &PSI, Report &R, double ColdRatio);
+
+// Aligns every global on a cache line flagged by reportFalseSharing() to a
+// cache-line boundary, so that no two of them share a line.
+bool alignFalseSharingGlobals(llvm::Module &M, Report &R, unsigned CacheLine);
+
+// Peels the dominant cases of each switch, hottest first, into
+// compare-and-branches ahead of it, and sets the branch weights of the
+// compares and of what is left of the switch from the hit counts. Counts come
+// from the "switch" sites of Profile, written by instrumentSwitches() code,
+// or from the switch's own !prof weights. A case is peeled while its compare
+// would be taken at least MinShare of the times it runs, up to MaxCases per
+// switch.
+bool peelSwitchCases(llvm::Module &M, Report &R, const SiteProfile &Profile, double MinShare,
+                     unsigned MaxCases);
+
+// Marks noalias the pointer arguments of internal functions for which
+// reportNoAliasCandidates() proves it safe: every call is direct and passes an
+// uncaptured, identified object of the caller that no other argument aliases,
+// and the function does not capture the argument.
+bool addNoAliasArguments(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                         llvm::ProfileSummaryInfo &PSI, Report &R);
+
+// Clones each of Functions once per x86-64 micro-architecture level in CPUs
+// (x86-64-v2, v3, v4) above the one it is built for, and replaces it with an
+// ifunc whose resolver picks the clone of the highest level the running CPU
+// supports, found with cpuid, or the original body. With Functions = {"auto"},
+// a function is cloned for each level that makes it at least MinGain cheaper
+// by estimateTargetCost(). Needs an x86-64 ELF target.
+bool multiversionFunctions(llvm::Module &M, llvm::FunctionAnalysisManager &FAM,
+                           llvm::ProfileSummaryInfo &PSI, Report &R,
+                           llvm::ArrayRef<std::string> Functions,
+                           llvm::ArrayRef<std::string> CPUs, double MinGain);
+
+// Counts the executions of every atomic instruction, and the failures of each
+// cmpxchg, in counters dumped by the runtime at exit.
+bool instrumentAtomics(llvm::Module &M, Report &R);
+
+// Times every call to a lock primitive and accumulates, per site and thread,
+// the calls, total and longest wait in nanoseconds, and failed try-locks.
+bool instrumentLocks(llvm::Module &M, Report &R);
+
+// Counts, per thread, how often each switch takes each of its cases and its
+// default, through a counting block on every switch edge.
+bool instrumentSwitches(llvm::Module &M, Report &R);
+
+} // namespace skeleton
+
+#endif // SKELETON_TRANSFORMS_H
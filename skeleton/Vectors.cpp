@@ -0,0 +1,297 @@
+#include "Vectors.h"
+#include "Analyses.h"
+#include "Profile.h"
+#include "Report.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Format.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace llvm;
+
+namespace skeleton {
+
+namespace {
+
+struct TypeUse {
+    VectorType *Type;
+    uint64_t Bits;
+    unsigned Count = 0;
+};
+
+struct SimdFunction {
+    Function *F;
+    unsigned Instructions = 0;
+    unsigned VectorOps = 0;
+    double Executions = 0;       // all instructions, by estimated block executions
+    double VectorExecutions = 0;
+    unsigned Arithmetic = 0;     // vector binops, compares, selects, casts and calls
+    unsigned Memory = 0;         // vector loads and stores
+    unsigned Shuffles = 0;
+    unsigned Extracts = 0;
+    unsigned Inserts = 0;
+    unsigned BuildVectors = 0;   // vectors assembled by chains of insertelement
+    unsigned Scalarized = 0;     // vectors taken apart by extracts of several lanes
+    uint64_t TotalBits = 0;      // sum over vector ops of their widest vector
+    uint64_t WidestBits = 0;
+    uint64_t RegisterBits = 0;   // the target's fixed-width vector registers
+    uint64_t PreferredBits = 0;  // "prefer-vector-width", 0 when unset
+    std::map<std::string, TypeUse> Types;
+    std::map<std::string, unsigned> ShuffleKinds;
+
+    unsigned movement() const { return Shuffles + Extracts + Inserts; }
+    double averageBits() const { return VectorOps ? double(TotalBits) / VectorOps : 0; }
+    // More lanes moved around than computed on.
+    bool shuffleDominated() const { return movement() > Arithmetic; }
+    // The width the vectorizer may use: the registers, capped by the
+    // function's preferred width.
+    uint64_t usableBits() const {
+        return PreferredBits ? std::min(PreferredBits, RegisterBits) : RegisterBits;
+    }
+    // No vector op fills that width.
+    bool narrow() const { return usableBits() && WidestBits < usableBits(); }
+    bool scalarized() const { return BuildVectors || Scalarized; }
+};
+
+bool touchesVectors(Function &F) {
+    for (Instruction &I : instructions(F)) {
+        if (I.getType()->isVectorTy())
+            return true;
+        for (Value *Op : I.operands())
+            if (Op->getType()->isVectorTy())
+                return true;
+    }
+    return false;
+}
+
+void analyze(SimdFunction &SF, FunctionProfile &Prof, const DataLayout &DL) {
+    DenseMap<Value *, unsigned> LanesExtracted;
+    for (BasicBlock &BB : *SF.F) {
+        double Count = Prof.blockCount(BB);
+        for (Instruction &I : BB) {
+            if (isa<PHINode>(I) || isa<DbgInfoIntrinsic>(I))
+                continue;
+            ++SF.Instructions;
+            SF.Executions += Count;
+            VectorType *VT = widestVectorType(I, DL);
+            if (!VT)
+                continue;
+            ++SF.VectorOps;
+            SF.VectorExecutions += Count;
+            uint64_t Bits = DL.getTypeSizeInBits(VT).getKnownMinValue();
+            SF.TotalBits += Bits;
+            SF.WidestBits = std::max(SF.WidestBits, Bits);
+            TypeUse &Use = SF.Types.try_emplace(typeName(VT), TypeUse{VT, Bits}).first->second;
+            ++Use.Count;
+
+            if (auto *SV = dyn_cast<ShuffleVectorInst>(&I)) {
+                ++SF.Shuffles;
+                ++SF.ShuffleKinds[shuffleKind(*SV).str()];
+            } else if (auto *EE = dyn_cast<ExtractElementInst>(&I)) {
+                ++SF.Extracts;
+                if (isa<ConstantInt>(EE->getIndexOperand()))
+                    ++LanesExtracted[EE->getVectorOperand()];
+            } else if (auto *IE = dyn_cast<InsertElementInst>(&I)) {
+                ++SF.Inserts;
+                // Count each chain once, at its last insert.
+                bool Last = none_of(IE->users(), [&](User *U) {
+                    auto *Next = dyn_cast<InsertElementInst>(U);
+                    return Next && Next->getOperand(0) == IE;
+                });
+                if (Last && isa<InsertElementInst>(IE->getOperand(0)))
+                    ++SF.BuildVectors;
+            } else if (isa<LoadInst>(I) || isa<StoreInst>(I)) {
+                ++SF.Memory;
+            } else if (isa<BinaryOperator>(I) || isa<UnaryOperator>(I) || isa<CmpInst>(I) ||
+                       isa<SelectInst>(I) || isa<CastInst>(I) || isa<CallBase>(I)) {
+                ++SF.Arithmetic;
+            }
+        }
+    }
+    for (const auto &[V, N] : LanesExtracted)
+        SF.Scalarized += N >= 2;
+}
+
+} // namespace
+
+StringRef shuffleKind(const ShuffleVectorInst &SV) {
+    if (SV.isIdentity())
+        return "identity";
+    if (SV.isZeroEltSplat())
+        return "broadcast";
+    if (SV.isReverse())
+        return "reverse";
+    if (SV.isSelect())
+        return "select";
+    if (SV.isTranspose())
+        return "transpose";
+    if (SV.isConcat())
+        return "concat";
+    return "permute";
+}
+
+VectorType *widestVectorType(const Instruction &I, const DataLayout &DL) {
+    VectorType *Widest = nullptr;
+    uint64_t WidestBits = 0;
+    auto Consider = [&](Type *T) {
+        auto *VT = dyn_cast<VectorType>(T);
+        if (!VT)
+            return;
+        uint64_t Bits = DL.getTypeSizeInBits(VT).getKnownMinValue();
+        if (!Widest || Bits > WidestBits) {
+            Widest = VT;
+            WidestBits = Bits;
+        }
+    };
+    Consider(I.getType());
+    for (const Value *Op : I.operands())
+        Consider(Op->getType());
+    return Widest;
+}
+
+void reportSimdUtilization(Module &M, FunctionAnalysisManager &FAM, ProfileSummaryInfo &PSI,
+                           Report &R, StringRef Stage) {
+    const DataLayout &DL = M.getDataLayout();
+    std::vector<SimdFunction> Functions;
+    unsigned Definitions = 0, VectorOps = 0;
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+        ++Definitions;
+        if (!touchesVectors(F))
+            continue;
+        SimdFunction SF{&F};
+        FunctionProfile Prof(F, PSI, FAM.getResult<BlockFrequencyAnalysis>(F));
+        analyze(SF, Prof, DL);
+        SF.RegisterBits = FAM.getResult<TargetIRAnalysis>(F)
+                              .getRegisterBitWidth(TargetTransformInfo::RGK_FixedWidthVector)
+                              .getFixedValue();
+        Attribute Preferred = F.getFnAttribute("prefer-vector-width");
+        if (Preferred.isValid())
+            Preferred.getValueAsString().getAsInteger(10, SF.PreferredBits);
+        VectorOps += SF.VectorOps;
+        Functions.push_back(std::move(SF));
+    }
+    if (Functions.empty())
+        return;
+
+    bool PerCall = !PSI.hasProfileSummary();
+    if (R.isText() && R.withinBudget())
+        R.stream() << "🧬 SIMD Utilization "
+                   << (Stage == "optimizer_last" ? "after optimization" : "at pipeline start")
+                   << " (" << Functions.size() << " of " << Definitions
+                   << " functions use vectors, " << VectorOps
+                   << " vector ops; widths against the target's vector registers)\n";
+
+    for (const SimdFunction &SF : Functions) {
+        if (!R.withinBudget())
+            return;
+        double Fraction = double(SF.VectorOps) / std::max(1u, SF.Instructions);
+        double Executed = SF.Executions ? SF.VectorExecutions / SF.Executions : 0;
+        double Utilization = SF.usableBits() ? SF.averageBits() / SF.usableBits() : 0;
+        if (!R.isText()) {
+            R.record("simd_function", [&](json::OStream &J) {
+                J.attribute("function", SF.F->getName());
+                J.attribute("stage", Stage);
+                J.attribute("instructions", SF.Instructions);
+                J.attribute("vector_ops", SF.VectorOps);
+                J.attribute("vector_fraction", Fraction);
+                J.attribute("executed_vector_fraction", Executed);
+                J.attribute("per_call", PerCall);
+                J.attribute("register_bits", static_cast<int64_t>(SF.RegisterBits));
+                if (SF.PreferredBits)
+                    J.attribute("preferred_bits", static_cast<int64_t>(SF.PreferredBits));
+                J.attribute("widest_bits", static_cast<int64_t>(SF.WidestBits));
+                J.attribute("average_bits", SF.averageBits());
+                J.attribute("utilization", Utilization);
+                J.attributeArray("types", [&] {
+                    for (const auto &[Name, Use] : SF.Types)
+                        J.object([&] {
+                            J.attribute("type", Name);
+                            J.attribute("lanes", Use.Type->getElementCount().getKnownMinValue());
+                            J.attribute("scalable", Use.Type->getElementCount().isScalable());
+                            J.attribute("element", typeName(Use.Type->getElementType()));
+                            J.attribute("bits", static_cast<int64_t>(Use.Bits));
+                            J.attribute("count", Use.Count);
+                        });
+                });
+                J.attribute("arithmetic", SF.Arithmetic);
+                J.attribute("memory", SF.Memory);
+                J.attribute("shuffles", SF.Shuffles);
+                J.attributeObject("shuffle_kinds", [&] {
+                    for (const auto &[Kind, N] : SF.ShuffleKinds)
+                        J.attribute(Kind, N);
+                });
+                J.attribute("extracts", SF.Extracts);
+                J.attribute("inserts", SF.Inserts);
+                J.attribute("build_vectors", SF.BuildVectors);
+                J.attribute("scalarized_vectors", SF.Scalarized);
+                J.attributeArray("flags", [&] {
+                    if (SF.shuffleDominated())
+                        J.value("shuffle_dominated");
+                    if (SF.narrow())
+                        J.value("narrow");
+                    if (SF.scalarized())
+                        J.value("scalarized");
+                });
+            });
+            continue;
+        }
+        raw_ostream &OS = R.stream();
+        OS << "   ┌─ " << SF.F->getName() << ": " << SF.VectorOps << " of " << SF.Instructions
+           << " instructions vector (" << format("%.0f", Fraction * 100) << "%, "
+           << format("%.0f", Executed * 100) << "% of executed)\n";
+        OS << "   │  Width: widest " << SF.WidestBits << " bits, average "
+           << format("%.0f", SF.averageBits()) << " of " << SF.RegisterBits
+           << "-bit registers";
+        if (SF.PreferredBits)
+            OS << " (prefer-vector-width " << SF.PreferredBits << ")";
+        OS << ", " << format("%.0f", Utilization * 100) << "% utilized\n";
+        OS << "   │  Types:";
+        ListSeparator LS(",");
+        for (const auto &[Name, Use] : SF.Types)
+            OS << LS << " " << Name << " ×" << Use.Count;
+        OS << "\n";
+        OS << "   │  Ops: " << SF.Arithmetic << " arithmetic, " << SF.Memory << " memory, "
+           << SF.Shuffles << " shuffle" << (SF.Shuffles == 1 ? "" : "s");
+        if (!SF.ShuffleKinds.empty()) {
+            OS << " (";
+            ListSeparator KS(", ");
+            for (const auto &[Kind, N] : SF.ShuffleKinds)
+                OS << KS << Kind << " " << N;
+            OS << ")";
+        }
+        OS << ", " << SF.Extracts << " extracts, " << SF.Inserts << " inserts\n";
+        if (SF.shuffleDominated())
+            OS << "   │  ⚠️  Shuffle-dominated: " << SF.movement()
+               << " lane moves for " << SF.Arithmetic << " arithmetic\n";
+        if (SF.narrow())
+            OS << "   │  ⚠️  Narrow: never uses the full " << SF.usableBits() << "-bit width\n";
+        if (SF.scalarized()) {
+            OS << "   │  ⚠️  Scalarized: ";
+            ListSeparator SS(", ");
+            if (SF.BuildVectors)
+                OS << SS << SF.BuildVectors << " vector" << (SF.BuildVectors == 1 ? "" : "s")
+                   << " built lane by lane";
+            if (SF.Scalarized)
+                OS << SS << SF.Scalarized << " vector" << (SF.Scalarized == 1 ? "" : "s")
+                   << " taken apart lane by lane";
+            OS << "\n";
+        }
+        OS << "   └─────────────────────────────────────────────────────\n";
+    }
+    if (R.isText())
+        R.stream() << "\n";
+}
+
+} // namespace skeleton
@@ -0,0 +1,25 @@
+#ifndef SKELETON_VECTORS_H
+#define SKELETON_VECTORS_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+class DataLayout;
+class Instruction;
+class ShuffleVectorInst;
+class VectorType;
+} // namespace llvm
+
+namespace skeleton {
+
+// How a shufflevector moves lanes: "identity", "broadcast", "reverse",
+// "select", "transpose", "concat", or "permute" for any other mask.
+llvm::StringRef shuffleKind(const llvm::ShuffleVectorInst &SV);
+
+// The widest vector type among I's result and operands, or null if I touches
+// no vectors. Scalable vectors are compared by their minimum size.
+llvm::VectorType *widestVectorType(const llvm::Instruction &I, const llvm::DataLayout &DL);
+
+} // namespace skeleton
+
+#endif // SKELETON_VECTORS_H
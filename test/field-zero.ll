@@ -0,0 +1,25 @@
+; Accesses to field 0 go through an all-zero GEP, which
+; Value::stripPointerCasts() looks through. The layout and heat map sections
+; still count them against field 0.
+
+; RUN: %opt-skeleton -passes='default<O0>' -disable-output %s 2>&1 | FileCheck %s
+
+; CHECK: Struct Layouts
+; CHECK: %struct.S: 16 bytes
+; CHECK-NEXT: Accesses: 1 loads, 1 stores, 2 GEPs, 0 allocas
+
+; CHECK: Field Access Heat Map
+; CHECK-NEXT: %struct.S: 2.0 weighted accesses, 2 GEPs
+; CHECK-NEXT: #0 @0 i64 1 / 0 1.0
+; CHECK-NEXT: #1 @8 i32 0 / 1 1.0
+; CHECK-NEXT: #2 @12 i32 0 / 0 0.0 cold
+
+%struct.S = type { i64, i32, i32 }
+
+define i64 @f(ptr %p) {
+  %f0 = getelementptr inbounds %struct.S, ptr %p, i64 0, i32 0
+  %a = load i64, ptr %f0
+  %f1 = getelementptr inbounds %struct.S, ptr %p, i64 0, i32 1
+  store i32 1, ptr %f1
+  ret i64 %a
+}
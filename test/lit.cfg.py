@@ -0,0 +1,20 @@
+import os
+
+import lit.formats
+
+config.name = "Skeleton"
+config.test_format = lit.formats.ShTest(True)
+config.suffixes = [".ll"]
+config.test_source_root = os.path.dirname(__file__)
+config.test_exec_root = config.skeleton_obj_root
+
+# opt and FileCheck come from the LLVM the plugin is built against.
+config.environment["PATH"] = os.pathsep.join(
+    [config.llvm_tools_dir, config.environment.get("PATH", "")])
+
+config.substitutions.append(
+    ("%opt-skeleton", "opt -load-pass-plugin=" + config.skeleton_plugin))
+
+# Tests that need a backend say so with REQUIRES: <arch>-registered-target.
+for target in config.targets_to_build.split(";"):
+    config.available_features.add(target.lower() + "-registered-target")
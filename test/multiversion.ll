@@ -0,0 +1,69 @@
+; -skeleton-multiversion clones a function per x86-64 level with that level's
+; CPU and features, and dispatches through an ifunc whose resolver checks the
+; running CPU's level. A function built with a level's feature turned off
+; keeps its single body.
+
+; REQUIRES: x86-registered-target
+; RUN: %opt-skeleton -passes='default<O0>' -skeleton-multiversion=scale,noavx \
+; RUN:   -skeleton-multiversion-cpus=x86-64-v3,x86-64-v4 -S %s 2>%t.report | FileCheck %s
+; RUN: FileCheck %s --check-prefix=REPORT < %t.report
+
+; CHECK: @scale = ifunc void (ptr, i64), ptr @scale.resolver
+; CHECK-NOT: ifunc
+
+; CHECK: define internal void @scale.default(ptr %p, i64 %n) #[[DEFAULT:[0-9]+]]
+; CHECK: define void @noavx(ptr %p, i64 %n) #[[NOAVX:[0-9]+]]
+; CHECK: define internal void @scale.x86-64-v3(ptr %p, i64 %n) #[[V3:[0-9]+]]
+; CHECK: define internal void @scale.x86-64-v4(ptr %p, i64 %n) #[[V4:[0-9]+]]
+
+; CHECK: define internal ptr @scale.resolver()
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %[[LEVEL:[0-9]+]] = call i32 @skeleton.x86_64_level()
+; CHECK-NEXT: %[[GE3:[0-9]+]] = icmp uge i32 %[[LEVEL]], 3
+; CHECK-NEXT: %[[SEL3:[0-9]+]] = select i1 %[[GE3]], ptr @scale.x86-64-v3, ptr @scale.default
+; CHECK-NEXT: %[[GE4:[0-9]+]] = icmp uge i32 %[[LEVEL]], 4
+; CHECK-NEXT: %[[SEL4:[0-9]+]] = select i1 %[[GE4]], ptr @scale.x86-64-v4, ptr %[[SEL3]]
+; CHECK-NEXT: ret ptr %[[SEL4]]
+
+; CHECK: define linkonce_odr hidden i32 @skeleton.x86_64_level()
+; CHECK: call { i32, i32, i32, i32 } asm "cpuid"
+; CHECK: asm sideeffect "xgetbv"
+
+; CHECK: attributes #[[DEFAULT]] = { "target-cpu"="x86-64" "target-features"="+sse2" }
+; CHECK: attributes #[[NOAVX]] = { "target-cpu"="x86-64" "target-features"="+sse2,-avx" }
+; CHECK: attributes #[[V3]] = { "target-cpu"="x86-64-v3" "target-features"="+sse2,+cmov,{{.*}},+avx,+avx2,
+; CHECK-NOT: avx512
+; CHECK-SAME: }
+; CHECK: attributes #[[V4]] = { "target-cpu"="x86-64-v4" "target-features"="+sse2,+cmov,{{.*}},+avx2,{{.*}},+avx512f,+avx512vl" }
+
+; REPORT: Function Multiversioning
+; REPORT: scale; cloned for x86-64-v3, x86-64-v4; dispatched by scale.resolver
+; REPORT: noavx; kept: target-features disable avx, needed by x86-64-v3
+
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+define void @scale(ptr %p, i64 %n) #0 {
+entry:
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i1, %loop ]
+  %a = getelementptr inbounds float, ptr %p, i64 %i
+  %v = load float, ptr %a
+  %m = fmul float %v, 2.0
+  store float %m, ptr %a
+  %i1 = add i64 %i, 1
+  %c = icmp slt i64 %i1, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+define void @noavx(ptr %p, i64 %n) #1 {
+entry:
+  call void @scale(ptr %p, i64 %n)
+  ret void
+}
+
+attributes #0 = { "target-cpu"="x86-64" "target-features"="+sse2" }
+attributes #1 = { "target-cpu"="x86-64" "target-features"="+sse2,-avx" }
@@ -0,0 +1,59 @@
+; Struct splitting moves everything after the entry block's allocas into a
+; new block, here the store that captures %buf. addNoAliasArguments() must see
+; that capture, so @copy's %d stays without noalias while %s gets it.
+
+; RUN: %opt-skeleton -passes='default<O0>' -skeleton-split-structs \
+; RUN:   -skeleton-add-noalias -S %s 2>%t.report | FileCheck %s
+; RUN: FileCheck %s --check-prefix=REPORT < %t.report
+
+; CHECK: define internal void @copy(ptr %d, ptr noalias %s, i64 %n)
+; CHECK: define i64 @main()
+; CHECK: split.link:
+
+; REPORT: Struct Splitting
+; REPORT: %struct.S: cold fields {1}
+; REPORT-SAME: split 1 objects
+; REPORT: noalias Arguments
+; REPORT: copy %d; kept: main:exit:1 passes %buf, captured before the call
+; REPORT: copy %s; added
+
+%struct.S = type { i64, [64 x i8] }
+
+@sink = global ptr null
+
+define internal void @copy(ptr %d, ptr %s, i64 %n) {
+entry:
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i1, %loop ]
+  %ps = getelementptr inbounds i32, ptr %s, i64 %i
+  %pd = getelementptr inbounds i32, ptr %d, i64 %i
+  %v = load i32, ptr %ps
+  store i32 %v, ptr %pd
+  %i1 = add i64 %i, 1
+  %c = icmp slt i64 %i1, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+define i64 @main() {
+entry:
+  %objs = alloca [4 x %struct.S]
+  %buf = alloca [16 x i32]
+  %dst = alloca [16 x i32]
+  store ptr %buf, ptr @sink
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i1, %loop ]
+  %sum = phi i64 [ 0, %entry ], [ %sum1, %loop ]
+  %f = getelementptr inbounds [4 x %struct.S], ptr %objs, i64 0, i64 %i, i32 0
+  %v = load i64, ptr %f
+  %sum1 = add i64 %sum, %v
+  %i1 = add i64 %i, 1
+  %c = icmp slt i64 %i1, 4
+  br i1 %c, label %loop, label %exit
+exit:
+  call void @copy(ptr %buf, ptr %dst, i64 16)
+  ret i64 %sum1
+}
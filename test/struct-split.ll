@@ -0,0 +1,137 @@
+; Struct splitting moves field 1 of each struct to a cold side struct only
+; when every access through a field address provably stays inside the field.
+; %struct.Ok is split. The others reach past their cold field and are kept.
+
+; RUN: %opt-skeleton -passes='default<O0>' -skeleton-split-structs \
+; RUN:   -skeleton-split-cold-ratio=0.1 -S %s 2>%t.report | FileCheck %s
+; RUN: FileCheck %s --check-prefix=REPORT < %t.report
+
+; CHECK-DAG: %struct.Ok.hot = type { i64, ptr }
+; CHECK-DAG: %struct.Ok.cold = type { [64 x i8] }
+; CHECK-NOT: %struct.Bytes.hot
+; CHECK-NOT: %struct.Back.hot
+; CHECK-NOT: %struct.Long.hot
+; CHECK-NOT: %struct.Var.hot
+
+; CHECK-LABEL: define void @ok(
+; CHECK: alloca [4 x %struct.Ok.hot]
+; CHECK: alloca [4 x %struct.Ok.cold]
+; CHECK: exit:
+; CHECK: %cold = load ptr, ptr
+; CHECK: %name = getelementptr inbounds %struct.Ok.cold, ptr %cold, i64 0, i32 0
+; CHECK: call void @llvm.memset.p0.i64(ptr %name, i8 0, i64 64, i1 false)
+
+; REPORT: Struct Splitting
+; REPORT: %struct.Ok: cold fields {1}
+; REPORT-SAME: split 1 objects
+; REPORT: %struct.Bytes: cold fields {1}
+; REPORT-SAME: kept: pointer arithmetic on a field address in @bytes
+; REPORT: %struct.Back: cold fields {1}
+; REPORT-SAME: kept: pointer arithmetic on a field address in @back
+; REPORT: %struct.Long: cold fields {1}
+; REPORT-SAME: kept: llvm.memset.p0.i64 may run past the end of a field in @long
+; REPORT: %struct.Var: cold fields {1}
+; REPORT-SAME: kept: variable-length llvm.memcpy.p0.p0.i64 may run past the end of a field in @var
+
+%struct.Ok = type { i64, [64 x i8] }
+%struct.Bytes = type { i64, [64 x i8] }
+%struct.Back = type { i64, [64 x i8] }
+%struct.Long = type { i64, [64 x i8] }
+%struct.Var = type { i64, [64 x i8] }
+
+declare void @llvm.memset.p0.i64(ptr, i8, i64, i1)
+declare void @llvm.memcpy.p0.p0.i64(ptr, ptr, i64, i1)
+
+; Indexing into the field's own array and clearing exactly the field is fine.
+define void @ok() {
+entry:
+  %objs = alloca [4 x %struct.Ok]
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i1, %loop ]
+  %f = getelementptr inbounds [4 x %struct.Ok], ptr %objs, i64 0, i64 %i, i32 0
+  store i64 %i, ptr %f
+  %i1 = add i64 %i, 1
+  %c = icmp slt i64 %i1, 4
+  br i1 %c, label %loop, label %exit
+exit:
+  %name = getelementptr inbounds [4 x %struct.Ok], ptr %objs, i64 0, i64 0, i32 1
+  %ch = getelementptr inbounds [64 x i8], ptr %name, i64 0, i64 3
+  store i8 65, ptr %ch
+  call void @llvm.memset.p0.i64(ptr %name, i8 0, i64 64, i1 false)
+  ret void
+}
+
+; A byte offset from the cold field used to land on the next object's field 0.
+define void @bytes() {
+entry:
+  %objs = alloca [4 x %struct.Bytes]
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i1, %loop ]
+  %f = getelementptr inbounds [4 x %struct.Bytes], ptr %objs, i64 0, i64 %i, i32 0
+  store i64 %i, ptr %f
+  %i1 = add i64 %i, 1
+  %c = icmp slt i64 %i1, 4
+  br i1 %c, label %loop, label %exit
+exit:
+  %name = getelementptr inbounds [4 x %struct.Bytes], ptr %objs, i64 0, i64 0, i32 1
+  %next = getelementptr i8, ptr %name, i64 64
+  store i64 0, ptr %next
+  ret void
+}
+
+; container_of: from the cold field back to the start of its object.
+define i64 @back() {
+entry:
+  %objs = alloca [4 x %struct.Back]
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i1, %loop ]
+  %f = getelementptr inbounds [4 x %struct.Back], ptr %objs, i64 0, i64 %i, i32 0
+  store i64 %i, ptr %f
+  %i1 = add i64 %i, 1
+  %c = icmp slt i64 %i1, 4
+  br i1 %c, label %loop, label %exit
+exit:
+  %name = getelementptr inbounds [4 x %struct.Back], ptr %objs, i64 0, i64 1, i32 1
+  %obj = getelementptr i8, ptr %name, i64 -8
+  %v = load i64, ptr %obj
+  ret i64 %v
+}
+
+; Clearing the field and the next object's field 0 in one memset.
+define void @long() {
+entry:
+  %objs = alloca [4 x %struct.Long]
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i1, %loop ]
+  %f = getelementptr inbounds [4 x %struct.Long], ptr %objs, i64 0, i64 %i, i32 0
+  store i64 %i, ptr %f
+  %i1 = add i64 %i, 1
+  %c = icmp slt i64 %i1, 4
+  br i1 %c, label %loop, label %exit
+exit:
+  %name = getelementptr inbounds [4 x %struct.Long], ptr %objs, i64 0, i64 0, i32 1
+  call void @llvm.memset.p0.i64(ptr %name, i8 0, i64 72, i1 false)
+  ret void
+}
+
+; A copy whose length is only known at run time.
+define void @var(ptr %src, i64 %n) {
+entry:
+  %objs = alloca [4 x %struct.Var]
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i1, %loop ]
+  %f = getelementptr inbounds [4 x %struct.Var], ptr %objs, i64 0, i64 %i, i32 0
+  store i64 %i, ptr %f
+  %i1 = add i64 %i, 1
+  %c = icmp slt i64 %i1, 4
+  br i1 %c, label %loop, label %exit
+exit:
+  %name = getelementptr inbounds [4 x %struct.Var], ptr %objs, i64 0, i64 0, i32 1
+  call void @llvm.memcpy.p0.p0.i64(ptr %name, ptr %src, i64 %n, i1 false)
+  ret void
+}
@@ -0,0 +1,70 @@
+; -skeleton-peel-switches moves the dominant cases of a switch into compares
+; ahead of it, hottest first, while each compare would be taken at least
+; -skeleton-peel-min-share of the times it runs. Without a profile the hits
+; come from the switch's !prof weights.
+
+; RUN: %opt-skeleton -passes='default<O0>' -skeleton-peel-switches -S %s \
+; RUN:   2>%t.report | FileCheck %s
+; RUN: FileCheck %s --check-prefix=REPORT < %t.report
+
+; CHECK-LABEL: define i32 @dispatch(
+; CHECK: entry:
+; CHECK-NEXT: %sw.peel = icmp eq i32 %x, 1
+; CHECK-NEXT: br i1 %sw.peel, label %common, label %sw.rest, !prof ![[FIRST:[0-9]+]]
+; CHECK: sw.rest:
+; CHECK-NEXT: %sw.peel2 = icmp eq i32 %x, 2
+; CHECK-NEXT: br i1 %sw.peel2, label %other, label %sw.rest1, !prof ![[SECOND:[0-9]+]]
+; CHECK: sw.rest1:
+; CHECK-NEXT: switch i32 %x, label %common [
+; CHECK-NEXT: i32 4, label %third
+; CHECK-NEXT: i32 3, label %common
+; CHECK-NEXT: ], !prof ![[LEFT:[0-9]+]]
+
+; Case 1 shared %common with case 3 and the default: its PHI keeps both of
+; their entries and gains one for the compare.
+; CHECK: common:
+; CHECK-NEXT: %v = phi i32 [ %b, %other ], [ %a, %sw.rest1 ], [ %a, %sw.rest1 ], [ %a, %entry ]
+
+; CHECK-DAG: ![[FIRST]] = !{!"branch_weights", i32 600, i32 400}
+; CHECK-DAG: ![[SECOND]] = !{!"branch_weights", i32 250, i32 150}
+; The default, case 4 and case 3 keep their own weights.
+; CHECK-DAG: ![[LEFT]] = !{!"branch_weights", i32 30, i32 40, i32 80}
+
+; REPORT: Switch Case Peeling
+; REPORT: dispatch:entry:1  1000 weight; peeled case 1 (60%), case 2 (25%), 2 cases left in the switch
+; REPORT: flat:entry:1  300 weight; kept: no dominant case
+
+define i32 @dispatch(i32 %x, i32 %a, i32 %b) {
+entry:
+  switch i32 %x, label %common [
+    i32 1, label %common
+    i32 2, label %other
+    i32 3, label %common
+    i32 4, label %third
+  ], !prof !0
+other:
+  br label %common
+third:
+  ret i32 0
+common:
+  %v = phi i32 [ %b, %other ], [ %a, %entry ], [ %a, %entry ], [ %a, %entry ]
+  ret i32 %v
+}
+
+; No case reaches half of the hits.
+define i32 @flat(i32 %x) {
+entry:
+  switch i32 %x, label %d [
+    i32 1, label %one
+    i32 2, label %two
+  ], !prof !1
+one:
+  ret i32 1
+two:
+  ret i32 2
+d:
+  ret i32 0
+}
+
+!0 = !{!"branch_weights", i32 30, i32 600, i32 250, i32 80, i32 40}
+!1 = !{!"branch_weights", i32 100, i32 100, i32 100}